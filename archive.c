@@ -0,0 +1,538 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#if defined(WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// An on-disk archive of all primes up to some limit, for answering
+// count, nth prime and listing queries without sieving again.  The
+// primes are stored in blocks of SOE_ARCHIVE_BLOCK_PRIMES: the first
+// prime of a block is only in the index, the rest are gaps / 2 as
+// LEB128 varints (the gap from 2 to 3 is written as 0), which is one
+// byte per prime for gaps below 256.  The index has, for each block,
+// its first prime, the number of primes before it and the byte offset
+// of its gaps.  The file is mapped, so a query only touches the index
+// entries of a binary search and one or two blocks.
+//
+//   "YSPA", version, block primes, 0       4 x 32 bits
+//   limit, num_primes, num_blocks, index   4 x 64 bits
+//   gap data
+//   index                                  3 x 64 bits per block
+//
+// All numbers are little endian.
+
+#define SOE_ARCHIVE_VERSION 1
+#define SOE_ARCHIVE_BLOCK_PRIMES 8192
+#define SOE_ARCHIVE_HEADER_BYTES 48
+
+// primes are generated for the archive this many integers at a time
+#define SOE_ARCHIVE_SEGMENT (1ULL << 30)
+
+static __inline uint64_t next_prime(const uint8_t **data, uint64_t p)
+{
+	// decode one gap from the block data
+	const uint8_t *d = *data;
+	uint64_t x = 0;
+	int shift = 0;
+
+	while (*d & 128)
+	{
+		x |= (uint64_t)(*d++ & 127) << shift;
+		shift += 7;
+	}
+	x |= (uint64_t)(*d++) << shift;
+	*data = d;
+
+	return (p == 2) ? 3 : p + 2 * x;
+}
+
+static __inline uint64_t block_first(soe_archive_t *a, uint64_t b)
+{
+	return get_u64(a->index + 24 * b);
+}
+
+static __inline uint64_t block_count(soe_archive_t *a, uint64_t b)
+{
+	return get_u64(a->index + 24 * b + 8);
+}
+
+static __inline const uint8_t *block_data(soe_archive_t *a, uint64_t b)
+{
+	return a->map + get_u64(a->index + 24 * b + 16);
+}
+
+static uint64_t block_primes(soe_archive_t *a, uint64_t b)
+{
+	if (b == a->num_blocks - 1)
+		return a->num_primes - block_count(a, b);
+	return block_count(a, b + 1) - block_count(a, b);
+}
+
+static uint64_t archive_pi(soe_archive_t *a, uint64_t x)
+{
+	// the number of primes <= x, for x <= limit
+	uint64_t lo = 0, hi = a->num_blocks, b, i, n, p;
+	const uint8_t *d;
+
+	if ((a->num_blocks == 0) || (x < 2))
+		return 0;
+
+	// the last block whose first prime is <= x
+	while (hi - lo > 1)
+	{
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (block_first(a, mid) <= x)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	b = lo;
+
+	p = block_first(a, b);
+	d = block_data(a, b);
+	n = block_primes(a, b);
+	for (i = 1; i < n; i++)
+	{
+		p = next_prime(&d, p);
+		if (p > x)
+			break;
+	}
+
+	return block_count(a, b) + i;
+}
+
+int soe_archive_build(soe_staticdata_t *sdata, const char *filename, uint64_t limit)
+{
+	// write an archive of the primes up to limit to filename.
+	// Returns 0 on success.
+	FILE *out, *idx;
+	uint8_t *buf, hdr[SOE_ARCHIVE_HEADER_BYTES];
+	size_t len = 0;
+	uint64_t lo, n = 0, pos = SOE_ARCHIVE_HEADER_BYTES, prev = 0, num_blocks = 0;
+	int err = 0;
+
+	// timing
+	double t;
+	struct timeval tstart, tstop;
+
+	out = fopen(filename, "wb");
+	if (out == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for writing\n", filename);
+		return -1;
+	}
+
+	// the index is collected on the side and appended at the end
+	idx = tmpfile();
+	if (idx == NULL)
+	{
+		printf("can't open a temporary file for the archive index\n");
+		fclose(out);
+		return -1;
+	}
+
+	gettimeofday(&tstart, NULL);
+
+	memset(hdr, 0, sizeof(hdr));
+	err |= (fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr));
+	buf = (uint8_t *)xmalloc(1 << 20);
+
+	for (lo = 0; lo <= limit; )
+	{
+		uint64_t hi = MIN(limit, lo + SOE_ARCHIVE_SEGMENT - 1);
+		uint64_t num, i;
+		uint64_t *primes = soe_wrapper(sdata, lo, hi, 0, &num, 0, 0);
+
+		for (i = 0; i < num; i++)
+		{
+			uint64_t p = primes[i];
+
+			if ((p < lo) || (p > hi))
+				continue;
+
+			if ((n % SOE_ARCHIVE_BLOCK_PRIMES) == 0)
+			{
+				uint8_t e[24];
+
+				put_u64(e, p);
+				put_u64(e + 8, n);
+				put_u64(e + 16, pos + len);
+				err |= (fwrite(e, 1, 24, idx) != 24);
+				num_blocks++;
+			}
+			else
+			{
+				uint64_t x = (p - prev) / 2;
+
+				while (x >= 128)
+				{
+					buf[len++] = (uint8_t)(x | 128);
+					x >>= 7;
+				}
+				buf[len++] = (uint8_t)x;
+
+				if (len > (1 << 20) - 16)
+				{
+					err |= (fwrite(buf, 1, len, out) != len);
+					pos += len;
+					len = 0;
+				}
+			}
+
+			prev = p;
+			n++;
+		}
+
+		soe_free_primes(sdata, primes);
+
+		if (sdata->VFLAG > 0)
+		{
+			printf("archived %" PRIu64 " primes up to %" PRIu64 "\r", n, hi);
+			fflush(stdout);
+		}
+
+		if (hi == limit)
+			break;
+		lo = hi + 1;
+	}
+
+	err |= (fwrite(buf, 1, len, out) != len);
+	pos += len;
+
+	// append the index
+	rewind(idx);
+	while ((len = fread(buf, 1, 1 << 20, idx)) > 0)
+	{
+		err |= (fwrite(buf, 1, len, out) != len);
+	}
+	fclose(idx);
+
+	memcpy(hdr, "YSPA", 4);
+	put_u32(hdr + 4, SOE_ARCHIVE_VERSION);
+	put_u32(hdr + 8, SOE_ARCHIVE_BLOCK_PRIMES);
+	put_u64(hdr + 16, limit);
+	put_u64(hdr + 24, n);
+	put_u64(hdr + 32, num_blocks);
+	put_u64(hdr + 40, pos);
+	rewind(out);
+	err |= (fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr));
+
+	if (fclose(out) != 0)
+		err = 1;
+	free(buf);
+
+	if (err)
+	{
+		printf("error writing %s\n", filename);
+		return -1;
+	}
+
+	if (sdata->VFLAG > 0)
+	{
+		gettimeofday(&tstop, NULL);
+		t = ytools_difftime(&tstart, &tstop);
+		printf("\narchived %" PRIu64 " primes up to %" PRIu64 " in %" PRIu64 
+			" blocks, %" PRIu64 " bytes, in %1.4f seconds\n", 
+			n, limit, num_blocks, pos + 24 * num_blocks, t);
+	}
+
+	return 0;
+}
+
+soe_archive_t *soe_archive_open(const char *filename)
+{
+	soe_archive_t *a;
+	const uint8_t *m;
+	uint64_t size;
+
+	a = (soe_archive_t *)xcalloc(1, sizeof(soe_archive_t));
+
+#if defined(WIN32) || defined(_WIN64)
+	{
+		LARGE_INTEGER sz;
+
+		a->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if ((a->file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(a->file, &sz))
+		{
+			printf("can't open %s\n", filename);
+			if (a->file != INVALID_HANDLE_VALUE)
+				CloseHandle(a->file);
+			free(a);
+			return NULL;
+		}
+		size = (uint64_t)sz.QuadPart;
+
+		a->mapping = CreateFileMapping(a->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		m = (a->mapping == NULL) ? NULL :
+			(const uint8_t *)MapViewOfFile(a->mapping, FILE_MAP_READ, 0, 0, 0);
+		if (m == NULL)
+		{
+			printf("can't map %s\n", filename);
+			if (a->mapping != NULL)
+				CloseHandle(a->mapping);
+			CloseHandle(a->file);
+			free(a);
+			return NULL;
+		}
+	}
+#else
+	{
+		struct stat st;
+
+		a->fd = open(filename, O_RDONLY);
+		if ((a->fd < 0) || (fstat(a->fd, &st) != 0))
+		{
+			printf("open error: %s\n", strerror(errno));
+			printf("can't open %s\n", filename);
+			if (a->fd >= 0)
+				close(a->fd);
+			free(a);
+			return NULL;
+		}
+		size = (uint64_t)st.st_size;
+
+		m = (size == 0) ? MAP_FAILED :
+			(const uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, a->fd, 0);
+		if (m == MAP_FAILED)
+		{
+			printf("mmap error: %s\n", strerror(errno));
+			close(a->fd);
+			free(a);
+			return NULL;
+		}
+	}
+#endif
+
+	a->map = m;
+	a->size = size;
+
+	if ((size < SOE_ARCHIVE_HEADER_BYTES) || (memcmp(m, "YSPA", 4) != 0) ||
+		(get_u32(m + 4) != SOE_ARCHIVE_VERSION))
+	{
+		printf("%s is not a prime archive\n", filename);
+		soe_archive_close(a);
+		return NULL;
+	}
+
+	a->limit = get_u64(m + 16);
+	a->num_primes = get_u64(m + 24);
+	a->num_blocks = get_u64(m + 32);
+	a->index = m + get_u64(m + 40);
+
+	if ((get_u64(m + 40) > size) || (a->num_blocks > (size - get_u64(m + 40)) / 24))
+	{
+		printf("%s is truncated\n", filename);
+		soe_archive_close(a);
+		return NULL;
+	}
+
+	return a;
+}
+
+void soe_archive_close(soe_archive_t *a)
+{
+	if (a == NULL)
+		return;
+
+#if defined(WIN32) || defined(_WIN64)
+	UnmapViewOfFile(a->map);
+	CloseHandle(a->mapping);
+	CloseHandle(a->file);
+#else
+	munmap((void *)a->map, a->size);
+	close(a->fd);
+#endif
+
+	free(a);
+	return;
+}
+
+uint64_t soe_archive_count(soe_archive_t *a, soe_staticdata_t *sdata, 
+	uint64_t lowlimit, uint64_t highlimit)
+{
+	// the number of primes in [lowlimit, highlimit].  Anything above the
+	// archive's limit is counted by the sieve.
+	uint64_t count = 0;
+
+	if (highlimit < lowlimit)
+		return 0;
+
+	if (lowlimit <= a->limit)
+	{
+		count = archive_pi(a, MIN(highlimit, a->limit));
+		if (lowlimit > 0)
+			count -= archive_pi(a, lowlimit - 1);
+	}
+
+	if (highlimit > a->limit)
+	{
+		uint64_t num;
+
+		soe_wrapper(sdata, MAX(lowlimit, a->limit + 1), highlimit, 1, &num, 0, 0);
+		count += num;
+	}
+
+	return count;
+}
+
+uint64_t soe_archive_nth_prime(soe_archive_t *a, soe_staticdata_t *sdata, uint64_t n)
+{
+	// the nth prime, counting 2 as the first.  Past the end of the
+	// archive, the sieve counts forward in windows sized by the
+	// density of primes until the window holding it is found.
+	uint64_t lo, p;
+
+	if (n == 0)
+		return 0;
+
+	if (n <= a->num_primes)
+	{
+		uint64_t b = (n - 1) / SOE_ARCHIVE_BLOCK_PRIMES;
+		uint64_t i;
+		const uint8_t *d = block_data(a, b);
+
+		p = block_first(a, b);
+		for (i = block_count(a, b) + 1; i < n; i++)
+			p = next_prime(&d, p);
+		return p;
+	}
+
+	n -= a->num_primes;
+	lo = a->limit + 1;
+
+	while (1)
+	{
+		uint64_t w = (uint64_t)((double)n * log((double)MAX(lo, 3)) * 1.1) + 1000;
+		uint64_t num, i;
+		uint64_t *primes;
+
+		w = MIN(w, SOE_ARCHIVE_SEGMENT);
+		soe_wrapper(sdata, lo, lo + w - 1, 1, &num, 0, 0);
+
+		if (num < n)
+		{
+			n -= num;
+			lo += w;
+			continue;
+		}
+
+		primes = soe_wrapper(sdata, lo, lo + w - 1, 0, &num, 0, 0);
+		for (i = 0, p = 0; i < num; i++)
+		{
+			if ((primes[i] >= lo) && (--n == 0))
+			{
+				p = primes[i];
+				break;
+			}
+		}
+		soe_free_primes(sdata, primes);
+		return p;
+	}
+}
+
+uint64_t *soe_archive_primes(soe_archive_t *a, soe_staticdata_t *sdata,
+	uint64_t lowlimit, uint64_t highlimit, uint64_t *num_p)
+{
+	// the primes in [lowlimit, highlimit], from the archive and then
+	// from the sieve for anything above its limit.
+	uint64_t *primes = NULL;
+	uint64_t num = 0, alloc = 0;
+
+	*num_p = 0;
+	if (highlimit < lowlimit)
+		return NULL;
+
+	if ((lowlimit <= a->limit) && (a->num_blocks > 0))
+	{
+		uint64_t hi = MIN(highlimit, a->limit);
+		uint64_t first = archive_pi(a, (lowlimit > 0) ? lowlimit - 1 : 0) + 1;
+		uint64_t last = archive_pi(a, hi);
+
+		if (first <= last)
+		{
+			uint64_t b = (first - 1) / SOE_ARCHIVE_BLOCK_PRIMES;
+			uint64_t i = block_count(a, b) + 1;
+			uint64_t p = block_first(a, b);
+			const uint8_t *d = block_data(a, b);
+
+			alloc = last - first + 1;
+			primes = (uint64_t *)xmalloc(alloc * sizeof(uint64_t));
+
+			// step to the first one, then collect
+			for (; i < first; i++)
+				p = next_prime(&d, p);
+
+			for (; i <= last; i++)
+			{
+				if ((i > 1) && (((i - 1) % SOE_ARCHIVE_BLOCK_PRIMES) == 0))
+				{
+					b = (i - 1) / SOE_ARCHIVE_BLOCK_PRIMES;
+					p = block_first(a, b);
+					d = block_data(a, b);
+				}
+				else if (i > first)
+				{
+					p = next_prime(&d, p);
+				}
+				primes[num++] = p;
+			}
+		}
+	}
+
+	if (highlimit > a->limit)
+	{
+		uint64_t lo = MAX(lowlimit, a->limit + 1);
+		uint64_t n, i;
+		uint64_t *live = soe_wrapper(sdata, lo, highlimit, 0, &n, 0, 0);
+
+		primes = (uint64_t *)xrealloc(primes, (num + n + 1) * sizeof(uint64_t));
+		for (i = 0; i < n; i++)
+		{
+			if ((live[i] >= lo) && (live[i] <= highlimit))
+				primes[num++] = live[i];
+		}
+		soe_free_primes(sdata, live);
+	}
+
+	*num_p = num;
+	return primes;
+}
@@ -0,0 +1,364 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+#include "threadpool.h"
+
+// Sieve many unrelated windows [base, base + width] at once, for
+// example the neighborhoods of thousands of large numbers in a
+// nextprime search.  sieve_to_depth sets up a wheel sieve, computes
+// roots and runs a thread pool for each interval, which is all
+// overhead when the windows are small.  Here the sieve primes are
+// shared by every window, one pool hands out whole windows to the
+// threads, and each thread computes the residues of its window's base
+// in bulk and runs a plain odd-only sieve over the window.
+
+// odd values per block of the window sieve
+#define BATCH_BLOCK 32768
+
+typedef struct
+{
+	uint32_t *res;				// base mod p for each sieve prime
+	uint64_t *next;				// next flag to clear for each sieve prime
+	uint8_t *flags;
+	mpz_t tmpz;
+	mpz_t tmpz2;
+	int window;					// the window assigned to this thread
+} batch_threaddata_t;
+
+typedef struct
+{
+	soe_staticdata_t *sdata;
+	soe_staticdata_t single;	// a copy of sdata for one thread
+	mpz_t *bases;
+	uint64_t *widths;
+	int num_windows;
+	int next_window;
+	int num_witnesses;
+	uint32_t num_sp;			// sieve primes at or below the sieve limit
+	uint64_t **values;
+	uint64_t *num_p;
+	batch_threaddata_t *tdata;
+} batch_userdata_t;
+
+static void batch_residues(batch_userdata_t *udata, batch_threaddata_t *b, 
+	mpz_t base, uint32_t num_sp)
+{
+	// base mod p for the odd sieve primes.  Huge bases go through the
+	// remainder tree; otherwise each pass over the base reduces by the
+	// product of two primes, which fits in 64 bits.
+	uint32_t *p = udata->sdata->sieve_p;
+	uint32_t i;
+
+	if (mpz_sizeinbase(base, 2) >= REMTREE_MIN_BITS)
+	{
+		remtree_mod_primes(&udata->single, base, p + 1, num_sp - 1, b->res + 1);
+		return;
+	}
+
+	for (i = 1; i + 1 < num_sp; i += 2)
+	{
+		uint64_t r = mpz_mod_u64(base, (uint64_t)p[i] * (uint64_t)p[i + 1], b->tmpz);
+
+		b->res[i] = (uint32_t)(r % p[i]);
+		b->res[i + 1] = (uint32_t)(r % p[i + 1]);
+	}
+
+	if (i < num_sp)
+	{
+		b->res[i] = (uint32_t)mpz_mod_u64(base, p[i], b->tmpz);
+	}
+
+	return;
+}
+
+static void batch_window(batch_userdata_t *udata, batch_threaddata_t *b, int w)
+{
+	uint32_t *p = udata->sdata->sieve_p;
+	mpz_ptr base = udata->bases[w];
+	uint64_t width = udata->widths[w];
+	uint64_t b0 = 0, d0, n, blk, num = 0, alloc;
+	uint64_t *v;
+	uint32_t num_sp = udata->num_sp;
+	uint32_t i;
+	int small_base = (mpz_sizeinbase(base, 2) <= 62);
+#if defined(HAVE_UINT128)
+	uint128_t base128;
+	int native;
+#endif
+
+	// flag i is the odd value base + d0 + 2i
+	d0 = mpz_odd_p(base) ? 0 : 1;
+	n = (width >= d0) ? (width - d0) / 2 + 1 : 0;
+
+	// primes above the square root of the window's top would
+	// only remove themselves
+	mpz_add_ui(b->tmpz2, base, width);
+	mpz_sqrt(b->tmpz2, b->tmpz2);
+	while ((num_sp > 1) && (mpz_cmp_ui(b->tmpz2, p[num_sp - 1]) < 0))
+		num_sp--;
+
+	if (small_base)
+	{
+		mpz_export(&b0, NULL, -1, sizeof(uint64_t), 0, 0, base);
+		b0 += d0;
+	}
+
+	batch_residues(udata, b, base, num_sp);
+
+	for (i = 1; i < num_sp; i++)
+	{
+		uint64_t q = p[i];
+		uint64_t r = (b->res[i] + d0) % q;
+
+		// solve base + d0 + 2i = 0 mod p
+		b->next[i] = (((q - r) % q) * ((q + 1) / 2)) % q;
+
+		// a prime inside the window is not a hit on itself
+		if (small_base && (b0 + 2 * b->next[i] == q))
+			b->next[i] += q;
+	}
+
+	alloc = n / 8 + 16;
+	v = (uint64_t *)xmalloc(alloc * sizeof(uint64_t));
+
+	for (blk = 0; blk < n; blk += BATCH_BLOCK)
+	{
+		uint32_t len = (uint32_t)MIN(BATCH_BLOCK, n - blk);
+		uint32_t k;
+
+		memset(b->flags, 1, len);
+
+		for (i = 1; i < num_sp; i++)
+		{
+			uint64_t j = b->next[i];
+
+			for (; j < len; j += p[i])
+				b->flags[j] = 0;
+
+			b->next[i] = j - len;
+		}
+
+		for (k = 0; k < len; k++)
+		{
+			if (b->flags[k])
+			{
+				if (num == alloc)
+				{
+					alloc *= 2;
+					v = (uint64_t *)xrealloc(v, alloc * sizeof(uint64_t));
+				}
+				v[num++] = d0 + 2 * (blk + k);
+			}
+		}
+	}
+
+	if (udata->num_witnesses > 0)
+	{
+		uint64_t j, kept = 0;
+
+#if defined(HAVE_UINT128)
+		// below 2^127 the PRP test is native
+		mpz_add_ui(b->tmpz2, base, width);
+		native = (mpz_sizeinbase(b->tmpz2, 2) <= 127) &&
+			mpz_get_u128(base, &base128);
+#endif
+
+		for (j = 0; j < num; j++)
+		{
+#if defined(HAVE_UINT128)
+			if (native)
+			{
+				if (bpsw_u128(base128 + v[j]))
+					v[kept++] = v[j];
+				continue;
+			}
+#endif
+			mpz_add_ui(b->tmpz2, base, v[j]);
+			if (mpz_probab_prime_p(b->tmpz2, 1))
+				v[kept++] = v[j];
+		}
+		num = kept;
+	}
+
+	udata->values[w] = (uint64_t *)xrealloc(v, MAX(num, 1) * sizeof(uint64_t));
+	udata->num_p[w] = num;
+
+	return;
+}
+
+void batch_dispatch(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	batch_userdata_t *udata = (batch_userdata_t *)tdata->user_data;
+
+	// if not done, dispatch another window
+	if (udata->next_window < udata->num_windows)
+	{
+		udata->tdata[tdata->tindex].window = udata->next_window;
+		tdata->work_fcn_id = 0;
+		udata->next_window++;
+	}
+	else
+	{
+		tdata->work_fcn_id = tdata->num_work_fcn;
+	}
+
+	return;
+}
+
+void batch_work_fcn(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	batch_userdata_t *udata = (batch_userdata_t *)tdata->user_data;
+	batch_threaddata_t *b = &udata->tdata[tdata->tindex];
+
+	batch_window(udata, b, b->window);
+
+	return;
+}
+
+uint64_t **sieve_to_depth_batch(soe_staticdata_t* sdata,
+	mpz_t *bases, uint64_t *widths, int num_windows, int num_witnesses,
+	uint64_t sieve_limit, uint64_t *num_p)
+{
+	// sieve each window [bases[i], bases[i] + widths[i]] with the primes
+	// up to sieve_limit and, if num_witnesses > 0, PRP test what survives.
+	// Returns an array of num_windows arrays of offsets from each base,
+	// with the number of offsets in num_p[i].  The caller frees each 
+	// array and the array of arrays.  Even values are never reported.
+	batch_userdata_t udata;
+	tpool_t *tpool_data;
+	uint32_t lo, hi;
+	int i;
+
+	// timing
+	double t;
+	struct timeval tstart, tstop;
+
+	if (num_windows <= 0)
+		return NULL;
+
+	if (sdata->VFLAG > 0)
+	{
+		gettimeofday(&tstart, NULL);
+	}
+
+	// the sieve primes are shared by all of the windows
+	sieve_limit = MIN(sieve_limit, 0xffffffffULL);
+	if (sieve_limit > sdata->sieve_p[sdata->num_sp - 1])
+	{
+		extend_sieve_primes(sdata, sieve_limit * sieve_limit);
+	}
+
+	lo = 0;
+	hi = sdata->num_sp;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (sdata->sieve_p[mid] <= sieve_limit)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	udata.sdata = sdata;
+	udata.single = *sdata;
+	udata.single.THREADS = 1;
+	udata.single.VFLAG = 0;
+	udata.bases = bases;
+	udata.widths = widths;
+	udata.num_windows = num_windows;
+	udata.next_window = 0;
+	udata.num_witnesses = num_witnesses;
+	udata.num_sp = MAX(lo, 1);
+	udata.values = (uint64_t **)xmalloc(num_windows * sizeof(uint64_t *));
+	udata.num_p = num_p;
+
+	udata.tdata = (batch_threaddata_t *)xmalloc(sdata->THREADS * sizeof(batch_threaddata_t));
+	for (i = 0; i < sdata->THREADS; i++)
+	{
+		batch_threaddata_t *b = udata.tdata + i;
+
+		b->res = (uint32_t *)xmalloc(udata.num_sp * sizeof(uint32_t));
+		b->next = (uint64_t *)xmalloc(udata.num_sp * sizeof(uint64_t));
+		b->flags = (uint8_t *)xmalloc_align(BATCH_BLOCK * sizeof(uint8_t));
+		mpz_init(b->tmpz);
+		mpz_init(b->tmpz2);
+	}
+
+	tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
+		&batch_dispatch, &udata);
+
+	if (sdata->THREADS == 1)
+	{
+		for (; udata.next_window < udata.num_windows; udata.next_window++)
+		{
+			udata.tdata[0].window = udata.next_window;
+			batch_work_fcn(tpool_data);
+		}
+	}
+	else
+	{
+		tpool_add_work_fcn(tpool_data, &batch_work_fcn);
+		tpool_go(tpool_data);
+	}
+
+	free(tpool_data);
+
+	for (i = 0; i < sdata->THREADS; i++)
+	{
+		batch_threaddata_t *b = udata.tdata + i;
+
+		free(b->res);
+		free(b->next);
+		align_free(b->flags);
+		mpz_clear(b->tmpz);
+		mpz_clear(b->tmpz2);
+	}
+	free(udata.tdata);
+
+	if (sdata->VFLAG > 0)
+	{
+		uint64_t total = 0;
+
+		for (i = 0; i < num_windows; i++)
+			total += num_p[i];
+
+		gettimeofday(&tstop, NULL);
+		t = ytools_difftime(&tstart, &tstop);
+		printf("batch sieve: %d windows, %u sieve primes, %" PRIu64 " %s "
+			"found in %1.4f seconds\n", num_windows, udata.num_sp, total,
+			(num_witnesses > 0) ? "PRPs" : "survivors", t);
+	}
+
+	return udata.values;
+}
@@ -0,0 +1,504 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Benchmark driver for the sieve kernels.  Each kernel is timed on its own
+against a synthetic sieve setup, followed by end-to-end prime counts at
+increasing powers of ten.  Results are written to stdout as one JSON object
+per line, so that runs from different builds and hosts can be compared.
+
+usage: ysieve_bench [-t seconds] [-e max_exponent] [-T threads]
+  -t: minimum time spent in each small kernel (default 0.5 seconds)
+  -e: largest power of ten counted end-to-end (default 12)
+  -T: threads used for the end-to-end counts (default 1)
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#define BENCH_NUM(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+enum bench_isa
+{
+    BENCH_ISA_NONE,
+    BENCH_ISA_BMI2,
+    BENCH_ISA_AVX2,
+    BENCH_ISA_AVX512
+};
+
+typedef struct
+{
+    const char* name;
+    void (*fcn)(thread_soedata_t*);
+    uint32_t blocksize;     // 0: any block size
+    int isa;
+} bench_line_kernel_t;
+
+typedef struct
+{
+    const char* name;
+    void (*fcn)(soe_dynamicdata_t*, soe_staticdata_t*, uint8_t*);
+    int isa;
+} bench_presieve_kernel_t;
+
+typedef struct
+{
+    const char* name;
+    uint32_t (*fcn)(soe_staticdata_t*, uint32_t, uint64_t*, uint64_t);
+    int isa;
+} bench_extract_kernel_t;
+
+// a sieve set up the way spSOE does it, for a single thread,
+// without running any lines.
+typedef struct
+{
+    soe_staticdata_t* sdata;
+    thread_soedata_t* thread_data;
+    uint64_t lowlimit;
+    uint64_t highlimit;
+} bench_sieve_t;
+
+static const bench_line_kernel_t line_kernels[] = {
+    { "sieve_line", &sieve_line, 0, BENCH_ISA_NONE },
+#ifdef USE_AVX2
+    { "sieve_line_avx2_32k_bitmasks8", &sieve_line_avx2_32k_bitmasks8, 32768, BENCH_ISA_AVX2 },
+    { "sieve_line_avx2_32k_bitmasks32", &sieve_line_avx2_32k_bitmasks32, 32768, BENCH_ISA_AVX2 },
+    { "sieve_line_avx2_32k_bitlogic8", &sieve_line_avx2_32k_bitlogic8, 32768, BENCH_ISA_AVX2 },
+    { "sieve_line_avx2_32k_bitlogic32", &sieve_line_avx2_32k_bitlogic32, 32768, BENCH_ISA_AVX2 },
+    { "sieve_line_avx2_128k", &sieve_line_avx2_128k, 131072, BENCH_ISA_AVX2 },
+    { "sieve_line_avx2_512k", &sieve_line_avx2_512k, 524288, BENCH_ISA_AVX2 },
+#endif
+#ifdef USE_AVX512F
+    { "sieve_line_avx512_32k", &sieve_line_avx512_32k, 32768, BENCH_ISA_AVX512 },
+    { "sieve_line_avx512_128k", &sieve_line_avx512_128k, 131072, BENCH_ISA_AVX512 },
+    { "sieve_line_avx512_256k", &sieve_line_avx512_256k, 262144, BENCH_ISA_AVX512 },
+    { "sieve_line_avx512_512k", &sieve_line_avx512_512k, 524288, BENCH_ISA_AVX512 },
+#endif
+};
+
+static const bench_presieve_kernel_t presieve_kernels[] = {
+    { "pre_sieve", &pre_sieve, BENCH_ISA_NONE },
+#ifdef USE_AVX2
+    { "pre_sieve_avx2", &pre_sieve_avx2, BENCH_ISA_AVX2 },
+#endif
+#ifdef USE_AVX512F
+    { "pre_sieve_avx512", &pre_sieve_avx512, BENCH_ISA_AVX512 },
+#endif
+};
+
+static const bench_extract_kernel_t extract_kernels[] = {
+    { "compute_8_bytes", &compute_8_bytes, BENCH_ISA_NONE },
+#if defined(USE_BMI2) || defined(USE_AVX512F)
+    { "compute_8_bytes_bmi2", &compute_8_bytes_bmi2, BENCH_ISA_BMI2 },
+#endif
+};
+
+static const uint32_t block_sizes[] = { 32768, 65536, 131072, 262144, 524288 };
+
+static double min_time = 0.5;
+static info_t cpu;
+
+static int bench_has_isa(int isa)
+{
+    switch (isa)
+    {
+    case BENCH_ISA_BMI2:
+        return cpu.BMI2;
+    case BENCH_ISA_AVX2:
+        return cpu.AVX2;
+    case BENCH_ISA_AVX512:
+        return cpu.AVX512F;
+    default:
+        return 1;
+    }
+}
+
+static double bench_now(void)
+{
+    soe_phase_t now;
+
+    soe_clock(&now, NULL);
+    return now.wall;
+}
+
+static void bench_report(const char* kernel, bench_sieve_t* b,
+    uint64_t calls, double seconds, uint64_t result)
+{
+    printf("{\"bench\":\"kernel\",\"kernel\":\"%s\",\"lowlimit\":%" PRIu64
+        ",\"highlimit\":%" PRIu64 ",\"blocksize\":%u,\"classes\":%u,\"monty\":%d"
+        ",\"calls\":%" PRIu64 ",\"seconds\":%1.6f,\"ns_per_call\":%1.1f"
+        ",\"result\":%" PRIu64 "}\n",
+        kernel, b->lowlimit, b->highlimit, b->sdata->SOEBLOCKSIZE,
+        b->sdata->numclasses, b->sdata->use_monty, calls, seconds,
+        1e9 * seconds / (double)calls, result);
+    fflush(stdout);
+    return;
+}
+
+static int bench_setup(bench_sieve_t* b, uint64_t lowlimit, uint64_t highlimit,
+    uint32_t blocksize, int monty)
+{
+    // the same sequence as spSOE, with getRoots timed along the way.
+    // monty < 0 keeps the choice made by get_numclasses.
+    soe_staticdata_t* sdata;
+    uint64_t calls = 0;
+    double start, stop;
+
+    sdata = soe_init(0, 1, blocksize);
+    extend_sieve_primes(sdata, highlimit);
+    sdata->has_avx2 = cpu.AVX2;
+    sdata->has_avx512f = cpu.AVX512F;
+    sdata->has_bmi1 = cpu.BMI1;
+    sdata->has_bmi2 = cpu.BMI2;
+    sdata->only_count = 1;
+
+    if (check_input(highlimit, lowlimit, sdata->num_sp, sdata->sieve_p, sdata, NULL))
+    {
+        soe_finalize(sdata);
+        return 0;
+    }
+
+    get_numclasses(highlimit, lowlimit, sdata);
+    if (monty >= 0)
+    {
+        sdata->use_monty = monty;
+    }
+    init_sieve(sdata);
+
+    b->sdata = sdata;
+    b->thread_data = (thread_soedata_t*)malloc(sizeof(thread_soedata_t));
+    b->lowlimit = lowlimit;
+    b->highlimit = highlimit;
+
+    start = bench_now();
+    do
+    {
+        getRoots(sdata, b->thread_data);
+        calls++;
+        stop = bench_now();
+    } while ((stop - start) < min_time);
+    bench_report("getRoots", b, calls, stop - start, sdata->bitmap_start_id);
+
+    set_bucket_depth(sdata);
+    alloc_threaddata(sdata, b->thread_data);
+    return 1;
+}
+
+static void bench_teardown(bench_sieve_t* b)
+{
+    soe_staticdata_t* sdata = b->sdata;
+
+    align_free(b->thread_data[0].ddata.offsets);
+    finalize_sieve(sdata, b->thread_data, 1, NULL);
+    soe_finalize(sdata);
+    return;
+}
+
+static void bench_get_offsets(bench_sieve_t* b, const char* name)
+{
+    // offsets and bucket fill for each line in turn.
+    thread_soedata_t* t = &b->thread_data[0];
+    uint64_t calls = 0;
+    double start, stop;
+
+    start = bench_now();
+    do
+    {
+        t->current_line = (uint32_t)(calls % b->sdata->numclasses);
+        get_offsets(t);
+        calls++;
+        stop = bench_now();
+    } while ((stop - start) < min_time);
+    bench_report(name, b, calls, stop - start, 0);
+
+    return;
+}
+
+static void bench_presieve(bench_sieve_t* b)
+{
+    // presieve consecutive blocks of the first line.
+    thread_soedata_t* t = &b->thread_data[0];
+    uint8_t* flagblock = (uint8_t*)xmalloc_align(b->sdata->SOEBLOCKSIZE);
+    int i;
+
+    for (i = 0; i < BENCH_NUM(presieve_kernels); i++)
+    {
+        const bench_presieve_kernel_t* k = &presieve_kernels[i];
+        uint64_t calls = 0;
+        double start, stop;
+
+        if (!bench_has_isa(k->isa))
+            continue;
+
+        t->current_line = 0;
+        get_offsets(t);
+
+        start = bench_now();
+        do
+        {
+            memset(flagblock, 255, b->sdata->SOEBLOCKSIZE);
+            k->fcn(&t->ddata, &t->sdata, flagblock);
+            calls++;
+            stop = bench_now();
+        } while ((stop - start) < min_time);
+        bench_report(k->name, b, calls, stop - start, 0);
+    }
+
+    align_free(flagblock);
+    return;
+}
+
+static void bench_lines(bench_sieve_t* b)
+{
+    // sieve every line with each line sieve that supports this
+    // block size, and count the first set of lines.  The results
+    // should agree between kernels.
+    thread_soedata_t* t = &b->thread_data[0];
+    soe_staticdata_t* sdata = b->sdata;
+    int i, counted = 0;
+
+    for (i = 0; i < BENCH_NUM(line_kernels); i++)
+    {
+        const bench_line_kernel_t* k = &line_kernels[i];
+        double sieve_time = 0, count_time = 0, start;
+        uint64_t num = 0;
+        uint32_t j;
+
+        if ((k->blocksize > 0) && (k->blocksize != sdata->SOEBLOCKSIZE))
+            continue;
+        if (!bench_has_isa(k->isa))
+            continue;
+
+        for (j = 0; j < sdata->numclasses; j++)
+        {
+            t->current_line = j;
+            t->sdata.lines[j] = (uint8_t*)xmalloc_align(sdata->numlinebytes);
+
+            start = bench_now();
+            k->fcn(t);
+            sieve_time += bench_now() - start;
+
+            start = bench_now();
+            num += count_line(&t->sdata, j);
+            count_time += bench_now() - start;
+
+            align_free(t->sdata.lines[j]);
+            t->sdata.lines[j] = NULL;
+        }
+
+        bench_report(k->name, b, sdata->numclasses, sieve_time, num);
+        if (!counted)
+        {
+            bench_report("count_line", b, sdata->numclasses, count_time, num);
+            counted = 1;
+        }
+    }
+
+    return;
+}
+
+static void bench_extract(bench_sieve_t* b)
+{
+    // prime extraction from synthetic lines with about one flag in
+    // eight set, much like the lines at the bottom of a sieve.
+    soe_staticdata_t* sdata = b->sdata;
+    uint64_t numbytes = 65536;
+    uint64_t* primes = (uint64_t*)xmalloc(64 * sdata->numclasses * sizeof(uint64_t));
+    uint64_t x = 0x2545f4914f6cdd1dULL;
+    uint64_t i;
+    uint32_t j;
+    int k;
+
+    for (j = 0; j < sdata->numclasses; j++)
+    {
+        uint64_t* line;
+
+        sdata->lines[j] = (uint8_t*)xmalloc_align(numbytes);
+        line = (uint64_t*)sdata->lines[j];
+        for (i = 0; i < numbytes / 8; i++)
+        {
+            uint64_t r[3];
+
+            for (k = 0; k < 3; k++)
+            {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                r[k] = x;
+            }
+            line[i] = r[0] & r[1] & r[2];
+        }
+    }
+    sdata->GLOBAL_OFFSET = 0;
+
+    for (k = 0; k < BENCH_NUM(extract_kernels); k++)
+    {
+        const bench_extract_kernel_t* e = &extract_kernels[k];
+        uint64_t calls = 0, num = 0;
+        double start, stop;
+
+        if (!bench_has_isa(e->isa))
+            continue;
+
+        start = bench_now();
+        do
+        {
+            num = 0;
+            for (i = 0; i < numbytes; i += 8)
+            {
+                num += e->fcn(sdata, 0, primes, i);
+            }
+            calls += numbytes / 8;
+            stop = bench_now();
+        } while ((stop - start) < min_time);
+        bench_report(e->name, b, calls, stop - start, num);
+    }
+
+    for (j = 0; j < sdata->numclasses; j++)
+    {
+        align_free(sdata->lines[j]);
+        sdata->lines[j] = NULL;
+    }
+    free(primes);
+    return;
+}
+
+static void bench_count(uint64_t highlimit, int threads)
+{
+    soe_staticdata_t* sdata = soe_init(0, threads, 32);
+    uint64_t num_found;
+    double start, stop;
+
+    start = bench_now();
+    soe_wrapper(sdata, 0, highlimit, 1, &num_found, 0, 0);
+    stop = bench_now();
+
+    printf("{\"bench\":\"count\",\"lowlimit\":0,\"highlimit\":%" PRIu64
+        ",\"threads\":%d,\"blocksize\":%u,\"seconds\":%1.6f,\"result\":%" PRIu64 "}\n",
+        highlimit, threads, sdata->SOEBLOCKSIZE, stop - start, num_found);
+    fflush(stdout);
+
+    soe_finalize(sdata);
+    return;
+}
+
+int main(int argc, char** argv)
+{
+    bench_sieve_t b;
+    int max_exp = 12;
+    int threads = 1;
+    uint64_t highlimit;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+            min_time = atof(argv[++i]);
+        else if ((strcmp(argv[i], "-e") == 0) && (i + 1 < argc))
+            max_exp = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-T") == 0) && (i + 1 < argc))
+            threads = atoi(argv[++i]);
+        else
+        {
+            printf("usage: %s [-t seconds] [-e max_exponent] [-T threads]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    ytools_get_computer_info(&cpu, 0);
+
+    printf("{\"bench\":\"host\",\"avx2\":%d,\"avx512f\":%d,\"bmi2\":%d,\"build\":\"%s%s%s%s\""
+        ",\"compiler\":\"%s\"}\n",
+        cpu.AVX2 != 0, cpu.AVX512F != 0, cpu.BMI2 != 0,
+#ifdef USE_BMI2
+        " USE_BMI2",
+#else
+        "",
+#endif
+#ifdef USE_AVX2
+        " USE_AVX2",
+#else
+        "",
+#endif
+#ifdef USE_AVX512F
+        " USE_AVX512F",
+#else
+        "",
+#endif
+#ifdef USE_AVX512BW
+        " USE_AVX512BW",
+#else
+        "",
+#endif
+#ifdef __VERSION__
+        __VERSION__
+#else
+        "unknown"
+#endif
+        );
+    fflush(stdout);
+
+    // line sieves, presieving and counting at every block size, on a
+    // range big enough to use the bucket sieve.
+    for (i = 0; i < BENCH_NUM(block_sizes); i++)
+    {
+        if (!bench_setup(&b, 1000000000000ULL, 1001000000000ULL, block_sizes[i], -1))
+            continue;
+        bench_presieve(&b);
+        bench_lines(&b);
+        bench_teardown(&b);
+    }
+
+    // offsets with and without Montgomery arithmetic, and prime
+    // extraction, using 48 residue classes.
+    for (i = 0; i < 2; i++)
+    {
+        if ((i == 1) && !cpu.AVX2)
+            break;
+#ifndef USE_AVX2
+        if (i == 1)
+            break;
+#endif
+        if (!bench_setup(&b, 1000000000000ULL, 1010000000000ULL, 32768, i))
+            continue;
+        bench_get_offsets(&b, i ? "get_offsets_monty" : "get_offsets");
+        if (i == 0)
+            bench_extract(&b);
+        bench_teardown(&b);
+    }
+
+    // end to end
+    for (i = 9, highlimit = 1000000000ULL; i <= max_exp; i++, highlimit *= 10)
+    {
+        bench_count(highlimit, threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1481 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Behaviour checks for the library.  Each check runs one of the sieve's
+entry points on small ranges and compares the result against soe_wrapper
+or a brute force answer.  Output is one line per check; the exit status
+is the number of failed checks, capped at 255.
+
+usage: ysieve_check [-T threads] [-q]
+  -T: threads used by the multi-threaded checks (default 4)
+  -q: skip the checks that take more than a few seconds
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#define CHECK_NUM(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+static int num_checks = 0;
+static int num_failed = 0;
+static int threads = 4;
+static int quick = 0;
+
+static int check(int ok, const char* name, const char* detail)
+{
+    num_checks++;
+    if (ok)
+    {
+        printf("ok    %s\n", name);
+    }
+    else
+    {
+        num_failed++;
+        printf("FAIL  %s: %s\n", name, detail);
+    }
+    fflush(stdout);
+    return ok;
+}
+
+static int files_equal(const char* a, const char* b)
+{
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    static uint8_t ba[1 << 16], bb[1 << 16];
+    size_t na, nb;
+    int eq = (fa != NULL) && (fb != NULL);
+
+    while (eq)
+    {
+        na = fread(ba, 1, sizeof(ba), fa);
+        nb = fread(bb, 1, sizeof(bb), fb);
+        eq = (na == nb) && (memcmp(ba, bb, na) == 0);
+        if (na == 0)
+            break;
+    }
+
+    if (fa != NULL)
+        fclose(fa);
+    if (fb != NULL)
+        fclose(fb);
+    return eq;
+}
+
+static int lists_equal(uint64_t* a, uint64_t na, uint64_t* b, uint64_t nb,
+    char* detail)
+{
+    // compare two lists, describing the first difference in detail
+    uint64_t i;
+
+    for (i = 0; (i < na) && (i < nb); i++)
+    {
+        if (a[i] != b[i])
+        {
+            sprintf(detail, "element %" PRIu64 " is %" PRIu64 ", expected %" PRIu64,
+                i, a[i], b[i]);
+            return 0;
+        }
+    }
+
+    if (na != nb)
+    {
+        sprintf(detail, "%" PRIu64 " values, expected %" PRIu64, na, nb);
+        return 0;
+    }
+
+    strcpy(detail, "");
+    return 1;
+}
+
+static uint64_t first_at_least(uint64_t* list, uint64_t num, uint64_t x)
+{
+    // index of the first element of a sorted list >= x, or num
+    uint64_t lo = 0, hi = num;
+
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (list[mid] < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(uint64_t n)
+{
+    // a number in [0, n), the same sequence on every run
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state % n;
+}
+
+// ------------------------------------------------------------------
+// brute force references.  These avoid the library entirely, so a bug
+// shared by the sieve and its reference can't hide.
+
+static uint32_t* ref_primes(uint32_t limit, uint32_t* num)
+{
+    // primes up to limit with a plain byte sieve
+    uint8_t* composite = (uint8_t*)xcalloc((size_t)limit + 1, 1);
+    uint32_t* primes;
+    uint64_t i, j;
+    uint32_t n = 0;
+
+    for (i = 2; i * i <= limit; i++)
+    {
+        if (!composite[i])
+        {
+            for (j = i * i; j <= limit; j += i)
+                composite[j] = 1;
+        }
+    }
+
+    for (i = 2; i <= limit; i++)
+        n += !composite[i];
+
+    primes = (uint32_t*)xmalloc((n + 1) * sizeof(uint32_t));
+    n = 0;
+    for (i = 2; i <= limit; i++)
+    {
+        if (!composite[i])
+            primes[n++] = (uint32_t)i;
+    }
+
+    free(composite);
+    *num = n;
+    return primes;
+}
+
+static uint64_t isqrt64(uint64_t n)
+{
+    uint64_t r = (uint64_t)sqrt((double)n);
+
+    while ((r + 1) * (r + 1) <= n)
+        r++;
+    while (r * r > n)
+        r--;
+    return r;
+}
+
+// ref_primes_range pieces, small enough to stay in cache
+#define REF_PIECE 1000000
+
+static uint32_t* ref_primes_range(uint32_t lo, uint32_t hi, uint32_t* num)
+{
+    // primes in [lo, hi], 2 <= lo, sieving just that range with the
+    // primes up to sqrt(hi).  For limits too big for ref_primes.
+    uint8_t* composite = (uint8_t*)xcalloc((size_t)hi - lo + 1, 1);
+    uint32_t* small;
+    uint32_t* primes;
+    uint32_t ns, i, n = 0;
+    uint64_t j;
+
+    small = ref_primes((uint32_t)isqrt64(hi), &ns);
+    for (i = 0; i < ns; i++)
+    {
+        uint64_t p = small[i];
+
+        for (j = MAX(p * p, ((lo + p - 1) / p) * p); j <= hi; j += p)
+            composite[j - lo] = 1;
+    }
+
+    for (j = lo; j <= hi; j++)
+        n += !composite[j - lo];
+
+    primes = (uint32_t*)xmalloc((n + 1) * sizeof(uint32_t));
+    n = 0;
+    for (j = lo; j <= hi; j++)
+    {
+        if (!composite[j - lo])
+            primes[n++] = (uint32_t)j;
+    }
+
+    free(small);
+    free(composite);
+    *num = n;
+    return primes;
+}
+
+typedef struct
+{
+    uint64_t lowlimit;
+    uint64_t num;
+    uint8_t* nfactors;
+    uint64_t* factors;      // SOE_MAX_FACTORS per integer, ascending
+    uint8_t* exponents;
+} ref_factors_t;
+
+static void ref_factor(ref_factors_t* r, uint64_t lo, uint64_t hi)
+{
+    // factor every integer in [lo, hi], lo > 0, by dividing each prime
+    // up to sqrt(hi) out of its multiples.  What is left is prime.
+    uint32_t* primes;
+    uint32_t np, i;
+    uint64_t* rem;
+    uint64_t j;
+
+    r->lowlimit = lo;
+    r->num = hi - lo + 1;
+    r->nfactors = (uint8_t*)xcalloc(r->num, sizeof(uint8_t));
+    r->factors = (uint64_t*)xmalloc(r->num * SOE_MAX_FACTORS * sizeof(uint64_t));
+    r->exponents = (uint8_t*)xmalloc(r->num * SOE_MAX_FACTORS * sizeof(uint8_t));
+    rem = (uint64_t*)xmalloc(r->num * sizeof(uint64_t));
+
+    for (j = 0; j < r->num; j++)
+        rem[j] = lo + j;
+
+    primes = ref_primes((uint32_t)isqrt64(hi), &np);
+    for (i = 0; i < np; i++)
+    {
+        uint64_t p = primes[i];
+
+        for (j = ((lo + p - 1) / p) * p - lo; j < r->num; j += p)
+        {
+            int e = 0;
+            int k = r->nfactors[j]++;
+
+            while ((rem[j] % p) == 0)
+            {
+                rem[j] /= p;
+                e++;
+            }
+            r->factors[j * SOE_MAX_FACTORS + k] = p;
+            r->exponents[j * SOE_MAX_FACTORS + k] = (uint8_t)e;
+        }
+    }
+
+    for (j = 0; j < r->num; j++)
+    {
+        if (rem[j] > 1)
+        {
+            int k = r->nfactors[j]++;
+
+            r->factors[j * SOE_MAX_FACTORS + k] = rem[j];
+            r->exponents[j * SOE_MAX_FACTORS + k] = 1;
+        }
+    }
+
+    free(primes);
+    free(rem);
+    return;
+}
+
+static void ref_factor_free(ref_factors_t* r)
+{
+    free(r->nfactors);
+    free(r->factors);
+    free(r->exponents);
+    return;
+}
+
+static uint64_t* ref_sieve(mpz_t lo, uint64_t range, uint32_t limit, uint64_t* num)
+{
+    // offsets x in [0, range] for which lo + x has no prime factor
+    // <= limit.  lo must be bigger than limit.
+    uint8_t* hit = (uint8_t*)xcalloc(range + 1, 1);
+    uint64_t* values;
+    uint32_t* primes;
+    uint32_t np, i;
+    uint64_t x, plo, n = 0;
+
+    for (plo = 2; plo <= limit; plo += REF_PIECE)
+    {
+        primes = ref_primes_range((uint32_t)plo, (uint32_t)MIN(plo + REF_PIECE - 1, limit), &np);
+        for (i = 0; i < np; i++)
+        {
+            uint64_t p = primes[i];
+
+            for (x = (p - mpz_fdiv_ui(lo, p)) % p; x <= range; x += p)
+                hit[x] = 1;
+        }
+        free(primes);
+    }
+
+    values = (uint64_t*)xmalloc((range + 1) * sizeof(uint64_t));
+    for (x = 0; x <= range; x++)
+    {
+        if (!hit[x])
+            values[n++] = x;
+    }
+
+    free(hit);
+    *num = n;
+    return values;
+}
+
+static uint64_t* ref_prp(mpz_t lo, uint64_t range, uint64_t* num)
+{
+    // offsets of the primes in [lo, lo + range], lo > 1000
+    uint64_t* values = ref_sieve(lo, range, 1000, num);
+    uint64_t i, n = 0;
+    mpz_t v;
+
+    mpz_init(v);
+    for (i = 0; i < *num; i++)
+    {
+        mpz_add_ui(v, lo, values[i]);
+        if (mpz_probab_prime_p(v, 2))
+            values[n++] = values[i];
+    }
+    mpz_clear(v);
+
+    *num = n;
+    return values;
+}
+
+static uint64_t* wrapper_primes(uint64_t lo, uint64_t hi, uint64_t* num)
+{
+    // the plain sieve's list, on one thread
+    soe_staticdata_t* sdata = soe_init(0, 1, 32);
+    uint64_t* primes = soe_wrapper(sdata, lo, hi, 0, num, 0, 0);
+    uint64_t* copy = (uint64_t*)xmalloc((*num + 1) * sizeof(uint64_t));
+
+    memcpy(copy, primes, *num * sizeof(uint64_t));
+    soe_free_primes(sdata, primes);
+    soe_finalize(sdata);
+    return copy;
+}
+
+// ------------------------------------------------------------------
+// reductions folded into the count path
+
+static void check_reduce(void)
+{
+    static const uint64_t ranges[][2] = {
+        { 0, 1000000 },
+        { 1000000000, 1100000000 },
+        { 1000000000000ULL, 1000010000000ULL },
+        { 3999999999000000000ULL, 4000000000000000000ULL } };
+    int i;
+
+    for (i = 0; i < CHECK_NUM(ranges); i++)
+    {
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        soe_reduction_t red, ref;
+        uint64_t* primes;
+        uint64_t num, n, j;
+        char name[80], detail[160];
+
+        primes = wrapper_primes(ranges[i][0], ranges[i][1], &num);
+        memset(&ref, 0, sizeof(ref));
+        for (j = 0; j < num; j++)
+        {
+            ref.count++;
+            ref.sum_lo += primes[j];
+            ref.sum_hi += (ref.sum_lo < primes[j]);
+            ref.sumsq += primes[j] * primes[j];
+            ref.xorsum ^= primes[j];
+        }
+
+        n = soe_reduce(sdata, ranges[i][0], ranges[i][1], &red);
+
+        sprintf(name, "reduce %" PRIu64 " : %" PRIu64, ranges[i][0], ranges[i][1]);
+        sprintf(detail, "count %" PRIu64 " (%" PRIu64 "), sum %" PRIx64 ":%016" PRIx64
+            " (%" PRIx64 ":%016" PRIx64 "), sumsq %" PRIx64 " (%" PRIx64
+            "), xor %" PRIx64 " (%" PRIx64 ")",
+            red.count, ref.count, red.sum_hi, red.sum_lo, ref.sum_hi, ref.sum_lo,
+            red.sumsq, ref.sumsq, red.xorsum, ref.xorsum);
+        check((n == num) && (memcmp(&red, &ref, sizeof(ref)) == 0), name, detail);
+
+        free(primes);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+// ------------------------------------------------------------------
+// the factoring sieve and the functions built on it
+
+typedef struct
+{
+    uint64_t lowlimit;
+    uint64_t num;
+    int mode;
+    uint8_t* nfactors;
+    uint64_t* factors;
+    uint8_t* exponents;
+    int8_t* mu;
+    uint64_t* phi;
+    uint32_t* sigma0;
+    uint64_t blocks_outside;
+} factor_copy_t;
+
+static void factor_copy_fcn(soe_factor_block_t* block, void* user_data)
+{
+    // blocks come from several threads, but never overlap
+    factor_copy_t* c = (factor_copy_t*)user_data;
+    uint64_t o = block->lowlimit - c->lowlimit;
+
+    if ((block->lowlimit < c->lowlimit) || (o + block->num > c->num))
+    {
+        c->blocks_outside++;
+        return;
+    }
+
+    if (c->mode == SOE_FACTOR_FULL)
+    {
+        memcpy(c->nfactors + o, block->nfactors, block->num * sizeof(uint8_t));
+        memcpy(c->factors + o * SOE_MAX_FACTORS, block->factors,
+            block->num * SOE_MAX_FACTORS * sizeof(uint64_t));
+        memcpy(c->exponents + o * SOE_MAX_FACTORS, block->exponents,
+            block->num * SOE_MAX_FACTORS * sizeof(uint8_t));
+    }
+    else
+    {
+        memcpy(c->mu + o, block->mu, block->num * sizeof(int8_t));
+        memcpy(c->phi + o, block->phi, block->num * sizeof(uint64_t));
+        memcpy(c->sigma0 + o, block->sigma0, block->num * sizeof(uint32_t));
+    }
+
+    return;
+}
+
+static int same_factors(factor_copy_t* c, ref_factors_t* r, uint64_t j)
+{
+    // the factorizations of lowlimit + j agree, in any order
+    int k, m;
+
+    if (c->nfactors[j] != r->nfactors[j])
+        return 0;
+
+    for (k = 0; k < r->nfactors[j]; k++)
+    {
+        for (m = 0; m < c->nfactors[j]; m++)
+        {
+            if ((c->factors[j * SOE_MAX_FACTORS + m] == r->factors[j * SOE_MAX_FACTORS + k]) &&
+                (c->exponents[j * SOE_MAX_FACTORS + m] == r->exponents[j * SOE_MAX_FACTORS + k]))
+                break;
+        }
+        if (m == c->nfactors[j])
+            return 0;
+    }
+
+    return 1;
+}
+
+static const uint64_t factor_ranges[][2] = {
+    { 1, 200000 },
+    { 1000000000000ULL, 1000000200000ULL },
+    { 999999999900000ULL, 1000000000100000ULL } };
+
+static void check_factor(void)
+{
+    int i;
+
+    for (i = 0; i < CHECK_NUM(factor_ranges); i++)
+    {
+        uint64_t lo = factor_ranges[i][0];
+        uint64_t hi = factor_ranges[i][1];
+        uint64_t pbound = isqrt64(hi);
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        ref_factors_t r;
+        factor_copy_t c;
+        uint32_t* spf;
+        uint64_t j, bad = 0, first = 0;
+        char name[80], detail[160];
+
+        ref_factor(&r, lo, hi);
+
+        // smallest prime factors up to sqrt(hi)
+        spf = soe_spf_range(sdata, lo, hi);
+        for (j = 0; j < r.num; j++)
+        {
+            uint64_t s = 0;
+
+            if ((r.nfactors[j] > 0) && (r.factors[j * SOE_MAX_FACTORS] <= pbound))
+                s = r.factors[j * SOE_MAX_FACTORS];
+
+            if ((uint64_t)spf[j] != s)
+            {
+                if (bad++ == 0)
+                    first = j;
+            }
+        }
+
+        sprintf(name, "spf %" PRIu64 " : %" PRIu64, lo, hi);
+        sprintf(detail, "%" PRIu64 " wrong, first at %" PRIu64 ": %u",
+            bad, lo + first, bad ? spf[first] : 0);
+        check(bad == 0, name, detail);
+        free(spf);
+
+        // complete factorizations
+        memset(&c, 0, sizeof(c));
+        c.lowlimit = lo;
+        c.num = r.num;
+        c.mode = SOE_FACTOR_FULL;
+        c.nfactors = (uint8_t*)xcalloc(c.num, sizeof(uint8_t));
+        c.factors = (uint64_t*)xcalloc(c.num * SOE_MAX_FACTORS, sizeof(uint64_t));
+        c.exponents = (uint8_t*)xcalloc(c.num * SOE_MAX_FACTORS, sizeof(uint8_t));
+
+        soe_factor_range(sdata, lo, hi, SOE_FACTOR_FULL, &factor_copy_fcn, &c);
+
+        // 1 has no factors and is not sieved
+        bad = 0;
+        for (j = (lo == 1) ? 1 : 0; j < r.num; j++)
+        {
+            if (!same_factors(&c, &r, j))
+            {
+                if (bad++ == 0)
+                    first = j;
+            }
+        }
+
+        sprintf(name, "factor %" PRIu64 " : %" PRIu64, lo, hi);
+        sprintf(detail, "%" PRIu64 " wrong, first at %" PRIu64 " (%u factors), "
+            "%" PRIu64 " blocks out of range", bad, lo + first,
+            bad ? c.nfactors[first] : 0, c.blocks_outside);
+        check((bad == 0) && (c.blocks_outside == 0), name, detail);
+
+        free(c.nfactors);
+        free(c.factors);
+        free(c.exponents);
+        ref_factor_free(&r);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+static void check_mult(void)
+{
+    int i;
+
+    for (i = 0; i < CHECK_NUM(factor_ranges); i++)
+    {
+        uint64_t lo = factor_ranges[i][0];
+        uint64_t hi = factor_ranges[i][1];
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        ref_factors_t r;
+        factor_copy_t c;
+        int64_t mertens = 0;
+        uint64_t sqfree = 0;
+        uint64_t j, bad = 0, first = 0;
+        char name[80], detail[200];
+        int64_t m;
+        uint64_t q;
+
+        ref_factor(&r, lo, hi);
+
+        memset(&c, 0, sizeof(c));
+        c.lowlimit = lo;
+        c.num = r.num;
+        c.mode = SOE_FACTOR_MULT;
+        c.mu = (int8_t*)xcalloc(c.num, sizeof(int8_t));
+        c.phi = (uint64_t*)xcalloc(c.num, sizeof(uint64_t));
+        c.sigma0 = (uint32_t*)xcalloc(c.num, sizeof(uint32_t));
+
+        soe_mult_range(sdata, lo, hi, &factor_copy_fcn, &c);
+
+        for (j = 0; j < r.num; j++)
+        {
+            int8_t mu = 1;
+            uint64_t phi = 1;
+            uint32_t sigma0 = 1;
+            int k;
+
+            for (k = 0; k < r.nfactors[j]; k++)
+            {
+                uint64_t p = r.factors[j * SOE_MAX_FACTORS + k];
+                int e = r.exponents[j * SOE_MAX_FACTORS + k];
+                int x;
+
+                mu = (e > 1) ? 0 : -mu;
+                phi *= p - 1;
+                for (x = 1; x < e; x++)
+                    phi *= p;
+                sigma0 *= e + 1;
+            }
+
+            mertens += mu;
+            sqfree += (mu != 0);
+            if ((c.mu[j] != mu) || (c.phi[j] != phi) || (c.sigma0[j] != sigma0))
+            {
+                if (bad++ == 0)
+                    first = j;
+            }
+        }
+
+        sprintf(name, "mu, phi, sigma0 %" PRIu64 " : %" PRIu64, lo, hi);
+        sprintf(detail, "%" PRIu64 " wrong, first at %" PRIu64 ": %d %" PRIu64 " %u, "
+            "%" PRIu64 " blocks out of range", bad, lo + first,
+            c.mu[first], c.phi[first], c.sigma0[first], c.blocks_outside);
+        check((bad == 0) && (c.blocks_outside == 0), name, detail);
+
+        m = soe_mertens(sdata, lo, hi);
+        q = soe_squarefree_count(sdata, lo, hi);
+        sprintf(name, "mertens, squarefree %" PRIu64 " : %" PRIu64, lo, hi);
+        sprintf(detail, "%" PRId64 " and %" PRIu64 ", expected %" PRId64 " and %" PRIu64,
+            m, q, mertens, sqfree);
+        check((m == mertens) && (q == sqfree), name, detail);
+
+        free(c.mu);
+        free(c.phi);
+        free(c.sigma0);
+        ref_factor_free(&r);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+static void check_smooth(void)
+{
+    // integers whose prime factors up to the limit (and their squares)
+    // add up to at least threshold bits.  Limits past 3.04e9 have
+    // squares past 2^63.
+    static const struct {
+        const char* lo;
+        uint64_t range;
+        uint32_t limit;
+        uint32_t threshold;
+    } cases[] = {
+        { "1000000000000", 200000, 100000, 30 },
+        { "1000000000000000000000000000000", 300000, 1000000, 45 },
+        { "340282366920938463463374607431768211297", 100000, 30000, 25 },
+        { "100000000000000000000", 100000, 3500000000U, 40 } };
+    int i;
+
+    for (i = 0; i < CHECK_NUM(cases); i++)
+    {
+        soe_staticdata_t* sdata;
+        uint32_t* primes;
+        uint32_t* bits;
+        uint32_t np, k;
+        uint64_t* values;
+        uint64_t* ref;
+        uint64_t num, nref = 0, x, plo;
+        mpz_t lo, hi;
+        char name[120], detail[160];
+
+        if (quick && (cases[i].limit > 100000000))
+            continue;
+
+        mpz_init_set_str(lo, cases[i].lo, 10);
+        mpz_init(hi);
+        mpz_add_ui(hi, lo, cases[i].range);
+
+        // the reference primes come a piece at a time
+        bits = (uint32_t*)xcalloc(cases[i].range + 1, sizeof(uint32_t));
+        for (plo = 2; plo <= cases[i].limit; plo += REF_PIECE)
+        {
+            primes = ref_primes_range((uint32_t)plo,
+                (uint32_t)MIN(plo + REF_PIECE - 1, cases[i].limit), &np);
+            for (k = 0; k < np; k++)
+            {
+                uint64_t p = primes[k];
+                uint32_t lg = 0;
+
+                while ((2ULL << lg) <= p)
+                    lg++;
+                for (x = (p - mpz_fdiv_ui(lo, p)) % p; x <= cases[i].range; x += p)
+                    bits[x] += lg;
+                for (x = (p * p - mpz_fdiv_ui(lo, p * p)) % (p * p); x <= cases[i].range;
+                    x += p * p)
+                    bits[x] += lg;
+            }
+            free(primes);
+        }
+
+        ref = (uint64_t*)xmalloc((cases[i].range + 1) * sizeof(uint64_t));
+        for (x = 0; x <= cases[i].range; x++)
+        {
+            if (bits[x] >= cases[i].threshold)
+                ref[nref++] = x;
+        }
+
+        sdata = soe_init(0, threads, 32);
+        values = sieve_to_depth_smooth(sdata, lo, hi, cases[i].limit,
+            cases[i].threshold, &num);
+
+        sprintf(name, "smooth %.12s.. + %" PRIu64 ", primes to %u, %u bits",
+            cases[i].lo, cases[i].range, cases[i].limit, cases[i].threshold);
+        check(lists_equal(values, num, ref, nref, detail), name, detail);
+
+        free(values);
+        free(ref);
+        free(bits);
+        mpz_clear(lo);
+        mpz_clear(hi);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+// ------------------------------------------------------------------
+// sieving and PRP testing arbitrary intervals
+
+static void check_depth(void)
+{
+    // survivors of sieving to a depth beyond the built in sieve primes,
+    // at offsets that take each of the residue paths: 64 bit, 128 bit,
+    // mpz, and the remainder tree.  Ranges below 1e6 are padded out by
+    // the sieve and trimmed again.
+    static const struct {
+        const char* lo;
+        uint64_t range;
+        uint32_t limit;
+    } cases[] = {
+        { "1000000000000000000", 2000000, 1000000 },
+        { "1000000000000000000", 100000, 1000000 },
+        { "18446744073709000000", 1200000, 300000 },
+        { "1000000000000000000000000000000", 2000000, 1000000 },
+        { "1000000000000000000000000000000", 50000, 65536 },
+        { "1e300", 1000000, 1000000 },
+        { "1e3100", 200000, 200000 },
+        { "1e3100", 200000, 65536 } };
+    int i, t;
+
+    for (i = 0; i < CHECK_NUM(cases); i++)
+    {
+        uint64_t* ref;
+        uint64_t nref;
+        mpz_t lo, hi;
+
+        mpz_init(lo);
+        mpz_init(hi);
+        if (cases[i].lo[1] == 'e')
+            mpz_ui_pow_ui(lo, 10, strtoul(cases[i].lo + 2, NULL, 10));
+        else
+            mpz_set_str(lo, cases[i].lo, 10);
+        mpz_add_ui(hi, lo, cases[i].range);
+
+        ref = ref_sieve(lo, cases[i].range, cases[i].limit, &nref);
+
+        for (t = 1; t <= threads; t += MAX(threads - 1, 1))
+        {
+            soe_staticdata_t* sdata = soe_init(0, t, 32);
+            uint64_t* values;
+            uint64_t num, count;
+            char name[120], detail[160];
+
+            values = sieve_to_depth(sdata, lo, hi, 0, 0, cases[i].limit, &num, 0, 0);
+            sieve_to_depth(sdata, lo, hi, 1, 0, cases[i].limit, &count, 0, 0);
+
+            sprintf(name, "depth %.8s.. + %" PRIu64 " to %u, %d thread%s",
+                cases[i].lo, cases[i].range, cases[i].limit, t, (t > 1) ? "s" : "");
+            if (lists_equal(values, num, ref, nref, detail) && (count != num))
+                sprintf(detail, "counted %" PRIu64 ", listed %" PRIu64, count, num);
+            check(strlen(detail) == 0, name, detail);
+
+            free(values);
+            soe_finalize(sdata);
+        }
+
+        free(ref);
+        mpz_clear(lo);
+        mpz_clear(hi);
+    }
+
+    if (!quick)
+    {
+        // past 2^32 the sieve primes are generated a window at a time.
+        // sieving to sqrt leaves exactly the primes.
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        uint64_t* values;
+        uint64_t* ref;
+        uint64_t num, nref;
+        mpz_t lo, hi;
+        char detail[160];
+
+        mpz_init(lo);
+        mpz_init(hi);
+        mpz_ui_pow_ui(lo, 2, 65);
+        mpz_add_ui(hi, lo, 100000);
+
+        ref = ref_prp(lo, 100000, &nref);
+        values = sieve_to_depth(sdata, lo, hi, 0, 0, 6100000000ULL, &num, 0, 0);
+        lists_equal(values, num, ref, nref, detail);
+        check(strlen(detail) == 0, "depth 2^65 + 100000 to 6.1e9 (primes)", detail);
+
+        free(values);
+        free(ref);
+        mpz_clear(lo);
+        mpz_clear(hi);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+static void check_prp(void)
+{
+    // sieving and PRP testing together gives the primes, whether the
+    // numbers fit the native 128 bit tests or need gmp, on one thread
+    // or several sieving and testing segments at once
+    static const struct {
+        const char* lo;
+        uint64_t range;
+    } cases[] = {
+        { "1000000000000000000000", 3000000 },
+        { "1000000000000000000000000000000", 10000000 },
+        { "170141183460469231731687303715884105727", 1000000 },
+        { "10000000000000000000000000000000000000000", 2000000 },
+        { "1e500", 100000 } };
+    int i, t;
+
+    for (i = 0; i < CHECK_NUM(cases); i++)
+    {
+        uint64_t* ref;
+        uint64_t nref;
+        mpz_t lo, hi;
+
+        if (quick && (cases[i].range > 3000000))
+            continue;
+
+        mpz_init(lo);
+        mpz_init(hi);
+        if (cases[i].lo[1] == 'e')
+            mpz_ui_pow_ui(lo, 10, strtoul(cases[i].lo + 2, NULL, 10));
+        else
+            mpz_set_str(lo, cases[i].lo, 10);
+        mpz_add_ui(hi, lo, cases[i].range);
+
+        ref = ref_prp(lo, cases[i].range, &nref);
+
+        for (t = 1; t <= threads; t += MAX(threads - 1, 1))
+        {
+            soe_staticdata_t* sdata = soe_init(0, t, 32);
+            uint64_t* values;
+            uint64_t num;
+            char name[120], detail[160];
+
+            values = sieve_to_depth(sdata, lo, hi, 0, 1,
+                sdata->sieve_p[sdata->num_sp - 1], &num, 0, 0);
+
+            sprintf(name, "prp %.8s.. + %" PRIu64 ", %d thread%s",
+                cases[i].lo, cases[i].range, t, (t > 1) ? "s" : "");
+            check(lists_equal(values, num, ref, nref, detail), name, detail);
+
+            free(values);
+            soe_finalize(sdata);
+        }
+
+        free(ref);
+        mpz_clear(lo);
+        mpz_clear(hi);
+    }
+
+    return;
+}
+
+static void check_batch(void)
+{
+    // many windows at once, sieved and then PRP tested
+    static const char* bases[] = { "1000000000000000", "100000000000000000000",
+        "1000000000000000000000000000001", "98765432109876543210987654321098765432109",
+        "1000000000000000000000000000000000000000000000000000000000000000000" };
+    static const uint64_t widths[] = { 1000000, 20000, 50000, 3000, 100000 };
+    int num_windows = CHECK_NUM(bases);
+    mpz_t b[CHECK_NUM(bases)];
+    uint64_t w[CHECK_NUM(bases)];
+    int witnesses, i;
+
+    for (i = 0; i < num_windows; i++)
+    {
+        mpz_init_set_str(b[i], bases[i], 10);
+        w[i] = widths[i];
+    }
+
+    for (witnesses = 0; witnesses <= 1; witnesses++)
+    {
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        uint64_t num_p[CHECK_NUM(bases)];
+        uint64_t** values;
+
+        values = sieve_to_depth_batch(sdata, b, w, num_windows, witnesses, 100000, num_p);
+
+        for (i = 0; i < num_windows; i++)
+        {
+            uint64_t* ref;
+            uint64_t nref;
+            char name[120], detail[160];
+
+            if (witnesses)
+                ref = ref_prp(b[i], w[i], &nref);
+            else
+                ref = ref_sieve(b[i], w[i], 100000, &nref);
+
+            sprintf(name, "batch %s window %d, %.8s.. + %" PRIu64,
+                witnesses ? "prp" : "sieve", i, bases[i], w[i]);
+            check(lists_equal(values[i], num_p[i], ref, nref, detail), name, detail);
+
+            free(ref);
+            free(values[i]);
+        }
+
+        free(values);
+        soe_finalize(sdata);
+    }
+
+    if (!quick)
+    {
+        // sieve limits past 3.04e9 have squares past 2^63
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        uint64_t num_p[2];
+        uint64_t** values;
+
+        values = sieve_to_depth_batch(sdata, b + 1, w + 1, 2, 0, 3500000000U, num_p);
+
+        for (i = 0; i < 2; i++)
+        {
+            uint64_t* ref;
+            uint64_t nref;
+            char name[120], detail[160];
+
+            ref = ref_sieve(b[i + 1], w[i + 1], 3500000000U, &nref);
+            sprintf(name, "batch sieve window %d to 3.5e9, %.8s.. + %" PRIu64,
+                i + 1, bases[i + 1], w[i + 1]);
+            check(lists_equal(values[i], num_p[i], ref, nref, detail), name, detail);
+
+            free(ref);
+            free(values[i]);
+        }
+
+        free(values);
+        soe_finalize(sdata);
+    }
+
+    for (i = 0; i < num_windows; i++)
+        mpz_clear(b[i]);
+
+    return;
+}
+
+static void check_bitmap(void)
+{
+    // sieve survivors kept as bits, expanded in slices, and saved
+    static const struct {
+        const char* lo;
+        uint64_t range;
+    } cases[] = {
+        { "100000000000000000000", 3000000 },
+        { "100000000000000000000", 100000 },
+        { "1000000000000000000000000000000000000000", 1500000 } };
+    int i;
+
+    for (i = 0; i < CHECK_NUM(cases); i++)
+    {
+        soe_staticdata_t* sdata = soe_init(0, threads, 32);
+        soe_bitmap_t* bm;
+        soe_bitmap_t* rd;
+        uint64_t* values;
+        uint64_t* ref;
+        uint64_t num, nref, n, j, k, start, stop;
+        mpz_t lo, hi;
+        char name[120], detail[160];
+        int ok;
+
+        mpz_init_set_str(lo, cases[i].lo, 10);
+        mpz_init(hi);
+        mpz_add_ui(hi, lo, cases[i].range);
+
+        ref = ref_sieve(lo, cases[i].range, sdata->sieve_p[sdata->num_sp - 1], &nref);
+        bm = sieve_to_depth_bitmap(sdata, lo, hi, &num);
+        values = (uint64_t*)xmalloc((cases[i].range + 1) * sizeof(uint64_t));
+        n = soe_bitmap_values(bm, 0, cases[i].range, values);
+
+        sprintf(name, "bitmap %.8s.. + %" PRIu64, cases[i].lo, cases[i].range);
+        if (lists_equal(values, n, ref, nref, detail) && (num != n))
+            sprintf(detail, "%" PRIu64 " flags counted, %" PRIu64 " listed", num, n);
+        check(strlen(detail) == 0, name, detail);
+
+        // slices that don't line up with anything
+        ok = 1;
+        for (j = 0; ok && (j < 20); j++)
+        {
+            uint64_t m = 0;
+
+            start = rng(cases[i].range + 1);
+            stop = start + rng(cases[i].range + 1 - start);
+            n = soe_bitmap_values(bm, start, stop, values);
+            for (k = 0; k < nref; k++)
+            {
+                if ((ref[k] >= start) && (ref[k] <= stop))
+                    ok &= (m < n) && (values[m++] == ref[k]);
+            }
+            ok &= (m == n);
+        }
+
+        sprintf(name, "bitmap %.8s.. + %" PRIu64 " slices", cases[i].lo, cases[i].range);
+        sprintf(detail, "slice %" PRIu64 " : %" PRIu64 " differs", start, stop);
+        check(ok, name, detail);
+
+        sprintf(name, "bitmap %.8s.. + %" PRIu64 " file", cases[i].lo, cases[i].range);
+        strcpy(detail, "write or read failed");
+        rd = NULL;
+        if (soe_bitmap_write(bm, "check_bitmap.bin") == 0)
+            rd = soe_bitmap_read("check_bitmap.bin");
+        if (rd != NULL)
+        {
+            n = soe_bitmap_values(rd, 0, cases[i].range, values);
+            if (lists_equal(values, n, ref, nref, detail) &&
+                ((mpz_cmp(rd->base, bm->base) != 0) || (rd->num != bm->num)))
+                strcpy(detail, "base or count differ");
+            soe_bitmap_free(rd);
+        }
+        check(strlen(detail) == 0, name, detail);
+        remove("check_bitmap.bin");
+
+        soe_bitmap_free(bm);
+        free(values);
+        free(ref);
+        mpz_clear(lo);
+        mpz_clear(hi);
+        soe_finalize(sdata);
+    }
+
+    return;
+}
+
+// ------------------------------------------------------------------
+// prime lists on disk and in mapped files
+
+static void check_formats(void)
+{
+    // each binary format reads back what was written, including only
+    // the part of the list inside the limits; the text format matches
+    // printf.
+    static const int formats[] = { SOE_OUTPUT_U64, SOE_OUTPUT_GAP32, SOE_OUTPUT_VARINT };
+    static const uint64_t ranges[][2] = {
+        { 0, 2000000 },
+        { 999999000, 1000001000 },
+        { 1000000000000000000ULL, 1000000000001000000ULL },
+        { 3999999999900000000ULL, 4000000000000000000ULL } };
+    int i, f;
+
+    for (i = 0; i < CHECK_NUM(ranges); i++)
+    {
+        uint64_t lo = ranges[i][0];
+        uint64_t hi = ranges[i][1];
+        uint64_t sublo = lo + (hi - lo) / 3;
+        uint64_t subhi = hi - (hi - lo) / 3;
+        uint64_t* primes;
+        uint64_t num, n, j, first, last;
+        char name[120], detail[160];
+        FILE* out;
+
+        primes = wrapper_primes(lo, hi, &num);
+        first = first_at_least(primes, num, sublo);
+        last = first_at_least(primes, num, subhi + 1);
+
+        for (f = 0; f < CHECK_NUM(formats); f++)
+        {
+            const char* filename = soe_output_filename(formats[f]);
+            uint64_t* rd;
+
+            n = soe_write_primes(filename, formats[f], primes, num, lo, hi);
+            rd = soe_read_primes(filename, formats[f], &n);
+            sprintf(name, "format %s %" PRIu64 " : %" PRIu64, filename, lo, hi);
+            check(lists_equal(rd, n, primes, num, detail), name, detail);
+            free(rd);
+
+            n = soe_write_primes(filename, formats[f], primes, num, sublo, subhi);
+            rd = soe_read_primes(filename, formats[f], &n);
+            sprintf(name, "format %s %" PRIu64 " : %" PRIu64, filename, sublo, subhi);
+            check(lists_equal(rd, n, primes + first, last - first, detail), name, detail);
+            free(rd);
+            remove(filename);
+        }
+
+        out = fopen("check_text.ref", "w");
+        for (j = 0; j < num; j++)
+            fprintf(out, "%" PRIu64 "\n", primes[j]);
+        fclose(out);
+
+        soe_write_primes(soe_output_filename(SOE_OUTPUT_TEXT), SOE_OUTPUT_TEXT,
+            primes, num, lo, hi);
+        sprintf(name, "format %s %" PRIu64 " : %" PRIu64,
+            soe_output_filename(SOE_OUTPUT_TEXT), lo, hi);
+        check(files_equal(soe_output_filename(SOE_OUTPUT_TEXT), "check_text.ref"),
+            name, "differs from printf");
+        remove(soe_output_filename(SOE_OUTPUT_TEXT));
+        remove("check_text.ref");
+
+        free(primes);
+    }
+
+    return;
+}
+
+static void check_file_threads(void)
+{
+    // a range over two file pieces, written with one thread and then
+    // with several, in every format.  The lists soe_wrapper returns and
+    // the files must be the same.
+    static const int formats[] = { SOE_OUTPUT_TEXT, SOE_OUTPUT_U64,
+        SOE_OUTPUT_GAP32, SOE_OUTPUT_VARINT };
+    uint64_t lo = 4000000000ULL;
+    uint64_t hi = quick ? 6100000000ULL : 7000000000ULL;
+    int i;
+
+    for (i = 0; i < CHECK_NUM(formats); i++)
+    {
+        const char* filename = soe_output_filename(formats[i]);
+        soe_staticdata_t* s1 = soe_init(0, 1, 32);
+        soe_staticdata_t* sn = soe_init(0, threads, 32);
+        uint64_t n1, nn, j;
+        uint64_t* p1;
+        uint64_t* pn;
+        char name[80], detail[160];
+        int same;
+
+        p1 = soe_wrapper(s1, lo, hi, 0, &n1, formats[i], 0);
+        remove("check_file.ref");
+        rename(filename, "check_file.ref");
+        pn = soe_wrapper(sn, lo, hi, 0, &nn, formats[i], 0);
+
+        same = (n1 == nn);
+        for (j = 0; same && (j < n1); j++)
+            same = (p1[j] == pn[j]);
+
+        sprintf(name, "file %s, %d threads", filename, threads);
+        sprintf(detail, "%" PRIu64 " primes from 1 thread, %" PRIu64 " from %d%s",
+            n1, nn, threads, same ? ", files differ" : "");
+        check(same && files_equal(filename, "check_file.ref"), name, detail);
+
+        remove("check_file.ref");
+        remove(filename);
+        soe_free_primes(s1, p1);
+        soe_free_primes(sn, pn);
+        soe_finalize(s1);
+        soe_finalize(sn);
+    }
+
+    return;
+}
+
+static void check_mapped(void)
+{
+    // a list big enough to live in a mapped file
+    soe_staticdata_t* sdata = soe_init(0, threads, 32);
+    uint64_t hi = quick ? 300000000 : 1000000000;
+    uint64_t* primes;
+    uint64_t* ref;
+    uint64_t num, nref;
+    char detail[160];
+
+    ref = wrapper_primes(0, hi, &nref);
+    sdata->map_path = "check_map";
+    primes = soe_wrapper(sdata, 0, hi, 0, &num, 0, 0);
+    if (lists_equal(primes, num, ref, nref, detail) && (sdata->num_mapped != 1))
+        sprintf(detail, "%d mapped lists, expected 1", sdata->num_mapped);
+    check(strlen(detail) == 0, "mapped prime list", detail);
+
+    soe_free_primes(sdata, primes);
+    free(ref);
+    soe_finalize(sdata);
+    return;
+}
+
+static void check_archive(void)
+{
+    // counts, nth primes and lists from an archive, including the parts
+    // past its limit that are left to the sieve
+    uint64_t limit = quick ? 200000000 : 1000000000;
+    soe_staticdata_t* sdata = soe_init(0, threads, 32);
+    soe_archive_t* a;
+    uint64_t* ref;
+    uint64_t nref, i, bad;
+    char detail[240];
+
+    ref = wrapper_primes(0, limit + limit / 4, &nref);
+    if (soe_archive_build(sdata, "check.arc", limit) != 0)
+    {
+        check(0, "archive build", "failed");
+        free(ref);
+        soe_finalize(sdata);
+        return;
+    }
+
+    a = soe_archive_open("check.arc");
+    if (a == NULL)
+    {
+        check(0, "archive open", "failed");
+        free(ref);
+        soe_finalize(sdata);
+        return;
+    }
+
+    for (bad = 0, i = 0; i < 200; i++)
+    {
+        uint64_t lo = rng(limit + limit / 4);
+        uint64_t hi = lo + rng((i < 20) ? (limit + limit / 4 - lo) : 100000);
+        uint64_t c = soe_archive_count(a, sdata, lo, hi);
+        uint64_t n = first_at_least(ref, nref, hi + 1) - first_at_least(ref, nref, lo);
+
+        if ((c != n) && (bad++ == 0))
+            sprintf(detail, "%" PRIu64 " : %" PRIu64 " has %" PRIu64 ", expected %" PRIu64,
+                lo, hi, c, n);
+    }
+    check(bad == 0, "archive count", detail);
+
+    for (bad = 0, i = 0; i < 200; i++)
+    {
+        uint64_t n = 1 + ((i < 4) ? i : rng(nref));
+        uint64_t p = soe_archive_nth_prime(a, sdata, n);
+
+        if ((p != ref[n - 1]) && (bad++ == 0))
+            sprintf(detail, "prime %" PRIu64 " is %" PRIu64 ", expected %" PRIu64,
+                n, p, ref[n - 1]);
+    }
+    check(bad == 0, "archive nth prime", detail);
+
+    for (bad = 0, i = 0; i < 20; i++)
+    {
+        uint64_t lo = rng(limit + limit / 4 - 3000000);
+        uint64_t hi = lo + rng(3000000);
+        uint64_t* primes;
+        uint64_t num, j, k;
+        char d[160];
+
+        if (i == 0)
+            lo = 0, hi = 1000;
+        else if (i == 1)
+            lo = limit - 1000000, hi = limit + 1000000;
+
+        primes = soe_archive_primes(a, sdata, lo, hi, &num);
+        j = first_at_least(ref, nref, lo);
+        k = first_at_least(ref, nref, hi + 1);
+        if (!lists_equal(primes, num, ref + j, k - j, d) && (bad++ == 0))
+            sprintf(detail, "%" PRIu64 " : %" PRIu64 ": %s", lo, hi, d);
+        free(primes);
+    }
+    check(bad == 0, "archive primes", detail);
+
+    soe_archive_close(a);
+    remove("check.arc");
+    free(ref);
+    soe_finalize(sdata);
+    return;
+}
+
+static void check_pi_table(void)
+{
+    // counts that start or stop anywhere near the table's checkpoints
+    uint64_t limit = quick ? 1000000000 : 4000000000ULL;
+    uint64_t step = 100000000;
+    soe_staticdata_t* sdata = soe_init(0, threads, 32);
+    soe_staticdata_t* plain = soe_init(0, threads, 32);
+    uint64_t i, bad = 0;
+    char detail[160];
+
+    if ((soe_pi_table_build(plain, "check.pi", limit, step) != 0) ||
+        (soe_pi_table_load(sdata, "check.pi") != 0))
+    {
+        check(0, "pi table", "build or load failed");
+        soe_finalize(sdata);
+        soe_finalize(plain);
+        return;
+    }
+
+    for (i = 0; i < (quick ? 12 : 30); i++)
+    {
+        uint64_t k = 1 + rng(limit / step - 1);
+        uint64_t lo = k * step - 1000000 + rng(2000000);
+        uint64_t hi = (k + rng(4)) * step - 1000000 + rng(2000000);
+        uint64_t c, n;
+
+        if (i < 3)
+            lo = i;
+        if (hi < lo)
+            hi = lo + rng(1000000);
+
+        soe_wrapper(sdata, lo, hi, 1, &c, 0, 0);
+        soe_wrapper(plain, lo, hi, 1, &n, 0, 0);
+        if ((c != n) && (bad++ == 0))
+            sprintf(detail, "%" PRIu64 " : %" PRIu64 " has %" PRIu64 ", expected %" PRIu64,
+                lo, hi, c, n);
+    }
+    check(bad == 0, "pi table counts", detail);
+
+    remove("check.pi");
+    soe_finalize(sdata);
+    soe_finalize(plain);
+    return;
+}
+
+// ------------------------------------------------------------------
+// tuning parameters change the speed, never the answers
+
+static int tune_equal(const soe_tune_t* a, const soe_tune_t* b)
+{
+    int i;
+
+    if ((a->blocksize != b->blocksize) || (a->wheel_max_low != b->wheel_max_low) ||
+        (a->bucket_start != b->bucket_start) || (a->bit_update != b->bit_update) ||
+        (a->cpu != b->cpu))
+        return 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        if ((a->wheel_bounds[i] != b->wheel_bounds[i]) || (a->unroll[i] != b->unroll[i]))
+            return 0;
+    }
+    return 1;
+}
+
+static uint64_t count_range(soe_staticdata_t* sdata, uint64_t lo, uint64_t hi)
+{
+    uint64_t num;
+
+    soe_wrapper(sdata, lo, hi, 1, &num, 0, 0);
+    return num;
+}
+
+static void check_tune(void)
+{
+    static const uint64_t ranges[][2] = {
+        { 0, 100000000 },
+        { 100000000000ULL, 100200000000ULL },
+        { 1000000000000000ULL, 1000000050000000ULL } };
+    static const soe_tune_t tunes[] = {
+        { 65536, { 1000000, 2000000, 3000000 }, 0, { 100, 200, 300 }, 20000, SOE_BITMASKS8, 0 },
+        { 131072, { 10000000000ULL, 100000000000ULL, 1000000000000ULL }, 1000000000ULL,
+            { 5000, 6000, 7000 }, 2000, SOE_BITMASKS32, 0 },
+        { 0, { 0, 0, 0 }, 0, { 0, 0, 0 }, 0, SOE_BITLOGIC8, 0 },
+        { 0, { 0, 0, 0 }, 0, { 0, 0, 0 }, 0, SOE_BITLOGIC32, 0 } };
+    uint64_t ref[CHECK_NUM(ranges)];
+    soe_staticdata_t* sdata;
+    soe_tune_t rd;
+    char name[80], detail[160];
+    int i, t;
+
+    sdata = soe_init(0, threads, 32);
+    for (i = 0; i < CHECK_NUM(ranges); i++)
+        ref[i] = count_range(sdata, ranges[i][0], ranges[i][1]);
+    soe_finalize(sdata);
+
+    for (t = 0; t < CHECK_NUM(tunes); t++)
+    {
+        // profiles survive a write and read
+        memset(&rd, 0, sizeof(rd));
+        soe_tune_write((soe_tune_t*)&tunes[t], "check.tune");
+        soe_tune_read(&rd, "check.tune");
+        sprintf(name, "tune profile %d", t);
+        check(tune_equal(&rd, &tunes[t]), name, "read back differently");
+        remove("check.tune");
+
+        // applied as soe_autotune does
+        sdata = soe_init(0, threads, 32);
+        sdata->tune = rd;
+        if (rd.blocksize > 0)
+            sdata->SOEBLOCKSIZE = rd.blocksize;
+        sdata->bit_update = rd.bit_update;
+
+        for (i = 0; i < CHECK_NUM(ranges); i++)
+        {
+            uint64_t n = count_range(sdata, ranges[i][0], ranges[i][1]);
+
+            sprintf(name, "tune profile %d counts %" PRIu64 " : %" PRIu64,
+                t, ranges[i][0], ranges[i][1]);
+            sprintf(detail, "%" PRIu64 ", expected %" PRIu64, n, ref[i]);
+            check(n == ref[i], name, detail);
+        }
+        soe_finalize(sdata);
+    }
+
+    if (!quick)
+    {
+        // measured once, then reused
+        soe_tune_t first;
+        int m1, m2;
+
+        remove("check.tune");
+        sdata = soe_init(0, threads, 32);
+        m1 = soe_autotune(sdata, "check.tune");
+        first = sdata->tune;
+        for (i = 0; i < CHECK_NUM(ranges); i++)
+        {
+            uint64_t n = count_range(sdata, ranges[i][0], ranges[i][1]);
+
+            sprintf(name, "autotune counts %" PRIu64 " : %" PRIu64,
+                ranges[i][0], ranges[i][1]);
+            sprintf(detail, "%" PRIu64 ", expected %" PRIu64, n, ref[i]);
+            check(n == ref[i], name, detail);
+        }
+        soe_finalize(sdata);
+
+        sdata = soe_init(0, threads, 32);
+        m2 = soe_autotune(sdata, "check.tune");
+        sprintf(detail, "measured %d then %d times", m1, m2);
+        check((m1 == 1) && (m2 == 0) && tune_equal(&first, &sdata->tune),
+            "autotune profile reuse", detail);
+        soe_finalize(sdata);
+        remove("check.tune");
+    }
+
+    return;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-T") == 0) && (i + 1 < argc))
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0)
+            quick = 1;
+        else
+        {
+            printf("usage: %s [-T threads] [-q]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    check_reduce();
+    check_factor();
+    check_mult();
+    check_smooth();
+    check_depth();
+    check_prp();
+    check_batch();
+    check_bitmap();
+    check_formats();
+    check_file_threads();
+    check_mapped();
+    check_archive();
+    check_pi_table();
+    check_tune();
+
+    printf("%d of %d checks failed\n", num_failed, num_checks);
+    return MIN(num_failed, 255);
+}
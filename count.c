@@ -336,3 +336,69 @@ void count_line_special(thread_soedata_t *thread_data)
 	}
 
 }
+
+void reduction_add_prime(soe_reduction_t *r, uint64_t prime)
+{
+	r->count++;
+	r->sum_lo += prime;
+	r->sum_hi += (r->sum_lo < prime);
+	r->sumsq += prime * prime;
+	r->xorsum ^= prime;
+	return;
+}
+
+void reduction_merge(soe_reduction_t *dest, soe_reduction_t *src)
+{
+	dest->count += src->count;
+	dest->sum_lo += src->sum_lo;
+	dest->sum_hi += src->sum_hi + (dest->sum_lo < src->sum_lo);
+	dest->sumsq += src->sumsq;
+	dest->xorsum ^= src->xorsum;
+	return;
+}
+
+uint64_t reduce_line(soe_staticdata_t *sdata, uint32_t current_line, soe_reduction_t *r)
+{
+	// fold the primes flagged in this line directly into the 
+	// reduction accumulators.  All of the supported reductions are
+	// commutative, so we can visit the line in storage order and
+	// never need to interleave it with the other residue classes
+	// like compute_8_bytes does.
+	uint64_t *line64 = (uint64_t *)sdata->lines[current_line];
+	uint64_t numwords = sdata->numlinebytes >> 3;
+	uint64_t prodN = sdata->prodN;
+	uint64_t olow = sdata->orig_llimit;
+	uint64_t ohigh = sdata->orig_hlimit;
+	uint64_t base = sdata->lowlimit + (uint64_t)sdata->rclass[current_line];
+	uint64_t count = 0, sum_lo = 0, sum_hi = 0, sumsq = 0, xorsum = 0;
+	uint64_t i;
+
+	for (i = 0; i < numwords; i++, base += 64 * prodN)
+	{
+		uint64_t flags64 = line64[i];
+
+		while (flags64 > 0)
+		{
+			uint64_t pos = _trail_zcnt64(flags64);
+			uint64_t prime = base + pos * prodN;
+
+			if ((prime >= olow) && (prime <= ohigh))
+			{
+				count++;
+				sum_lo += prime;
+				sum_hi += (sum_lo < prime);
+				sumsq += prime * prime;
+				xorsum ^= prime;
+			}
+			flags64 ^= (1ULL << pos);
+		}
+	}
+
+	r->count += count;
+	r->sum_lo += sum_lo;
+	r->sum_hi += sum_hi + (r->sum_lo < sum_lo);
+	r->sumsq += sumsq;
+	r->xorsum ^= xorsum;
+
+	return count;
+}
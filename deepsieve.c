@@ -0,0 +1,323 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+#include "threadpool.h"
+
+// Remove values divisible by primes beyond the 32-bit sieve.  The main
+// sieve keeps its primes, roots and offsets in 32 bits, which caps the
+// sieve depth of sieve_to_depth at about 4e9.  Deeper presieving of
+// large candidates is done here as a second pass over the survivors.
+// The deep primes are split into windows that are handed to the
+// threads.  Each thread generates the primes of its window with a
+// private instance of the sieve, reduces the offset modulo all of them
+// at once, and looks up each multiple in a bitmap of the survivors.
+// Primes larger than the range have at most one multiple in it, so
+// nearly all of the work is the prime generation and the reduction.
+// Hits on survivors are kept in per-thread lists and removed at the end.
+
+// width of each window of deep primes
+#define DEEP_WINDOW (1ULL << 26)
+
+typedef struct
+{
+	soe_staticdata_t *gen;		// this thread's deep prime generator
+	uint64_t lo;				// the window assigned to this thread
+	uint64_t hi;
+	uint64_t *res;				// offset mod each prime of the window
+	uint64_t res_alloc;
+	uint64_t *hits;				// survivors with a deep prime factor
+	uint64_t num_hits;
+	uint64_t hits_alloc;
+	uint64_t num_primes;
+} deep_threaddata_t;
+
+typedef struct
+{
+	mpz_ptr offset;
+	int offset_mode;			// how the offset is reduced, see below
+	uint64_t off64;				// the offset, if it fits in 64 bits
+#ifdef HAVE_UINT128
+	uint128_t off128;			// the offset, if it fits in 128 bits
+#endif
+	const uint8_t *surv;		// bitmap of the survivors
+	uint64_t span;				// the largest survivor
+	uint64_t phi;
+	uint64_t next;				// start of the next window to hand out
+	uint64_t plo;
+	soe_staticdata_t *sdata;	// the caller's, for progress counts
+	deep_threaddata_t *tdata;
+} deep_userdata_t;
+
+enum deep_offset_mode
+{
+	DEEP_OFFSET_U64,
+	DEEP_OFFSET_U128,
+	DEEP_OFFSET_MPZ
+};
+
+void deep_dispatch(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	deep_userdata_t *udata = (deep_userdata_t *)tdata->user_data;
+	deep_threaddata_t *t = udata->tdata + tdata->tindex;
+
+	// if not done, dispatch another window
+	if (udata->next <= udata->phi)
+	{
+		t->lo = udata->next;
+		t->hi = MIN(udata->next + DEEP_WINDOW - 1, udata->phi);
+		tdata->work_fcn_id = 0;
+		udata->next = t->hi + 1;
+	}
+	else
+	{
+		tdata->work_fcn_id = tdata->num_work_fcn;
+	}
+
+	return;
+}
+
+static __inline void deep_hit(deep_threaddata_t *t, uint64_t loc)
+{
+	if (t->num_hits == t->hits_alloc)
+	{
+		t->hits_alloc = MAX(2 * t->hits_alloc, 1024);
+		t->hits = (uint64_t *)xrealloc(t->hits, t->hits_alloc * sizeof(uint64_t));
+	}
+	t->hits[t->num_hits++] = loc;
+	return;
+}
+
+void deep_work_fcn(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	deep_userdata_t *udata = (deep_userdata_t *)tdata->user_data;
+	deep_threaddata_t *t = udata->tdata + tdata->tindex;
+	uint64_t *primes;
+	uint64_t num, i, j;
+	uint64_t span = udata->span;
+
+	primes = soe_wrapper(t->gen, t->lo, t->hi, 0, &num, 0, 0);
+	if (primes == NULL)
+		return;
+
+	// soe_wrapper may return a little more than was asked for
+	while ((num > 0) && (primes[num - 1] > t->hi))
+		num--;
+	for (i = 0; (i < num) && (primes[i] < t->lo); i++);
+
+	// huge offsets are reduced modulo the whole window at once
+	if ((udata->offset_mode == DEEP_OFFSET_MPZ) && (num > i))
+	{
+		if ((num - i) > t->res_alloc)
+		{
+			t->res_alloc = num - i;
+			t->res = (uint64_t *)xrealloc(t->res, t->res_alloc * sizeof(uint64_t));
+		}
+		remtree_mod_primes64(udata->offset, primes + i, (uint32_t)(num - i), t->res);
+	}
+
+	for (j = 0; i < num; i++, j++)
+	{
+		uint64_t p = primes[i];
+		uint64_t r, s;
+
+		if ((udata->offset_mode == DEEP_OFFSET_U64) && (udata->off64 <= p))
+		{
+			// a prime inside the range is not a hit on itself
+			s = 2 * p - udata->off64;
+		}
+		else
+		{
+			if (udata->offset_mode == DEEP_OFFSET_U64)
+				r = udata->off64 % p;
+#ifdef HAVE_UINT128
+			else if (udata->offset_mode == DEEP_OFFSET_U128)
+				r = (uint64_t)(udata->off128 % p);
+#endif
+			else
+				r = t->res[j];
+
+			s = (r == 0) ? 0 : p - r;
+		}
+
+		// beyond the span of the range the loop runs at most once
+		for (; s <= span; s += p)
+		{
+			if (udata->surv[s >> 3] & (1 << (s & 7)))
+				deep_hit(t, s);
+		}
+	}
+
+	t->num_primes += j;
+	soe_free_primes(t->gen, primes);
+	soe_progress_add(udata->sdata, SOE_PROGRESS_DEEP, t->hi - t->lo + 1);
+
+	return;
+}
+
+uint64_t deep_sieve_values(soe_staticdata_t *sdata, mpz_t *offset,
+	uint64_t *values, uint64_t num, uint64_t plo, uint64_t phi)
+{
+	// values[0..num) are sorted offsets from *offset.  Remove those
+	// with a prime factor in (plo, phi] and return how many remain.
+	// Primes larger than the square root of the largest value are not
+	// needed and are not used.
+	deep_userdata_t udata;
+	tpool_t *tpool_data;
+	uint8_t *surv;
+	uint64_t span, i, k;
+	uint64_t num_primes = 0;
+	mpz_t tmpz;
+	int t;
+
+	// timing
+	double tt;
+	struct timeval tstart, tstop;
+
+	if (num == 0)
+		return 0;
+
+	span = values[num - 1];
+
+	// the largest prime that can divide a composite value
+	mpz_init(tmpz);
+	mpz_add_ui(tmpz, *offset, span);
+	mpz_sqrt(tmpz, tmpz);
+	if (mpz_cmp_ui(tmpz, phi) < 0)
+		phi = mpz_get_ui(tmpz);
+
+	if (phi <= plo)
+	{
+		mpz_clear(tmpz);
+		return num;
+	}
+
+	if (sdata->VFLAG > 0)
+	{
+		printf("sieving %" PRIu64 " survivors with primes from %" PRIu64
+			" to %" PRIu64 "\n", num, plo, phi);
+		gettimeofday(&tstart, NULL);
+	}
+
+	surv = (uint8_t *)xcalloc(span / 8 + 1, sizeof(uint8_t));
+	for (i = 0; i < num; i++)
+		surv[values[i] >> 3] |= (uint8_t)(1 << (values[i] & 7));
+
+	udata.offset = *offset;
+	udata.off64 = 0;
+	if (mpz_sizeinbase(*offset, 2) <= 64)
+	{
+		udata.offset_mode = DEEP_OFFSET_U64;
+		mpz_export(&udata.off64, NULL, -1, sizeof(uint64_t), 0, 0, *offset);
+	}
+#ifdef HAVE_UINT128
+	else if (mpz_get_u128(*offset, &udata.off128))
+	{
+		udata.offset_mode = DEEP_OFFSET_U128;
+	}
+#endif
+	else
+	{
+		udata.offset_mode = DEEP_OFFSET_MPZ;
+	}
+	udata.surv = surv;
+	udata.span = span;
+	udata.plo = plo;
+	udata.phi = phi;
+	udata.next = plo + 1;
+	udata.sdata = sdata;
+
+	// separate single-threaded sieve instances for the deep primes,
+	// so that the caller's sieve primes are left alone.
+	udata.tdata = (deep_threaddata_t *)xcalloc(sdata->THREADS, sizeof(deep_threaddata_t));
+	for (t = 0; t < sdata->THREADS; t++)
+	{
+		udata.tdata[t].gen = soe_init(0, 1, sdata->SOEBLOCKSIZE);
+	}
+
+	tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
+		&deep_dispatch, &udata);
+
+	soe_progress_begin(sdata, SOE_PROGRESS_DEEP, phi - plo);
+	if (sdata->THREADS == 1)
+	{
+		while (udata.next <= phi)
+		{
+			deep_dispatch(tpool_data);
+			deep_work_fcn(tpool_data);
+		}
+	}
+	else
+	{
+		tpool_add_work_fcn(tpool_data, &deep_work_fcn);
+		tpool_go(tpool_data);
+	}
+	soe_progress_end(sdata, SOE_PROGRESS_DEEP);
+
+	free(tpool_data);
+
+	// clear the survivors that a deep prime hit, and keep the rest
+	for (t = 0; t < sdata->THREADS; t++)
+	{
+		deep_threaddata_t *d = udata.tdata + t;
+
+		for (i = 0; i < d->num_hits; i++)
+			surv[d->hits[i] >> 3] &= (uint8_t)~(1 << (d->hits[i] & 7));
+		num_primes += d->num_primes;
+
+		soe_finalize(d->gen);
+		free(d->res);
+		free(d->hits);
+	}
+	free(udata.tdata);
+
+	for (i = 0, k = 0; i < num; i++)
+	{
+		uint64_t v = values[i];
+
+		if (surv[v >> 3] & (1 << (v & 7)))
+			values[k++] = v;
+	}
+
+	free(surv);
+	mpz_clear(tmpz);
+
+	if (sdata->VFLAG > 0)
+	{
+		gettimeofday(&tstop, NULL);
+		tt = ytools_difftime(&tstart, &tstop);
+		printf("\nremoved %" PRIu64 " survivors with %" PRIu64 " deep primes in "
+			"%1.4f seconds\n", num - k, num_primes, tt);
+	}
+
+	return k;
+}
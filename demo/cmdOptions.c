@@ -30,6 +30,7 @@ SOFTWARE.
 
 
 #include "cmdOptions.h"
+#include "soe.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,13 +48,13 @@ char usageHelp[MAXHELPLEN] = "[start (default 0)] stop [options]";
 
 // command line options, specified by '-'
 char OptionArray[NUMOPTIONS][MAXOPTIONLEN] = { 
-    "t", "s", "f", "v", "b", "p"};
+    "t", "s", "f", "v", "b", "p", "r", "o", "m", "c", "T", "B", "a"};
 
 // command line option aliases, specified by '--'
 // need the same number of strings here, even if
 // some of them are blank (i.e., have no long form alias).
 char LongOptionAliases[NUMOPTIONS][MAXOPTIONLEN] = {
-    "threads", "screen", "file", "", "blksz", "sievep"};
+    "threads", "screen", "file", "", "blksz", "sievep", "reduce", "format", "map", "counters", "trace", "bits", "autotune"};
 
 // indication of whether or not an option needs a corresponding argument.
 // needs to be the same length as the above two arrays.
@@ -61,7 +62,7 @@ char LongOptionAliases[NUMOPTIONS][MAXOPTIONLEN] = {
 // 1 = argument required
 // 2 = argument optional
 int needsArg[NUMOPTIONS] = {
-    1,0,2,0,1,1};
+    1,0,2,0,1,1,0,1,1,0,1,1,2};
 
 // help strings displayed with -h
 // needs to be the same length as the above arrays, even if 
@@ -72,7 +73,14 @@ char OptionHelp[NUMOPTIONS][MAXHELPLEN] = {
     "Output to file",
     "Verbosity - this option should not have an argument",
     "Blocksize in kB",
-    "Upper end of primes to sieve with (default = 0: sieve with all necessary primes)"};
+    "Upper end of primes to sieve with (default = 0: sieve with all necessary primes)",
+    "Compute sum, sum of squares and xor of the primes instead of listing them",
+    "File format: text (default), u64, gap32 or varint",
+    "Keep big prime lists in temporary files named after this path instead of memory",
+    "Print per-phase timings, with hardware event counts where available",
+    "Write a Chrome trace of the sieve threads to this file",
+    "Flag clearing in the AVX2 line sieve: auto (default), bitmasks8, bitmasks32, bitlogic8 or bitlogic32",
+    "Measure sieve parameters for this machine, or read them from this profile (overrides -b)"};
 // ========================================================================
 
 // ========================================================================
@@ -132,6 +140,64 @@ void applyOpt(char* opt, char* arg, options_t* options)
     {
         options->sieve_primes_limit = strtoul(arg, NULL, 10);
     }
+    else if (strcmp(opt, options->OptionArray[6]) == 0)
+    {
+        options->reduce = 1;
+    }
+    else if (strcmp(opt, options->OptionArray[7]) == 0)
+    {
+        if (strcmp(arg, "text") == 0)
+            options->outFormat = SOE_OUTPUT_TEXT;
+        else if (strcmp(arg, "u64") == 0)
+            options->outFormat = SOE_OUTPUT_U64;
+        else if (strcmp(arg, "gap32") == 0)
+            options->outFormat = SOE_OUTPUT_GAP32;
+        else if (strcmp(arg, "varint") == 0)
+            options->outFormat = SOE_OUTPUT_VARINT;
+        else
+        {
+            printf("unknown file format %s\n", arg);
+            exit(0);
+        }
+    }
+    else if (strcmp(opt, options->OptionArray[8]) == 0)
+    {
+        strcpy(options->mapFile, arg);
+    }
+    else if (strcmp(opt, options->OptionArray[9]) == 0)
+    {
+        options->counters = 1;
+    }
+    else if (strcmp(opt, options->OptionArray[10]) == 0)
+    {
+        strcpy(options->traceFile, arg);
+    }
+    else if (strcmp(opt, options->OptionArray[11]) == 0)
+    {
+        if (strcmp(arg, "auto") == 0)
+            options->bitUpdate = SOE_BITS_AUTO;
+        else if (strcmp(arg, "bitmasks8") == 0)
+            options->bitUpdate = SOE_BITMASKS8;
+        else if (strcmp(arg, "bitmasks32") == 0)
+            options->bitUpdate = SOE_BITMASKS32;
+        else if (strcmp(arg, "bitlogic8") == 0)
+            options->bitUpdate = SOE_BITLOGIC8;
+        else if (strcmp(arg, "bitlogic32") == 0)
+            options->bitUpdate = SOE_BITLOGIC32;
+        else
+        {
+            printf("unknown bit update method %s\n", arg);
+            exit(0);
+        }
+    }
+    else if (strcmp(opt, options->OptionArray[12]) == 0)
+    {
+        options->autotune = 1;
+        if (arg != NULL)
+        {
+            strcpy(options->tuneFile, arg);
+        }
+    }
     else
     {
         int i;
@@ -193,6 +259,14 @@ options_t* initOpt(void)
     options->outScreen = 0;
     options->blocksize = 32;
     options->sieve_primes_limit = 0;
+    options->reduce = 0;
+    options->outFormat = SOE_OUTPUT_TEXT;
+    strcpy(options->mapFile, "");
+    options->counters = 0;
+    strcpy(options->traceFile, "");
+    options->bitUpdate = SOE_BITS_AUTO;
+    options->autotune = 0;
+    strcpy(options->tuneFile, "");
     // ========================================================================
 
     return options;
@@ -40,7 +40,7 @@ extern "C" {
 #include <stdint.h>
 
 // the number of recognized command line options
-#define NUMOPTIONS 6
+#define NUMOPTIONS 13
 // maximum length of command line option strings
 #define MAXOPTIONLEN 20
 // maximum length of help string for each option
@@ -89,6 +89,14 @@ typedef struct
     int threads;
     int blocksize;
     uint32_t sieve_primes_limit;
+    int reduce;
+    int outFormat;
+    char mapFile[MAXARGLEN];
+    int counters;
+    char traceFile[MAXARGLEN];
+    int bitUpdate;
+    int autotune;
+    char tuneFile[MAXARGLEN];
     // ========================================================================
 
 } options_t;
@@ -88,6 +88,23 @@ int main(int argc, char** argv)
     }
 
     sdata = soe_init(options->verbosity, options->threads, options->blocksize);
+    if (strlen(options->mapFile) > 0)
+    {
+        sdata->map_path = options->mapFile;
+    }
+    sdata->perf_events = options->counters;
+    if (options->autotune)
+    {
+        soe_autotune(sdata, strlen(options->tuneFile) > 0 ? options->tuneFile : NULL);
+    }
+    if (options->bitUpdate != SOE_BITS_AUTO)
+    {
+        sdata->bit_update = options->bitUpdate;
+    }
+    if (strlen(options->traceFile) > 0)
+    {
+        sdata->trace_path = options->traceFile;
+    }
 
     gettimeofday(&tstart, NULL);
     
@@ -122,7 +139,7 @@ int main(int argc, char** argv)
                 sdata->sieve_p[i] = (uint32_t)primes[i];
             }
             sdata->num_sp = (uint32_t)num_found;
-            free(primes);
+            soe_free_primes(sdata, primes);
         }
 
         gmp_printf("starting sieve on bounds %Zd : %Zd\n", low, high);
@@ -145,6 +162,34 @@ int main(int argc, char** argv)
         mpz_clear(low);
         mpz_clear(high);
     }
+    else if (options->reduce)
+    {
+        soe_reduction_t red;
+        uint64_t sum[2];
+        mpz_t zsum;
+
+        sscanf(startStr, "%" PRIu64 "", &start);
+        sscanf(stopStr, "%" PRIu64 "", &stop);
+
+        printf("starting sieve on bounds %" PRIu64 " : %" PRIu64 "\n", start, stop);
+
+        num_found = soe_reduce(sdata, start, stop, &red);
+        primes = NULL;
+
+        mpz_init(zsum);
+        sum[0] = red.sum_lo;
+        sum[1] = red.sum_hi;
+        mpz_import(zsum, 2, -1, sizeof(uint64_t), 0, 0, sum);
+
+        printf("Num primes found: %" PRIu64 "\n", num_found);
+        gmp_printf("Sum of primes   : %Zd\n", zsum);
+        printf("Sum of squares  : %" PRIu64 " (mod 2^64)\n", red.sumsq);
+        printf("Xor of primes   : %016" PRIx64 "\n", red.xorsum);
+        gettimeofday(&tstop, NULL);
+        t = ytools_difftime(&tstart, &tstop);
+        printf("Elapsed time    : %1.6f seconds\n", t);
+        mpz_clear(zsum);
+    }
     else
     {
         sscanf(startStr, "%" PRIu64 "", &start);
@@ -153,7 +198,7 @@ int main(int argc, char** argv)
         printf("starting sieve on bounds %" PRIu64 " : %" PRIu64 "\n", start, stop);
 
         primes = soe_wrapper(sdata, start, stop, count, &num_found,
-            haveFile, options->outScreen);
+            haveFile ? options->outFormat : 0, options->outScreen);
 
         printf("Num primes found: %" PRIu64 "\n", num_found);
         gettimeofday(&tstop, NULL);
@@ -161,14 +206,19 @@ int main(int argc, char** argv)
         printf("Elapsed time    : %1.6f seconds\n", t);
     }
     
+    if (options->counters)
+    {
+        soe_print_stats(sdata);
+    }
+
+    if (primes != NULL)
+    {
+        soe_free_primes(sdata, primes);
+    }
     soe_finalize(sdata);
     free(sdata);
     free(startStr);
     free(stopStr);
-    if (primes != NULL)
-    {
-        align_free(primes);
-    }
 
     return 0;
 }
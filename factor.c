@@ -0,0 +1,737 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+#include "threadpool.h"
+
+// A segmented factoring sieve.  Unlike the prime sieve, which only
+// needs to know whether a prime hits a location, here we visit every
+// integer in [lowlimit, highlimit] and record which primes divide it.
+// Residue classes don't help here (the integers we skip in the prime
+// sieve are exactly the ones with the most factors), so the interval
+// is processed linearly in blocks.  Everything else follows the
+// line sieve: primes smaller than a block carry an offset from one
+// block to the next, and larger primes are distributed into per-block
+// buckets of (prime << 32 | location) hits that are unloaded as each
+// block is processed.  Threads work on independent chunks of blocks.
+//
+// Complete factorizations avoid dividing on every hit.  A prime hit
+// just multiplies the smooth part of the integer by p, and a second,
+// much sparser set of buckets holds the multiples of p^2; only those
+// integers are divided to find the full exponent.  Whatever is left
+// once the block is done (n / smooth part) is a single large prime.
+// Multiplicative functions use the same hits but update value arrays
+// in place instead of building factor lists.
+//
+// The same machinery also serves as a smoothness sieve: integers can
+// be taken relative to an mpz offset, the prime bound is arbitrary,
+// and each prime or prime-square hit adds floor(log2 p) to a byte per
+// integer.  Locations that accumulate enough bits are likely smooth.
+
+// number of blocks processed by a thread per dispatch
+#define FACTOR_CHUNK_BLOCKS 256
+
+typedef struct
+{
+	uint32_t *offsets;			// next hit of each small prime in the next block
+	uint64_t **sieve_buckets;	// per-block bucket of (prime << 32 | location) hits
+	uint32_t *bucket_hits;
+	uint32_t *bucket_alloc;
+	uint64_t **power_buckets;	// per-block bucket of (prime << 32 | location) p^2 hits
+	uint32_t *power_hits;
+	uint32_t *power_alloc;
+	uint64_t *smooth;			// product of the prime powers found so far
+	uint64_t chunk;				// the chunk currently assigned to this thread
+	soe_factor_block_t block;
+} factor_threaddata_t;
+
+typedef struct
+{
+	soe_staticdata_t *sdata;
+	factor_threaddata_t *fdata;
+	uint64_t lowlimit;
+	uint64_t highlimit;
+	uint32_t *offmod;			// offset mod p for each sieve prime, or NULL
+	uint64_t *offmodsq;			// offset mod p^2 for each sieve prime, or NULL
+	uint32_t num_sp;			// number of sieve primes <= the prime bound
+	uint32_t bucket_start_id;	// first sieve prime that is bucket sieved
+	uint32_t blocksize;			// integers per block, a power of 2
+	uint32_t blockbits;
+	uint64_t chunksize;
+	uint64_t num_chunks;
+	uint64_t next_chunk;
+	int mode;
+	soe_factor_fcn_t fcn;
+	void *user_data;
+} factor_userdata_t;
+
+typedef struct
+{
+	uint32_t *spf;
+	uint64_t lowlimit;
+} spf_userdata_t;
+
+static __inline void bucket_push(uint64_t **buckets, uint32_t *hits, uint32_t *alloc,
+	uint32_t bnum, uint64_t hit)
+{
+	if (hits[bnum] == alloc[bnum])
+	{
+		alloc[bnum] *= 2;
+		buckets[bnum] = (uint64_t *)xrealloc(buckets[bnum], alloc[bnum] * sizeof(uint64_t));
+	}
+	buckets[bnum][hits[bnum]++] = hit;
+	return;
+}
+
+static __inline void factor_hit(soe_factor_block_t *b, uint64_t *smooth,
+	uint32_t loc, uint32_t prime, int mode)
+{
+	if (mode == SOE_FACTOR_LOGP)
+	{
+		uint32_t v = b->logp[loc] + (uint32_t)(63 - _lead_zcnt64(prime));
+		b->logp[loc] = (uint8_t)((v > 255) ? 255 : v);
+		return;
+	}
+
+	// bucket hits arrive in no particular prime order, so keep the
+	// smallest prime seen and insert factors in ascending position.
+	if ((b->spf[loc] == 0) || (prime < b->spf[loc]))
+		b->spf[loc] = prime;
+
+	if (mode == SOE_FACTOR_FULL)
+	{
+		uint64_t *fp = b->factors + loc * SOE_MAX_FACTORS;
+		uint8_t *ep = b->exponents + loc * SOE_MAX_FACTORS;
+		uint32_t k = b->nfactors[loc]++;
+
+		smooth[loc] *= prime;
+		while ((k > 0) && (fp[k - 1] > prime))
+		{
+			fp[k] = fp[k - 1];
+			ep[k] = ep[k - 1];
+			k--;
+		}
+		fp[k] = prime;
+		ep[k] = 1;
+	}
+	else if (mode == SOE_FACTOR_MULT)
+	{
+		smooth[loc] *= prime;
+		b->mu[loc] = -b->mu[loc];
+		b->phi[loc] *= (prime - 1);
+		b->sigma0[loc] <<= 1;
+	}
+
+	return;
+}
+
+static __inline uint64_t first_hit(uint64_t chunk_lo, uint64_t m, uint64_t offmod)
+{
+	// distance from chunk_lo (plus an offset with residue offmod)
+	// to the next multiple of m
+	uint64_t r = chunk_lo % m;
+	uint64_t s = r + offmod;
+
+	// r + offmod may wrap when m is close to 2^64
+	if ((s < r) || (s >= m))
+		s -= m;
+
+	return (s > 0) ? m - s : 0;
+}
+
+static __inline void power_hit(soe_factor_block_t *b, uint64_t *smooth,
+	uint32_t loc, uint32_t prime, int mode)
+{
+	// p^2 divides this integer: find the full exponent.  The prime
+	// itself was already accounted for by factor_hit.
+	uint64_t n;
+	uint64_t pe = prime;
+	uint8_t e = 2;
+
+	// for smoothness the square is counted once more, and higher
+	// powers are ignored (the integers may be far above 64 bits).
+	if (mode == SOE_FACTOR_LOGP)
+	{
+		factor_hit(b, smooth, loc, prime, mode);
+		return;
+	}
+
+	n = (b->lowlimit + loc) / ((uint64_t)prime * prime);
+	while ((n % prime) == 0)
+	{
+		n /= prime;
+		pe *= prime;
+		e++;
+	}
+
+	// pe = p^(e-1)
+	smooth[loc] *= pe;
+
+	if (mode == SOE_FACTOR_FULL)
+	{
+		uint64_t *fp = b->factors + loc * SOE_MAX_FACTORS;
+		uint32_t k = 0;
+
+		while (fp[k] != prime)
+			k++;
+		b->exponents[loc * SOE_MAX_FACTORS + k] = e;
+	}
+	else
+	{
+		// factor_hit counted a single power of p
+		b->mu[loc] = 0;
+		b->phi[loc] *= pe;
+		b->sigma0[loc] = (b->sigma0[loc] >> 1) * (e + 1);
+	}
+
+	return;
+}
+
+static void factor_chunk(factor_userdata_t *udata, factor_threaddata_t *f, int tindex)
+{
+	soe_staticdata_t *sdata = udata->sdata;
+	soe_factor_block_t *b = &f->block;
+	uint32_t *sieve_p = sdata->sieve_p;
+	uint32_t blocksize = udata->blocksize;
+	uint32_t blockbits = udata->blockbits;
+	uint32_t bucket_start_id = udata->bucket_start_id;
+	uint64_t chunk_lo = udata->lowlimit + f->chunk * udata->chunksize;
+	uint64_t chunk_len = udata->highlimit - chunk_lo + 1;
+	uint32_t nblocks, bnum, i, j;
+	int mode = udata->mode;
+
+	if (chunk_len > udata->chunksize)
+		chunk_len = udata->chunksize;
+
+	nblocks = (uint32_t)((chunk_len + blocksize - 1) >> blockbits);
+
+	// starting offsets of the small primes in the first block
+	for (i = 0; i < bucket_start_id; i++)
+	{
+		f->offsets[i] = (uint32_t)first_hit(chunk_lo, sieve_p[i],
+			(udata->offmod != NULL) ? udata->offmod[i] : 0);
+	}
+
+	// fill the buckets with the first hit of every larger prime.
+	// later hits are added as the buckets are emptied.
+	for (bnum = 0; bnum < nblocks; bnum++)
+	{
+		f->bucket_hits[bnum] = 0;
+		f->power_hits[bnum] = 0;
+	}
+
+	for (i = bucket_start_id; i < udata->num_sp; i++)
+	{
+		uint32_t prime = sieve_p[i];
+		uint64_t loc = first_hit(chunk_lo, prime,
+			(udata->offmod != NULL) ? udata->offmod[i] : 0);
+
+		if (loc < chunk_len)
+		{
+			bucket_push(f->sieve_buckets, f->bucket_hits, f->bucket_alloc,
+				(uint32_t)(loc >> blockbits), ((uint64_t)prime << 32) | loc);
+		}
+	}
+
+	// and the first hit of every prime square
+	if (mode != SOE_FACTOR_SPF)
+	{
+		for (i = 0; i < udata->num_sp; i++)
+		{
+			uint32_t prime = sieve_p[i];
+			uint64_t loc = first_hit(chunk_lo, (uint64_t)prime * prime,
+				(udata->offmodsq != NULL) ? udata->offmodsq[i] : 0);
+
+			if (loc < chunk_len)
+			{
+				bucket_push(f->power_buckets, f->power_hits, f->power_alloc,
+					(uint32_t)(loc >> blockbits), ((uint64_t)prime << 32) | loc);
+			}
+		}
+	}
+
+	for (bnum = 0; bnum < nblocks; bnum++)
+	{
+		uint64_t blockstart = (uint64_t)bnum << blockbits;
+		uint32_t blen = (uint32_t)MIN((uint64_t)blocksize, chunk_len - blockstart);
+		uint64_t *bucket;
+
+		b->lowlimit = chunk_lo + blockstart;
+		b->num = blen;
+		b->tindex = tindex;
+
+		if (mode == SOE_FACTOR_LOGP)
+			memset(b->logp, 0, blen * sizeof(uint8_t));
+		else
+			memset(b->spf, 0, blen * sizeof(uint32_t));
+
+		if (mode == SOE_FACTOR_FULL)
+		{
+			memset(b->nfactors, 0, blen * sizeof(uint8_t));
+			for (j = 0; j < blen; j++)
+				f->smooth[j] = 1;
+		}
+		else if (mode == SOE_FACTOR_MULT)
+		{
+			for (j = 0; j < blen; j++)
+			{
+				f->smooth[j] = 1;
+				b->mu[j] = 1;
+				b->phi[j] = 1;
+				b->sigma0[j] = 1;
+			}
+		}
+
+		// small primes hit every block at least once
+		for (i = 0; i < bucket_start_id; i++)
+		{
+			uint32_t prime = sieve_p[i];
+
+			for (j = f->offsets[i]; j < blen; j += prime)
+				factor_hit(b, f->smooth, j, prime, mode);
+
+			f->offsets[i] = j - blen;
+		}
+
+		// empty this block's bucket, moving each prime on to the
+		// next block it hits
+		bucket = f->sieve_buckets[bnum];
+		for (i = 0; i < f->bucket_hits[bnum]; i++)
+		{
+			uint32_t prime = (uint32_t)(bucket[i] >> 32);
+			uint64_t loc = bucket[i] & 0xffffffff;
+
+			factor_hit(b, f->smooth, (uint32_t)(loc - blockstart), prime, mode);
+
+			loc += prime;
+			if (loc < chunk_len)
+			{
+				bucket_push(f->sieve_buckets, f->bucket_hits, f->bucket_alloc,
+					(uint32_t)(loc >> blockbits), ((uint64_t)prime << 32) | loc);
+			}
+		}
+
+		if (mode != SOE_FACTOR_SPF)
+		{
+			// fix up the exponents of the prime powers.  Squares smaller
+			// than a block hit the block again, so this bucket can grow
+			// (and move) while it is being emptied.
+			for (i = 0; i < f->power_hits[bnum]; i++)
+			{
+				uint64_t hit = f->power_buckets[bnum][i];
+				uint32_t prime = (uint32_t)(hit >> 32);
+				uint64_t loc = hit & 0xffffffff;
+
+				power_hit(b, f->smooth, (uint32_t)(loc - blockstart), prime, mode);
+
+				loc += (uint64_t)prime * prime;
+				if (loc < chunk_len)
+				{
+					bucket_push(f->power_buckets, f->power_hits, f->power_alloc,
+						(uint32_t)(loc >> blockbits), ((uint64_t)prime << 32) | loc);
+				}
+			}
+
+		}
+
+		// anything left over is a prime larger than sqrt(highlimit)
+		if (mode == SOE_FACTOR_FULL)
+		{
+			for (j = 0; j < blen; j++)
+			{
+				uint64_t n = b->lowlimit + j;
+
+				if (f->smooth[j] != n)
+				{
+					uint32_t k = b->nfactors[j]++;
+					b->factors[j * SOE_MAX_FACTORS + k] = n / f->smooth[j];
+					b->exponents[j * SOE_MAX_FACTORS + k] = 1;
+				}
+			}
+		}
+		else if (mode == SOE_FACTOR_MULT)
+		{
+			for (j = 0; j < blen; j++)
+			{
+				uint64_t n = b->lowlimit + j;
+
+				if (f->smooth[j] != n)
+				{
+					b->mu[j] = -b->mu[j];
+					b->phi[j] *= (n / f->smooth[j] - 1);
+					b->sigma0[j] <<= 1;
+				}
+			}
+		}
+
+		udata->fcn(b, udata->user_data);
+	}
+
+	return;
+}
+
+void factor_dispatch(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	factor_userdata_t *udata = (factor_userdata_t *)tdata->user_data;
+	factor_threaddata_t *f = &udata->fdata[tdata->tindex];
+
+	// if not done, dispatch another chunk of blocks
+	if (udata->next_chunk < udata->num_chunks)
+	{
+		f->chunk = udata->next_chunk;
+		tdata->work_fcn_id = 0;
+		udata->next_chunk++;
+	}
+	else
+	{
+		tdata->work_fcn_id = tdata->num_work_fcn;
+	}
+
+	return;
+}
+
+void factor_work_fcn(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	factor_userdata_t *udata = (factor_userdata_t *)tdata->user_data;
+
+	factor_chunk(udata, &udata->fdata[tdata->tindex], tdata->tindex);
+
+	return;
+}
+
+uint64_t mpz_mod_u64(mpz_t n, uint64_t m, mpz_t tmpz)
+{
+	// mpz_tdiv_ui only takes an unsigned long, which is 32 bits on windows
+	uint64_t r = 0;
+
+	if (sizeof(unsigned long) >= sizeof(uint64_t))
+		return mpz_tdiv_ui(n, (unsigned long)m);
+
+	mpz_import(tmpz, 1, -1, sizeof(uint64_t), 0, 0, &m);
+	mpz_tdiv_r(tmpz, n, tmpz);
+	mpz_export(&r, NULL, -1, sizeof(uint64_t), 0, 0, tmpz);
+	return r;
+}
+
+void factor_range(soe_staticdata_t* sdata, mpz_t *offset, uint64_t lowlimit, uint64_t highlimit,
+	uint64_t pbound, int mode, soe_factor_fcn_t fcn, void* user_data)
+{
+	// sieve the integers [offset + lowlimit, offset + highlimit] with
+	// all primes <= pbound.  offset may be NULL.  Block lowlimits passed
+	// to fcn are relative to the offset.
+	factor_userdata_t udata;
+	tpool_t *tpool_data;
+	uint32_t bucket_alloc;
+	uint32_t i, j;
+
+	// timing
+	double t;
+	struct timeval tstart, tstop;
+
+	if (sdata->VFLAG > 1)
+	{
+		gettimeofday(&tstart, NULL);
+	}
+
+	extend_sieve_primes(sdata, pbound * pbound);
+
+	udata.sdata = sdata;
+	udata.lowlimit = lowlimit;
+	udata.highlimit = highlimit;
+	udata.mode = mode;
+	udata.fcn = fcn;
+	udata.user_data = user_data;
+
+	// use blocks whose smooth-part array fills the sieve blocksize
+	udata.blockbits = 0;
+	while ((8U << (udata.blockbits + 1)) <= sdata->SOEBLOCKSIZE)
+		udata.blockbits++;
+	udata.blocksize = 1U << udata.blockbits;
+	udata.chunksize = (uint64_t)udata.blocksize * FACTOR_CHUNK_BLOCKS;
+	udata.num_chunks = (highlimit - lowlimit) / udata.chunksize + 1;
+	udata.next_chunk = 0;
+
+	// the primes we need, and which of them will be bucket sieved
+	udata.num_sp = 0;
+	udata.bucket_start_id = 0;
+	while ((udata.num_sp < sdata->num_sp) && (sdata->sieve_p[udata.num_sp] <= pbound))
+	{
+		if (sdata->sieve_p[udata.num_sp] < udata.blocksize)
+			udata.bucket_start_id++;
+		udata.num_sp++;
+	}
+
+	// residues of the offset, so that each chunk can find its
+	// first hits with 64-bit arithmetic
+	udata.offmod = NULL;
+	udata.offmodsq = NULL;
+	if (offset != NULL)
+	{
+		mpz_t tmpz;
+
+		mpz_init(tmpz);
+		udata.offmod = (uint32_t *)xmalloc(udata.num_sp * sizeof(uint32_t));
+		remtree_mod_primes(sdata, *offset, sdata->sieve_p, (uint32_t)udata.num_sp, udata.offmod);
+
+		if (mode != SOE_FACTOR_SPF)
+		{
+			udata.offmodsq = (uint64_t *)xmalloc(udata.num_sp * sizeof(uint64_t));
+			for (i = 0; i < udata.num_sp; i++)
+				udata.offmodsq[i] = mpz_mod_u64(*offset,
+					(uint64_t)sdata->sieve_p[i] * sdata->sieve_p[i], tmpz);
+		}
+		mpz_clear(tmpz);
+	}
+
+	// expected number of large prime hits per block, with some margin.
+	// buckets grow if needed.
+	if (pbound > udata.blocksize)
+	{
+		bucket_alloc = (uint32_t)(1.25 * udata.blocksize *
+			(log(log((double)pbound)) - log(log((double)udata.blocksize)))) + 256;
+	}
+	else
+	{
+		bucket_alloc = 256;
+	}
+
+	if (sdata->VFLAG > 0)
+	{
+		printf("factoring range %" PRIu64 " : %" PRIu64 " using %u primes "
+			"(%u bucket sieved) in %" PRIu64 " chunks of %" PRIu64 " integers\n",
+			lowlimit, highlimit, udata.num_sp, udata.num_sp - udata.bucket_start_id,
+			udata.num_chunks, udata.chunksize);
+	}
+
+	udata.fdata = (factor_threaddata_t *)malloc(sdata->THREADS * sizeof(factor_threaddata_t));
+	for (i = 0; i < sdata->THREADS; i++)
+	{
+		factor_threaddata_t *f = udata.fdata + i;
+		soe_factor_block_t *b = &f->block;
+
+		f->offsets = (uint32_t *)xmalloc_align((udata.bucket_start_id + 1) * sizeof(uint32_t));
+		f->sieve_buckets = (uint64_t **)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint64_t *));
+		f->bucket_hits = (uint32_t *)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint32_t));
+		f->bucket_alloc = (uint32_t *)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint32_t));
+		f->power_buckets = (uint64_t **)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint64_t *));
+		f->power_hits = (uint32_t *)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint32_t));
+		f->power_alloc = (uint32_t *)malloc(FACTOR_CHUNK_BLOCKS * sizeof(uint32_t));
+		for (j = 0; j < FACTOR_CHUNK_BLOCKS; j++)
+		{
+			f->sieve_buckets[j] = (uint64_t *)xmalloc(bucket_alloc * sizeof(uint64_t));
+			f->bucket_alloc[j] = bucket_alloc;
+
+			// sum of 1/p^2 over all primes is about 0.45
+			f->power_buckets[j] = (mode != SOE_FACTOR_SPF) ?
+				(uint64_t *)xmalloc((udata.blocksize / 2) * sizeof(uint64_t)) : NULL;
+			f->power_alloc[j] = udata.blocksize / 2;
+		}
+
+		b->spf = (mode != SOE_FACTOR_LOGP) ?
+			(uint32_t *)xmalloc_align(udata.blocksize * sizeof(uint32_t)) : NULL;
+		f->smooth = NULL;
+		b->nfactors = NULL;
+		b->factors = NULL;
+		b->exponents = NULL;
+		b->mu = NULL;
+		b->phi = NULL;
+		b->sigma0 = NULL;
+		b->logp = NULL;
+
+		if ((mode == SOE_FACTOR_FULL) || (mode == SOE_FACTOR_MULT))
+		{
+			f->smooth = (uint64_t *)xmalloc_align(udata.blocksize * sizeof(uint64_t));
+		}
+
+		if (mode == SOE_FACTOR_FULL)
+		{
+			b->nfactors = (uint8_t *)xmalloc_align(udata.blocksize * sizeof(uint8_t));
+			b->factors = (uint64_t *)xmalloc_align(udata.blocksize *
+				SOE_MAX_FACTORS * sizeof(uint64_t));
+			b->exponents = (uint8_t *)xmalloc_align(udata.blocksize *
+				SOE_MAX_FACTORS * sizeof(uint8_t));
+		}
+		else if (mode == SOE_FACTOR_MULT)
+		{
+			b->mu = (int8_t *)xmalloc_align(udata.blocksize * sizeof(int8_t));
+			b->phi = (uint64_t *)xmalloc_align(udata.blocksize * sizeof(uint64_t));
+			b->sigma0 = (uint32_t *)xmalloc_align(udata.blocksize * sizeof(uint32_t));
+		}
+		else if (mode == SOE_FACTOR_LOGP)
+		{
+			b->logp = (uint8_t *)xmalloc_align(udata.blocksize * sizeof(uint8_t));
+		}
+	}
+
+	tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
+		&factor_dispatch, &udata);
+
+	if (sdata->THREADS == 1)
+	{
+		for (; udata.next_chunk < udata.num_chunks; udata.next_chunk++)
+		{
+			udata.fdata[0].chunk = udata.next_chunk;
+			factor_work_fcn(tpool_data);
+		}
+	}
+	else
+	{
+		tpool_add_work_fcn(tpool_data, &factor_work_fcn);
+		tpool_go(tpool_data);
+	}
+
+	free(tpool_data);
+
+	for (i = 0; i < sdata->THREADS; i++)
+	{
+		factor_threaddata_t *f = udata.fdata + i;
+		soe_factor_block_t *b = &f->block;
+
+		for (j = 0; j < FACTOR_CHUNK_BLOCKS; j++)
+		{
+			free(f->sieve_buckets[j]);
+			free(f->power_buckets[j]);
+		}
+		free(f->sieve_buckets);
+		free(f->bucket_hits);
+		free(f->bucket_alloc);
+		free(f->power_buckets);
+		free(f->power_hits);
+		free(f->power_alloc);
+		align_free(f->offsets);
+		if (b->spf != NULL)
+		{
+			align_free(b->spf);
+		}
+		if (f->smooth != NULL)
+		{
+			align_free(f->smooth);
+		}
+		if (mode == SOE_FACTOR_FULL)
+		{
+			align_free(b->nfactors);
+			align_free(b->factors);
+			align_free(b->exponents);
+		}
+		else if (mode == SOE_FACTOR_MULT)
+		{
+			align_free(b->mu);
+			align_free(b->phi);
+			align_free(b->sigma0);
+		}
+		else if (mode == SOE_FACTOR_LOGP)
+		{
+			align_free(b->logp);
+		}
+	}
+	free(udata.fdata);
+	if (udata.offmod != NULL)
+		free(udata.offmod);
+	if (udata.offmodsq != NULL)
+		free(udata.offmodsq);
+
+	if (sdata->VFLAG > 1)
+	{
+		gettimeofday(&tstop, NULL);
+		t = ytools_difftime(&tstart, &tstop);
+		printf("factor sieve took %1.6f seconds\n", t);
+	}
+
+	return;
+}
+
+void soe_factor_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+	int mode, soe_factor_fcn_t fcn, void* user_data)
+{
+	uint64_t pbound;
+
+	if (highlimit < lowlimit)
+	{
+		printf("error: lowlimit must be less than highlimit\n");
+		return;
+	}
+
+	if (highlimit > 4000000000000000000ULL)
+	{
+		printf("input too large\n");
+		return;
+	}
+
+	// 0 and 1 have no prime factors
+	if (lowlimit < 2)
+		lowlimit = 2;
+
+	if (highlimit < lowlimit)
+		return;
+
+	// every prime factor but one of each integer is <= sqrt(highlimit)
+	pbound = (uint64_t)sqrt((double)highlimit);
+	while ((pbound + 1) * (pbound + 1) <= highlimit)
+		pbound++;
+	while (pbound * pbound > highlimit)
+		pbound--;
+
+	factor_range(sdata, NULL, lowlimit, highlimit, pbound, mode, fcn, user_data);
+
+	return;
+}
+
+static void spf_copy_fcn(soe_factor_block_t *block, void *user_data)
+{
+	spf_userdata_t *u = (spf_userdata_t *)user_data;
+
+	memcpy(u->spf + (block->lowlimit - u->lowlimit), block->spf,
+		block->num * sizeof(uint32_t));
+
+	return;
+}
+
+uint32_t* soe_spf_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit)
+{
+	// public interface to compute the smallest prime factor of every
+	// integer in the range.  Element i of the returned array belongs to
+	// lowlimit + i, and is 0 when that integer has no prime factor
+	// <= sqrt(highlimit) (it is either prime or less than 2).
+	spf_userdata_t u;
+
+	if (highlimit < lowlimit)
+	{
+		printf("error: lowlimit must be less than highlimit\n");
+		return NULL;
+	}
+
+	u.lowlimit = lowlimit;
+	u.spf = (uint32_t *)xcalloc(highlimit - lowlimit + 1, sizeof(uint32_t));
+
+	soe_factor_range(sdata, lowlimit, highlimit, SOE_FACTOR_SPF, &spf_copy_fcn, &u);
+
+	return u.spf;
+}
@@ -35,21 +35,50 @@ SOFTWARE.
     nptr[bnum]++;
 
 // addressing words vs. bytes and methods for setting bits
-// have different sweet spots for different compilers...
+// have different sweet spots for different compilers and cpus...
 // these were tested with 10^11 on AVX512 5122 gold cpu
 // using the avx2_32k linesieve and avx2 presieving.
+// All of them are built into the avx2_32k linesieve; this is
+// the one used for SOE_BITS_AUTO (see enum soe_bit_update).
 #ifdef _INTEL_COMPILER
-#define BITLOGIC32  /* 15.68 */
-//#define BITMASKS8  
+#define SIEVE_LINE_BITS_DEFAULT sieve_line_avx2_32k_bitlogic32  /* 15.68 */
+#define LINESIEVE_INLINE __forceinline
 #elif defined(_MSC_VER)
-#define BITMASKS8  /* 17.56 */
+#define SIEVE_LINE_BITS_DEFAULT sieve_line_avx2_32k_bitmasks8  /* 17.56 */
+#define LINESIEVE_INLINE __forceinline
 #else // gcc, mingw64-gcc
-//#define BITMASKS8  /* 17.91 */
-#define BITMASKS32 /* 16.69 */
-//#define BITLOGIC8  /* 19.02 */
-//#define BITLOGIC32   /* 17.20 */
+// BITMASKS8 17.91, BITLOGIC8 19.02, BITLOGIC32 17.20
+#define SIEVE_LINE_BITS_DEFAULT sieve_line_avx2_32k_bitmasks32 /* 16.69 */
+#define LINESIEVE_INLINE __inline __attribute__((always_inline))
 #endif
 
+// clear flag k of a block.  'bits' is a constant in each kernel
+// that uses this, so only one of the cases is compiled in.
+static LINESIEVE_INLINE void clear_flag(uint8_t* flagblock, uint8_t* masks,
+    uint32_t* masks32, uint64_t k, const int bits)
+{
+    uint32_t* flagblock32 = (uint32_t*)flagblock;
+
+    switch (bits)
+    {
+    case SOE_BITMASKS8:
+        flagblock[k >> 3] &= masks[k & 7];
+        break;
+    case SOE_BITMASKS32:
+        flagblock32[k >> 5] &= masks32[k & 31];
+        break;
+    case SOE_BITLOGIC8:
+        flagblock[k >> 3] &= ~(1 << (k & 7));
+        break;
+    default:
+        flagblock32[k >> 5] &= ~(1 << (k & 31));
+        break;
+    }
+    return;
+}
+
+#define CLEAR_FLAG(x) clear_flag(flagblock, masks, masks32, (x), bits)
+
 // sieve all blocks of a line, i.e., a row of the sieve area.
 void sieve_line(thread_soedata_t *thread_data)
 {
@@ -76,6 +105,7 @@ void sieve_line(thread_soedata_t *thread_data)
 	uint64_t i,j,k;
 	uint32_t prime;
     int stopid;
+    soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -87,6 +117,7 @@ void sieve_line(thread_soedata_t *thread_data)
 
     // one is not a prime
     flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
         if (sdata->num_bitmap_primes == 0)
@@ -112,6 +143,7 @@ void sieve_line(thread_soedata_t *thread_data)
 		
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
         // start where presieving left off, which is different for various cpus.
         j = sdata->presieve_max_id;
@@ -120,7 +152,7 @@ void sieve_line(thread_soedata_t *thread_data)
         // at first glance it looks like AVX2 operations to compute the indices
         // might be helpful, but since we can't address memory with SIMD registers
         // it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 1901); //22998); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); //22998); // 1901);
 		for (;j<stopid;j++)
 		{
 			uint32_t tmpP;
@@ -196,7 +228,7 @@ void sieve_line(thread_soedata_t *thread_data)
 		}
 
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
-		stopid = MIN(ddata->pbounds[i], 3513); //43388); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); //43388); // 3513);
         for (; j<stopid; j++)
         {
             uint32_t tmpP;
@@ -234,7 +266,7 @@ void sieve_line(thread_soedata_t *thread_data)
         }
 
         // unroll the loop: all primes less than this max hit the interval at least 4 times
-		stopid = MIN(ddata->pbounds[i], 6543); //82023); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); //82023); // 
         for (; j<stopid; j++)
         {
             uint32_t tmpP;
@@ -298,6 +330,8 @@ void sieve_line(thread_soedata_t *thread_data)
             ddata->offsets[j] = (uint32_t)(k - FLAGSIZE);
         }
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		// finally, fill any primes in this block's bucket
 		if (ddata->bucket_depth > 0)
 		{		
@@ -398,6 +432,8 @@ void sieve_line(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < FLAGSIZE; j++)
@@ -490,6 +526,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -500,6 +537,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 	get_offsets(thread_data);
 
     flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
         uint32_t* flagblock32 = (uint32_t*)flagblock;
@@ -531,6 +569,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// start where presieving left off, which is different for various cpus.
 		j = sdata->presieve_max_id;
@@ -541,7 +580,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 1901); //22998); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); //22998); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -619,7 +658,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 262144 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 3513); //43388); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); //43388); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -659,7 +698,7 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 262144 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 6543); //82023); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); //82023); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -723,6 +762,8 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 			ddata->offsets[j] = (uint32_t)(k - 262144);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m512i vt1, vt3;      // temp vectors
@@ -846,6 +887,8 @@ void sieve_line_avx512_32k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 262144; j++)
@@ -886,6 +929,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -896,6 +940,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 	get_offsets(thread_data);
 
 	flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
         uint32_t* flagblock32 = (uint32_t*)flagblock;
@@ -913,6 +958,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// one is not a prime
 		if (sdata->sieve_range == 0)
@@ -937,7 +983,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 6540); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1015,7 +1061,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 1048576 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 12249); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1055,7 +1101,7 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 1048576 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 22998); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1119,6 +1165,8 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 			ddata->offsets[j] = (uint32_t)(k - 1048576);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m512i vt1, vt3;      // temp vectors
@@ -1242,6 +1290,8 @@ void sieve_line_avx512_128k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 1048576; j++)
@@ -1282,6 +1332,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -1292,6 +1343,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 	get_offsets(thread_data);
 
 	flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
         uint32_t* flagblock32 = (uint32_t*)flagblock;
@@ -1309,6 +1361,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// one is not a prime
 		if (sdata->sieve_range == 0)
@@ -1333,7 +1386,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 12249); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1411,7 +1464,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 2097152 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 22998); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1451,7 +1504,7 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 2097152 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 43388); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1515,6 +1568,8 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 			ddata->offsets[j] = (uint32_t)(k - 2097152);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m512i vt1, vt3;      // temp vectors
@@ -1638,6 +1693,8 @@ void sieve_line_avx512_256k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 2097152; j++)
@@ -1678,6 +1735,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -1688,6 +1746,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 	get_offsets(thread_data);
 
 	flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
         uint32_t* flagblock32 = (uint32_t*)flagblock;
@@ -1705,6 +1764,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// one is not a prime
 		if (sdata->sieve_range == 0)
@@ -1729,7 +1789,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 22998); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1807,7 +1867,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 4194304 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 43388); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1847,7 +1907,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 4194304 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 82023); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -1911,6 +1971,8 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 			ddata->offsets[j] = (uint32_t)(k - 4194304);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m512i vt1, vt3;      // temp vectors
@@ -2034,6 +2096,8 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 4194304; j++)
@@ -2055,7 +2119,7 @@ void sieve_line_avx512_512k(thread_soedata_t *thread_data)
 #endif
 
 #if defined(USE_AVX2)
-void sieve_line_avx2_32k(thread_soedata_t *thread_data)
+static LINESIEVE_INLINE void sieve_line_avx2_32k_bits(thread_soedata_t *thread_data, const int bits)
 {
 	// extract stuff from the thread data structure
 	soe_dynamicdata_t *ddata = &thread_data->ddata;
@@ -2064,9 +2128,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 	uint8_t *line = thread_data->sdata.lines[current_line];
     uint8_t* masks = sdata->masks;
     uint8_t* nmasks = sdata->nmasks;
-#ifdef BITMASKS32
     uint32_t* masks32 = sdata->masks32;
-#endif
 
 	// stuff for bucket sieving
 	uint64_t *bptr;
@@ -2080,6 +2142,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -2094,6 +2157,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
     //         sdata->root[5], ddata->offsets[5]);
 
 	flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
 		uint32_t *flagblock32 = (uint32_t *)flagblock;
@@ -2110,6 +2174,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// one is not a prime
 		if (sdata->sieve_range == 0)
@@ -2138,7 +2203,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 1901); //22998); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); //22998); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2208,15 +2273,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 
             for (; k < 262144; k += prime)
             {
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-#endif
+                CLEAR_FLAG(k);
             }
 
 			ddata->offsets[j] = k - 262144;
@@ -2226,7 +2283,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 262144 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 3513); //43388); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); //43388); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2244,64 +2301,21 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 
 			while (k < stop)
 			{
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-                flagblock[(k + p1) >> 3] &= masks[(k + p1) & 7];
-                flagblock[(k + p2) >> 3] &= masks[(k + p2) & 7];
-                flagblock[(k + p3) >> 3] &= masks[(k + p3) & 7];
+                CLEAR_FLAG(k);
+                CLEAR_FLAG(k + p1);
+                CLEAR_FLAG(k + p2);
+                CLEAR_FLAG(k + p3);
                 k += (prime << 2);
-                flagblock[k >> 3] &= masks[k & 7];
-                flagblock[(k + p1) >> 3] &= masks[(k + p1) & 7];
-                flagblock[(k + p2) >> 3] &= masks[(k + p2) & 7];
-                flagblock[(k + p3) >> 3] &= masks[(k + p3) & 7];
+                CLEAR_FLAG(k);
+                CLEAR_FLAG(k + p1);
+                CLEAR_FLAG(k + p2);
+                CLEAR_FLAG(k + p3);
                 k += (prime << 2);
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-                flagblock32[(k + p1) >> 5] &= masks32[(k + p1) & 31];
-                flagblock32[(k + p2) >> 5] &= masks32[(k + p2) & 31];
-                flagblock32[(k + p3) >> 5] &= masks32[(k + p3) & 31];
-                k += (prime << 2);
-                flagblock32[k >> 5] &= masks32[k & 31];
-                flagblock32[(k + p1) >> 5] &= masks32[(k + p1) & 31];
-                flagblock32[(k + p2) >> 5] &= masks32[(k + p2) & 31];
-                flagblock32[(k + p3) >> 5] &= masks32[(k + p3) & 31];
-                k += (prime << 2);
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-                flagblock[(k + p1) >> 3] &= ~(1 << ((k + p1) & 7));
-                flagblock[(k + p2) >> 3] &= ~(1 << ((k + p2) & 7));
-                flagblock[(k + p3) >> 3] &= ~(1 << ((k + p3) & 7));
-                k += (prime << 2);
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-                flagblock[(k + p1) >> 3] &= ~(1 << ((k + p1) & 7));
-                flagblock[(k + p2) >> 3] &= ~(1 << ((k + p2) & 7));
-                flagblock[(k + p3) >> 3] &= ~(1 << ((k + p3) & 7));
-                k += (prime << 2);
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-                flagblock32[(k + p1) >> 5] &= ~(1 << ((k + p1) & 31));
-                flagblock32[(k + p2) >> 5] &= ~(1 << ((k + p2) & 31));
-                flagblock32[(k + p3) >> 5] &= ~(1 << ((k + p3) & 31));
-                k += (prime << 2);
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-                flagblock32[(k + p1) >> 5] &= ~(1 << ((k + p1) & 31));
-                flagblock32[(k + p2) >> 5] &= ~(1 << ((k + p2) & 31));
-                flagblock32[(k + p3) >> 5] &= ~(1 << ((k + p3) & 31));
-                k += (prime << 2);
-#endif
 			}
 
             for (; k < 262144; k += prime)
             {
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-#endif
+                CLEAR_FLAG(k);
             }
 
 			ddata->offsets[j] = (uint32_t)(k - 262144);
@@ -2311,7 +2325,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 262144 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 6543); //82023); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); //82023); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2329,44 +2343,16 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 			while (k < stop)
 			{
 
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-                flagblock[(k + p1) >> 3] &= masks[(k + p1) & 7];
-                flagblock[(k + p2) >> 3] &= masks[(k + p2) & 7];
-                flagblock[(k + p3) >> 3] &= masks[(k + p3) & 7];
-                k += (prime << 2);
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-                flagblock32[(k + p1) >> 5] &= masks32[(k + p1) & 31];
-                flagblock32[(k + p2) >> 5] &= masks32[(k + p2) & 31];
-                flagblock32[(k + p3) >> 5] &= masks32[(k + p3) & 31];
+                CLEAR_FLAG(k);
+                CLEAR_FLAG(k + p1);
+                CLEAR_FLAG(k + p2);
+                CLEAR_FLAG(k + p3);
                 k += (prime << 2);
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-                flagblock[(k + p1) >> 3] &= ~(1 << ((k + p1) & 7));
-                flagblock[(k + p2) >> 3] &= ~(1 << ((k + p2) & 7));
-                flagblock[(k + p3) >> 3] &= ~(1 << ((k + p3) & 7));
-                k += (prime << 2);
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-                flagblock32[(k + p1) >> 5] &= ~(1 << ((k + p1) & 31));
-                flagblock32[(k + p2) >> 5] &= ~(1 << ((k + p2) & 31));
-                flagblock32[(k + p3) >> 5] &= ~(1 << ((k + p3) & 31));
-                k += (prime << 2);
-#endif
 			}
 
             for (; k < 262144; k += prime)
             {
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-#endif
+                CLEAR_FLAG(k);
             }
 
 			ddata->offsets[j] = (uint32_t)(k - 262144);
@@ -2386,15 +2372,7 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 
             for (k = ddata->offsets[j]; k < 262144; k += prime)
             {
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-#endif
+                CLEAR_FLAG(k);
             }
 
             ddata->offsets[j] = (uint32_t)(k - 262144);
@@ -2405,20 +2383,14 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 			k = ddata->offsets[j];
 			if (ddata->offsets[j] < 262144)
 			{
-#ifdef BITMASKS8
-                flagblock[k >> 3] &= masks[k & 7];
-#elif defined(BITMASKS32)
-                flagblock32[k >> 5] &= masks32[k & 31];
-#elif defined(BITLOGIC8)
-                flagblock[k >> 3] &= ~(1 << (k & 7));
-#else
-                flagblock32[k >> 5] &= ~(1 << (k & 31));
-#endif
+                CLEAR_FLAG(k);
 				k += sdata->sieve_p[j];
 			}
 			ddata->offsets[j] = (uint32_t)(k - 262144);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m256i vt1, vt2, vt3, vt4;      // temp vectors
@@ -2556,6 +2528,8 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 262144; j++)
@@ -2626,6 +2600,38 @@ void sieve_line_avx2_32k(thread_soedata_t *thread_data)
 	return;
 }
 
+void sieve_line_avx2_32k_bitmasks8(thread_soedata_t *thread_data)
+{
+	sieve_line_avx2_32k_bits(thread_data, SOE_BITMASKS8);
+	return;
+}
+
+void sieve_line_avx2_32k_bitmasks32(thread_soedata_t *thread_data)
+{
+	sieve_line_avx2_32k_bits(thread_data, SOE_BITMASKS32);
+	return;
+}
+
+void sieve_line_avx2_32k_bitlogic8(thread_soedata_t *thread_data)
+{
+	sieve_line_avx2_32k_bits(thread_data, SOE_BITLOGIC8);
+	return;
+}
+
+void sieve_line_avx2_32k_bitlogic32(thread_soedata_t *thread_data)
+{
+	sieve_line_avx2_32k_bits(thread_data, SOE_BITLOGIC32);
+	return;
+}
+
+// indexed by enum soe_bit_update
+void (*sieve_line_avx2_32k_ptrs[SOE_NUM_BIT_UPDATES])(thread_soedata_t*) = {
+	&SIEVE_LINE_BITS_DEFAULT,
+	&sieve_line_avx2_32k_bitmasks8,
+	&sieve_line_avx2_32k_bitmasks32,
+	&sieve_line_avx2_32k_bitlogic8,
+	&sieve_line_avx2_32k_bitlogic32 };
+
 void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 {
 	// extract stuff from the thread data structure
@@ -2648,6 +2654,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 	uint32_t prime;
 	//uint32_t maxP;
 	int stopid;
+	soe_phase_t mark;
 
 	ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
 	ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -2658,6 +2665,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 	get_offsets(thread_data);
 
 	flagblock = line;
+	soe_clock(&mark, ddata);
 	for (i = 0; i < sdata->blocks; i++)
 	{
 		uint32_t *flagblock32 = (uint32_t *)flagblock;
@@ -2674,6 +2682,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 
 		// smallest primes use special methods
 		pre_sieve_ptr(ddata, sdata, flagblock);
+		soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
 		// one is not a prime
 		if (sdata->sieve_range == 0)
@@ -2698,7 +2707,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 		// at first glance it looks like AVX2 operations to compute the indices
 		// might be helpful, but since we can't address memory with SIMD registers
 		// it actually isn't.  Things might be different with a scatter operation.
-		stopid = MIN(ddata->pbounds[i], 1901); //22998); // 1901);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); //22998); // 1901);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2776,7 +2785,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 8 times
 		//maxP = 1048576 >> 3;
 
-		stopid = MIN(ddata->pbounds[i], 3513); //43388); // 3513);
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); //43388); // 3513);
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2816,7 +2825,7 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 		// unroll the loop: all primes less than this max hit the interval at least 4 times
 		//maxP = 1048576 >> 2;
 
-		stopid = MIN(ddata->pbounds[i], 6543); //82023); // 
+		stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); //82023); // 
 		for (; j < stopid; j++)
 		{
 			uint32_t tmpP;
@@ -2880,6 +2889,8 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 			ddata->offsets[j] = (uint32_t)(k - 1048576);
 		}
 
+		soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
 		if (ddata->bucket_depth > 0)
 		{
 			__m256i vt1, vt2, vt3, vt4;      // temp vectors
@@ -3017,6 +3028,8 @@ void sieve_line_avx2_128k(thread_soedata_t *thread_data)
 
 		}
 
+		soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
 		if (i == 0)
 		{
 			for (j = 0; j < 1048576; j++)
@@ -3057,6 +3070,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
     uint32_t prime;
     //uint32_t maxP;
     int stopid;
+    soe_phase_t mark;
 
     ddata->lblk_b = sdata->lowlimit + sdata->rclass[current_line];
     ddata->ublk_b = sdata->blk_r + ddata->lblk_b - sdata->prodN;
@@ -3067,6 +3081,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
     get_offsets(thread_data);
 
     flagblock = line;
+    soe_clock(&mark, ddata);
     for (i = 0; i < sdata->blocks; i++)
     {
         uint32_t* flagblock32 = (uint32_t*)flagblock;
@@ -3083,6 +3098,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
 
         // smallest primes use special methods
         pre_sieve_ptr(ddata, sdata, flagblock);
+        soe_phase_lap(&ddata->stats.presieve, &mark, ddata);
 
         // one is not a prime
         if (sdata->sieve_range == 0)
@@ -3107,7 +3123,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
         // at first glance it looks like AVX2 operations to compute the indices
         // might be helpful, but since we can't address memory with SIMD registers
         // it actually isn't.  Things might be different with a scatter operation.
-        stopid = MIN(ddata->pbounds[i], 1901); //22998); // 1901);
+        stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[0]); //22998); // 1901);
         for (; j < stopid; j++)
         {
             uint32_t tmpP;
@@ -3185,7 +3201,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
         // unroll the loop: all primes less than this max hit the interval at least 8 times
         //maxP = 4194304 >> 3;
 
-        stopid = MIN(ddata->pbounds[i], 3513); //43388); // 3513);
+        stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[1]); //43388); // 3513);
         for (; j < stopid; j++)
         {
             uint32_t tmpP;
@@ -3225,7 +3241,7 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
         // unroll the loop: all primes less than this max hit the interval at least 4 times
         //maxP = 4194304 >> 2;
 
-        stopid = MIN(ddata->pbounds[i], 6543); //82023); // 
+        stopid = MIN(ddata->pbounds[i], sdata->unroll_stop[2]); //82023); // 
         for (; j < stopid; j++)
         {
             uint32_t tmpP;
@@ -3289,6 +3305,8 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
             ddata->offsets[j] = (uint32_t)(k - 4194304);
         }
 
+        soe_phase_lap(&ddata->stats.medium_sieve, &mark, ddata);
+
         if (ddata->bucket_depth > 0)
         {
             __m256i vt1, vt2, vt3, vt4;      // temp vectors
@@ -3426,6 +3444,8 @@ void sieve_line_avx2_512k(thread_soedata_t* thread_data)
 
         }
 
+        soe_phase_lap(&ddata->stats.bucket_unload, &mark, ddata);
+
         if (i == 0)
         {
             for (j = 0; j < 4194304; j++)
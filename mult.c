@@ -0,0 +1,148 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+// Multiplicative functions over a range of integers.  The factoring
+// sieve in factor.c does the work in SOE_FACTOR_MULT mode: each
+// prime hit rescales the mobius, totient and divisor-count values of
+// the integers it divides, prime powers are fixed up from a sparse
+// set of p^2 hits, and the one remaining large prime of each integer
+// is applied when the block is finished.  The routines here add the
+// value at n = 1 and the usual summatory functions on top.
+
+typedef struct
+{
+	int64_t *mertens;			// per-thread sums of mu
+	uint64_t *sqfree;			// per-thread squarefree counts
+} mult_sum_t;
+
+void soe_mult_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+	soe_factor_fcn_t fcn, void* user_data)
+{
+	// compute mu, phi and sigma0 for every integer in [lowlimit, highlimit]
+	// (0 has none and is skipped).
+	// fcn is called once per block with the value arrays for that block,
+	// possibly from several threads at once and in no particular order.
+	if (highlimit < lowlimit)
+	{
+		printf("error: lowlimit must be less than highlimit\n");
+		return;
+	}
+
+	// the factoring sieve starts at 2; every function here is 1 at n = 1.
+	if ((lowlimit <= 1) && (highlimit >= 1))
+	{
+		soe_factor_block_t b;
+		uint32_t spf = 0;
+		int8_t mu = 1;
+		uint64_t phi = 1;
+		uint32_t sigma0 = 1;
+
+		memset(&b, 0, sizeof(soe_factor_block_t));
+		b.lowlimit = 1;
+		b.num = 1;
+		b.tindex = 0;
+		b.spf = &spf;
+		b.mu = &mu;
+		b.phi = &phi;
+		b.sigma0 = &sigma0;
+		fcn(&b, user_data);
+	}
+
+	if (highlimit >= 2)
+	{
+		soe_factor_range(sdata, lowlimit, highlimit, SOE_FACTOR_MULT, fcn, user_data);
+	}
+
+	return;
+}
+
+static void mult_sum_fcn(soe_factor_block_t *b, void *vptr)
+{
+	mult_sum_t *s = (mult_sum_t *)vptr;
+	int64_t msum = 0;
+	uint64_t qsum = 0;
+	uint32_t i;
+
+	for (i = 0; i < b->num; i++)
+	{
+		msum += b->mu[i];
+		qsum += (b->mu[i] != 0);
+	}
+
+	s->mertens[b->tindex] += msum;
+	s->sqfree[b->tindex] += qsum;
+
+	return;
+}
+
+static void mult_sums(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+	int64_t *mertens, uint64_t *sqfree)
+{
+	mult_sum_t s;
+	int i;
+
+	s.mertens = (int64_t *)xcalloc(sdata->THREADS, sizeof(int64_t));
+	s.sqfree = (uint64_t *)xcalloc(sdata->THREADS, sizeof(uint64_t));
+
+	soe_mult_range(sdata, lowlimit, highlimit, &mult_sum_fcn, &s);
+
+	*mertens = 0;
+	*sqfree = 0;
+	for (i = 0; i < sdata->THREADS; i++)
+	{
+		*mertens += s.mertens[i];
+		*sqfree += s.sqfree[i];
+	}
+
+	free(s.mertens);
+	free(s.sqfree);
+	return;
+}
+
+int64_t soe_mertens(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit)
+{
+	// sum of mu(n) over [lowlimit, highlimit].  With lowlimit <= 1
+	// this is the Mertens function M(highlimit).
+	int64_t mertens;
+	uint64_t sqfree;
+
+	mult_sums(sdata, lowlimit, highlimit, &mertens, &sqfree);
+	return mertens;
+}
+
+uint64_t soe_squarefree_count(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit)
+{
+	// number of squarefree integers in [lowlimit, highlimit]
+	int64_t mertens;
+	uint64_t sqfree;
+
+	mult_sums(sdata, lowlimit, highlimit, &mertens, &sqfree);
+	return sqfree;
+}
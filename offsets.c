@@ -23,6 +23,7 @@ SOFTWARE.
 */
 
 #include "soe.h"
+#include "soe_impl.h"
 #include "immintrin.h"
 #include "ytools.h"
 #include <math.h>
@@ -96,6 +97,9 @@ void get_offsets(thread_soedata_t *thread_data)
     int s;
     int FLAGSIZE = sdata->FLAGSIZE;
     int FLAGBITS = sdata->FLAGBITS;
+    soe_phase_t mark;
+
+    soe_clock(&mark, ddata);
 
     // failsafe: set all blocks to sieve with all primes.  the loop below will overwrite
     // these with better limits according to the size of flags in the blocks.
@@ -139,10 +143,13 @@ void get_offsets(thread_soedata_t *thread_data)
                 //printf("pbounds block %d = %u\n", block, i);
                 ddata->pbounds[block] = i;
 
-                // if (block < (sdata->blocks - 0)) // <-- sometimes crashes, but correct ranges
-                // if (block < (sdata->blocks - 1)) // <-- no crashes, but incorrect ranges
-                if (block < (sdata->blocks - 1))
-                    block++;
+                // no block sieves with the primes past the last block's bound.
+                // carrying on would find their offsets from past the end of
+                // the line, and avx2 builds pad the sieve primes beyond
+                // sqrt(highlimit) to a multiple of 8, so there can be some.
+                if (block == (sdata->blocks - 1))
+                    break;
+                block++;
                 ddata->lblk_b = ddata->ublk_b + prodN;
                 ddata->ublk_b += sdata->blk_r;
                 ddata->blk_b_sqrt = (uint64_t)(sqrt((int64_t)(ddata->ublk_b + prodN))) + 1;
@@ -160,7 +167,9 @@ void get_offsets(thread_soedata_t *thread_data)
     }
     else
     {
-        uint32_t modp;
+        uint32_t modp, sqrt_lim;
+        uint32_t *lmp = sdata->lower_mod_prime;
+        uint64_t blkoff = 0;
         mpz_t lowz, sqrtz;
         mpz_init(lowz);
         mpz_init(sqrtz);
@@ -173,25 +182,36 @@ void get_offsets(thread_soedata_t *thread_data)
         mpz_add_ui(sqrtz, sqrtz, 1);
         //mpz_set_ui(tmpz, ddata->lblk_b);
 
+        // block limits only matter while the sqrt is within reach of
+        // the 32-bit sieve primes.
+        sqrt_lim = (mpz_sizeinbase(sqrtz, 2) <= 32) ? (uint32_t)mpz_get_ui(sqrtz) : 0xffffffff;
+
         // if we're sieving with an offset, use all of the primes for each block
-        // and just find the offset into the first block
+        // and just find the offset into the first block.  getRoots left 
+        // (offset + lowlimit + 1) mod p in lower_mod_prime, and this line
+        // starts at offset + lowlimit + 1 + diff, so the mpz offset doesn't 
+        // need to be reduced again for every line.
         for (i = startprime; i < sdata->bucket_start_id; i++)
         {
             prime = sdata->sieve_p[i];
             s = sdata->root[i];
 
-            if (mpz_cmp_ui(sqrtz, sdata->sieve_p[i]) <= 0)
+            if (sqrt_lim <= prime)
             {
                 ddata->pbounds[block] = i;
+                if (block == (sdata->blocks - 1))
+                    break;
                 block++;
+                blkoff += sdata->blk_r;
                 mpz_add_ui(lowz, lowz, sdata->blk_r);
                 mpz_set(sqrtz, lowz);
                 mpz_add_ui(sqrtz, sqrtz, sdata->blk_r);
                 mpz_sqrt(sqrtz, sqrtz);
                 mpz_add_ui(sqrtz, sqrtz, 1);
+                sqrt_lim = (mpz_sizeinbase(sqrtz, 2) <= 32) ? (uint32_t)mpz_get_ui(sqrtz) : 0xffffffff;
             }
 
-            modp = mpz_tdiv_ui(lowz, prime);
+            modp = (uint32_t)(((uint64_t)lmp[i] + diff + (blkoff % prime)) % prime);
             tmp2 = (uint64_t)s * (uint64_t)modp;
             ddata->offsets[i] = (uint32_t)(tmp2 % (uint64_t)prime);
             //gmp_printf("p = %u, o = %u, r = %d, lblk_b = %Zd, modp = %u\n", 
@@ -202,6 +222,8 @@ void get_offsets(thread_soedata_t *thread_data)
         mpz_clear(sqrtz);
     }
 
+    soe_phase_lap(&ddata->stats.offsets, &mark, ddata);
+
     if (ddata->bucket_depth > 0)
     {
         uint64_t** bptr;
@@ -702,5 +724,35 @@ void get_offsets(thread_soedata_t *thread_data)
 
     }
 
+    if (ddata->bucket_depth > 0)
+    {
+        // note how full the buckets got, for soe_stats_t
+        uint32_t maxhits = 0;
+
+        for (i = 0; i < sdata->blocks; i++)
+        {
+            ddata->stats.bucket_hits += ddata->bucket_hits[i];
+            maxhits = MAX(maxhits, ddata->bucket_hits[i]);
+        }
+        ddata->stats.bucket_slots += sdata->blocks * ddata->bucket_alloc;
+        ddata->stats.bucket_max_fill = MAX(ddata->stats.bucket_max_fill,
+            (double)maxhits / (double)ddata->bucket_alloc);
+
+        if (ddata->largep_offset > 0)
+        {
+            maxhits = 0;
+            for (i = 0; i < sdata->blocks; i++)
+            {
+                ddata->stats.bucket_hits += ddata->large_bucket_hits[i];
+                maxhits = MAX(maxhits, ddata->large_bucket_hits[i]);
+            }
+            ddata->stats.bucket_slots += sdata->blocks * ddata->bucket_alloc_large;
+            ddata->stats.bucket_max_fill = MAX(ddata->stats.bucket_max_fill,
+                (double)maxhits / (double)ddata->bucket_alloc_large);
+        }
+    }
+
+    soe_phase_lap(&ddata->stats.bucket_fill, &mark, ddata);
+
 	return;
 }
@@ -0,0 +1,1313 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#if defined(WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Packed survivor bitmaps.  The sieve's lines already hold one flag
+// per wheel slot, so handing them over as they are costs about a bit
+// per candidate, versus 8 bytes for an offset or a decimal string per 
+// value.  The file format is a small header, the base as written by
+// mpz_out_raw, the residue classes, and then each line in turn:
+//
+//   "YSBM", version, prodN, numclasses     4 x 32 bits
+//   numlinebytes, lo, hi, num              4 x 64 bits, little endian
+//   base                                   mpz_out_raw
+//   rclass[numclasses]                     32 bits each, little endian
+//   lines[numclasses][numlinebytes]
+
+#define SOE_BITMAP_VERSION 1
+
+static void clear_bits(uint8_t *line, uint64_t from, uint64_t to)
+{
+	// clear bits [from, to) of a line
+	while ((from < to) && (from & 7))
+	{
+		line[from >> 3] &= ~(uint8_t)(1 << (from & 7));
+		from++;
+	}
+
+	if (to - from >= 8)
+	{
+		memset(line + (from >> 3), 0, (to - from) >> 3);
+		from += (to - from) & ~7ULL;
+	}
+
+	while (from < to)
+	{
+		line[from >> 3] &= ~(uint8_t)(1 << (from & 7));
+		from++;
+	}
+
+	return;
+}
+
+void bitmap_clip(soe_bitmap_t *bm, uint64_t lo, uint64_t hi)
+{
+	// clear the flags for values outside of [base + lo, base + hi]
+	// and recount what is left.
+	uint64_t nbits = bm->numlinebytes * 8;
+	uint64_t num = 0;
+	uint32_t i;
+
+	for (i = 0; i < bm->numclasses; i++)
+	{
+		uint8_t *line = bm->lines[i];
+		uint64_t *line64 = (uint64_t *)line;
+		uint64_t r = bm->rclass[i];
+		uint64_t nb = 0, nt = 0, j;
+
+		// slots below lo and above hi
+		if (lo > r)
+			nb = (lo - r + bm->prodN - 1) / bm->prodN;
+		if (hi >= r)
+			nt = (hi - r) / bm->prodN + 1;
+		nb = MIN(nb, nbits);
+		nt = MIN(nt, nbits);
+
+		clear_bits(line, 0, nb);
+		clear_bits(line, MAX(nt, nb), nbits);
+
+		for (j = 0; j < bm->numlinebytes / 8; j++)
+			num += _popcount64(line64[j]);
+	}
+
+	bm->lo = lo;
+	bm->hi = hi;
+	bm->num = num;
+	return;
+}
+
+uint64_t bitmap_from_lineflags(soe_staticdata_t *sdata, soe_bitmap_t *bm)
+{
+	// take ownership of the sieved lines, clearing the flags outside
+	// of the requested range.  Returns the number of flags left.
+	uint32_t i;
+
+	bm->prodN = (uint32_t)sdata->prodN;
+	bm->numclasses = sdata->numclasses;
+	bm->numlinebytes = sdata->numlinebytes;
+	bm->rclass = (uint32_t *)xmalloc(sdata->numclasses * sizeof(uint32_t));
+	memcpy(bm->rclass, sdata->rclass, sdata->numclasses * sizeof(uint32_t));
+	bm->lines = (uint8_t **)xmalloc(sdata->numclasses * sizeof(uint8_t *));
+
+	for (i = 0; i < sdata->numclasses; i++)
+	{
+		bm->lines[i] = sdata->lines[i];
+		sdata->lines[i] = NULL;
+	}
+
+	// bit 0 of each line is at base, which is lowlimit past the offset
+	// when sieving a range.
+	mpz_init(bm->base);
+	if (sdata->sieve_range)
+		mpz_set(bm->base, *sdata->offset);
+	mpz_add_ui(bm->base, bm->base, sdata->lowlimit);
+
+	bitmap_clip(bm, sdata->orig_llimit - sdata->lowlimit, 
+		sdata->orig_hlimit - sdata->lowlimit);
+
+	return bm->num;
+}
+
+uint64_t soe_bitmap_values(soe_bitmap_t *bm, uint64_t start, uint64_t stop, uint64_t *values)
+{
+	// the survivors in [start, stop], as ascending offsets from the 
+	// bottom of the bitmap's range.  Disjoint slices can be expanded by
+	// different threads.  Returns the number of values written.
+	uint64_t nbits = bm->numlinebytes * 8;
+	uint64_t b, b0, b1, g;
+	uint64_t num = 0;
+	uint64_t *words;
+	uint32_t c;
+
+	if ((start > stop) || (start > bm->hi - bm->lo))
+		return 0;
+
+	stop = MIN(stop, bm->hi - bm->lo);
+	b0 = (start + bm->lo) / bm->prodN;
+	b1 = MIN((stop + bm->lo) / bm->prodN + 1, nbits);
+
+	words = (uint64_t *)xmalloc(bm->numclasses * sizeof(uint64_t));
+
+	// 64 slots of every class at a time, so that values come out in order
+	for (g = b0 & ~63ULL; g < b1; g += 64)
+	{
+		uint64_t any = 0;
+
+		for (c = 0; c < bm->numclasses; c++)
+		{
+			memcpy(&words[c], bm->lines[c] + (g >> 3), sizeof(uint64_t));
+			any |= words[c];
+		}
+
+		if (any == 0)
+			continue;
+
+		for (b = MAX(g, b0); b < MIN(g + 64, b1); b++)
+		{
+			uint64_t base = b * bm->prodN;
+
+			for (c = 0; c < bm->numclasses; c++)
+			{
+				if (words[c] & (1ULL << (b - g)))
+				{
+					uint64_t v = base + bm->rclass[c] - bm->lo;
+
+					if ((v >= start) && (v <= stop))
+						values[num++] = v;
+				}
+			}
+		}
+	}
+
+	free(words);
+	return num;
+}
+
+static int write_u32(FILE *out, uint32_t x)
+{
+	uint8_t b[4];
+
+	put_u32(b, x);
+	return (fwrite(b, 1, 4, out) == 4) ? 0 : -1;
+}
+
+static int write_u64(FILE *out, uint64_t x)
+{
+	uint8_t b[8];
+
+	put_u64(b, x);
+	return (fwrite(b, 1, 8, out) == 8) ? 0 : -1;
+}
+
+static int read_u32(FILE *in, uint32_t *x)
+{
+	uint8_t b[4];
+
+	if (fread(b, 1, 4, in) != 4)
+		return -1;
+	*x = get_u32(b);
+	return 0;
+}
+
+static int read_u64(FILE *in, uint64_t *x)
+{
+	uint8_t b[8];
+
+	if (fread(b, 1, 8, in) != 8)
+		return -1;
+	*x = get_u64(b);
+	return 0;
+}
+
+int soe_bitmap_write(soe_bitmap_t *bm, const char *filename)
+{
+	FILE *out;
+	uint32_t i;
+	int err = 0;
+
+	out = fopen(filename, "wb");
+	if (out == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for writing\n", filename);
+		return -1;
+	}
+
+	err |= (fwrite("YSBM", 1, 4, out) == 4) ? 0 : -1;
+	err |= write_u32(out, SOE_BITMAP_VERSION);
+	err |= write_u32(out, bm->prodN);
+	err |= write_u32(out, bm->numclasses);
+	err |= write_u64(out, bm->numlinebytes);
+	err |= write_u64(out, bm->lo);
+	err |= write_u64(out, bm->hi);
+	err |= write_u64(out, bm->num);
+	err |= (mpz_out_raw(out, bm->base) > 0) ? 0 : -1;
+
+	for (i = 0; i < bm->numclasses; i++)
+		err |= write_u32(out, bm->rclass[i]);
+
+	for (i = 0; (i < bm->numclasses) && (err == 0); i++)
+	{
+		if (fwrite(bm->lines[i], 1, bm->numlinebytes, out) != bm->numlinebytes)
+			err = -1;
+	}
+
+	if (fclose(out) != 0)
+		err = -1;
+
+	if (err)
+	{
+		printf("error writing %s\n", filename);
+	}
+
+	return err;
+}
+
+soe_bitmap_t* soe_bitmap_read(const char *filename)
+{
+	soe_bitmap_t *bm;
+	FILE *in;
+	char magic[4];
+	uint32_t version, i;
+	int err = 0;
+
+	in = fopen(filename, "rb");
+	if (in == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for reading\n", filename);
+		return NULL;
+	}
+
+	if ((fread(magic, 1, 4, in) != 4) || (memcmp(magic, "YSBM", 4) != 0) ||
+		read_u32(in, &version) || (version != SOE_BITMAP_VERSION))
+	{
+		printf("%s is not a survivor bitmap\n", filename);
+		fclose(in);
+		return NULL;
+	}
+
+	bm = (soe_bitmap_t *)xcalloc(1, sizeof(soe_bitmap_t));
+	mpz_init(bm->base);
+
+	err |= read_u32(in, &bm->prodN);
+	err |= read_u32(in, &bm->numclasses);
+	err |= read_u64(in, &bm->numlinebytes);
+	err |= read_u64(in, &bm->lo);
+	err |= read_u64(in, &bm->hi);
+	err |= read_u64(in, &bm->num);
+	err |= (mpz_inp_raw(bm->base, in) > 0) ? 0 : -1;
+
+	// lines are padded to a multiple of 8 bytes, and each class is
+	// below prodN, so anything else is a corrupt file
+	if (err || (bm->prodN == 0) || (bm->numclasses == 0) || 
+		(bm->numclasses > bm->prodN) || (bm->numlinebytes & 7))
+	{
+		printf("error reading header of %s\n", filename);
+		mpz_clear(bm->base);
+		free(bm);
+		fclose(in);
+		return NULL;
+	}
+
+	bm->rclass = (uint32_t *)xmalloc(bm->numclasses * sizeof(uint32_t));
+	bm->lines = (uint8_t **)xcalloc(bm->numclasses, sizeof(uint8_t *));
+
+	for (i = 0; i < bm->numclasses; i++)
+		err |= read_u32(in, &bm->rclass[i]);
+
+	for (i = 0; (i < bm->numclasses) && (err == 0); i++)
+	{
+		bm->lines[i] = (uint8_t *)xmalloc_align(bm->numlinebytes * sizeof(uint8_t));
+		if (fread(bm->lines[i], 1, bm->numlinebytes, in) != bm->numlinebytes)
+			err = -1;
+	}
+
+	fclose(in);
+
+	if (err)
+	{
+		printf("error reading %s\n", filename);
+		soe_bitmap_free(bm);
+		return NULL;
+	}
+
+	return bm;
+}
+
+void soe_bitmap_free(soe_bitmap_t *bm)
+{
+	uint32_t i;
+
+	if (bm == NULL)
+		return;
+
+	for (i = 0; i < bm->numclasses; i++)
+	{
+		if (bm->lines[i] != NULL)
+			align_free(bm->lines[i]);
+	}
+	free(bm->lines);
+	free(bm->rclass);
+	mpz_clear(bm->base);
+	free(bm);
+
+	return;
+}
+
+// Prime list output.  Text is one decimal prime per line, as always.
+// The binary formats are little endian:
+//
+//   SOE_OUTPUT_U64     each prime as 64 bits
+//   SOE_OUTPUT_GAP32   the first prime as 64 bits, then each gap to 
+//                      the next prime as 32 bits
+//   SOE_OUTPUT_VARINT  the first prime as 64 bits, then each gap / 2
+//                      as a LEB128 varint: one byte for gaps below 256,
+//                      which is nearly all of them.  The gap from 2 to 3
+//                      is written as 0.
+//
+// Output is written by a thread of its own, so that the sieve can go
+// on to the next piece of a range (see soe_wrapper) while the last one
+// is formatted and written.  The caller queues jobs of two kinds.  A
+// list of primes is encoded by the writer thread into a large buffer,
+// which is written with one fwrite.  A buffer of text is one the caller
+// has already formatted.  soe_write_primes writes a whole list in one
+// go.
+//
+// Decimal text is not converted from binary value by value.  The digits
+// of the previous value are kept and the gap to the next one is added
+// to them in decimal, which for a prime gap touches two or three digits.
+// Given the static data, text is formatted by all of its threads, each
+// taking a slice of the list; the slices are then joined in order.
+
+#define SOE_OUTBUF_BYTES (1 << 22)
+
+// values per slice when formatting text in parallel, and per batch of
+// slices queued to the writer
+#define SOE_TEXT_SLICE 65536
+#define SOE_TEXT_BATCH (1 << 20)
+
+// a decimal number, as digits right aligned in buf[start..cap)
+typedef struct
+{
+	char *buf;
+	int cap;
+	int start;
+} soe_decimal_t;
+
+// most buffers of formatted text queued before the caller waits
+#define SOE_WRITER_DEPTH 4
+
+typedef struct
+{
+	uint8_t *bytes;			// formatted text, freed once written
+	size_t len;
+	uint64_t *primes;		// or primes to encode, owned by the caller
+	uint64_t num;
+} soe_write_job_t;
+
+struct soe_writer
+{
+	FILE *out;
+	int err;
+
+	// encoding state, only touched by the writer thread
+	int format;
+	uint64_t lowlimit;
+	uint64_t highlimit;
+	uint64_t prev;
+	uint64_t count;
+	soe_decimal_t dec;
+	uint8_t *buf;
+	size_t len;
+
+	// lines formatted by the caller
+	uint64_t formatted;
+
+	soe_write_job_t *jobs;
+	uint32_t num_jobs;
+	uint32_t alloc_jobs;
+	uint32_t next_job;
+	int done;
+#if defined(WIN32) || defined(_WIN64)
+	HANDLE thread_id;
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond;
+#else
+	pthread_t thread_id;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+};
+
+static __inline void writer_lock(soe_writer_t *w)
+{
+#if defined(WIN32) || defined(_WIN64)
+	EnterCriticalSection(&w->lock);
+#else
+	pthread_mutex_lock(&w->lock);
+#endif
+}
+
+static __inline void writer_unlock(soe_writer_t *w)
+{
+#if defined(WIN32) || defined(_WIN64)
+	LeaveCriticalSection(&w->lock);
+#else
+	pthread_mutex_unlock(&w->lock);
+#endif
+}
+
+static __inline void writer_wait(soe_writer_t *w)
+{
+#if defined(WIN32) || defined(_WIN64)
+	SleepConditionVariableCS(&w->cond, &w->lock, INFINITE);
+#else
+	pthread_cond_wait(&w->cond, &w->lock);
+#endif
+}
+
+static __inline void writer_wake(soe_writer_t *w)
+{
+#if defined(WIN32) || defined(_WIN64)
+	WakeAllConditionVariable(&w->cond);
+#else
+	pthread_cond_broadcast(&w->cond);
+#endif
+}
+
+static void writer_push(soe_writer_t *w, soe_write_job_t *job)
+{
+	writer_lock(w);
+
+	// don't let preformatted lines run too far ahead of the disk
+	while ((job->bytes != NULL) && (w->num_jobs - w->next_job >= SOE_WRITER_DEPTH))
+		writer_wait(w);
+
+	if (w->num_jobs == w->alloc_jobs)
+	{
+		w->alloc_jobs = (w->alloc_jobs == 0) ? 16 : 2 * w->alloc_jobs;
+		w->jobs = (soe_write_job_t *)xrealloc(w->jobs,
+			w->alloc_jobs * sizeof(soe_write_job_t));
+	}
+	w->jobs[w->num_jobs++] = *job;
+
+	writer_wake(w);
+	writer_unlock(w);
+	return;
+}
+
+static __inline void outbuf_flush(soe_writer_t *w)
+{
+	if ((w->len > 0) && (fwrite(w->buf, 1, w->len, w->out) != w->len))
+		w->err = 1;
+	w->len = 0;
+	return;
+}
+
+static __inline void outbuf_u64(soe_writer_t *w, uint64_t x)
+{
+	put_u64(w->buf + w->len, x);
+	w->len += 8;
+	return;
+}
+
+static __inline void outbuf_u32(soe_writer_t *w, uint32_t x)
+{
+	put_u32(w->buf + w->len, x);
+	w->len += 4;
+	return;
+}
+
+static __inline void outbuf_varint(soe_writer_t *w, uint64_t x)
+{
+	while (x >= 128)
+	{
+		w->buf[w->len++] = (uint8_t)(x | 128);
+		x >>= 7;
+	}
+	w->buf[w->len++] = (uint8_t)x;
+	return;
+}
+
+static void dec_init(soe_decimal_t *d, int digits)
+{
+	// room for digits, and a carry out of them
+	d->cap = digits + 2;
+	d->buf = (char *)xmalloc(d->cap);
+	d->start = d->cap - 1;
+	d->buf[d->start] = '0';
+	return;
+}
+
+static void dec_set_u64(soe_decimal_t *d, uint64_t x)
+{
+	d->start = d->cap;
+	do
+	{
+		d->buf[--d->start] = '0' + (char)(x % 10);
+		x /= 10;
+	} while (x != 0);
+	return;
+}
+
+static void dec_set_mpz(soe_decimal_t *d, mpz_t x, char *tmp)
+{
+	// tmp needs room for mpz_get_str
+	size_t n;
+
+	mpz_get_str(tmp, 10, x);
+	n = strlen(tmp);
+	d->start = d->cap - (int)n;
+	memcpy(d->buf + d->start, tmp, n);
+	return;
+}
+
+static __inline void dec_add(soe_decimal_t *d, uint64_t x)
+{
+	// add x to the digits, from the least significant up
+	char *p = d->buf + d->cap;
+	int carry = 0;
+
+	while ((x != 0) || carry)
+	{
+		int v;
+
+		p--;
+		if (p < d->buf + d->start)
+		{
+			*p = '0';
+			d->start--;
+		}
+
+		v = (*p - '0') + (int)(x % 10) + carry;
+		x /= 10;
+		carry = (v >= 10);
+		*p = '0' + (char)(carry ? v - 10 : v);
+	}
+
+	return;
+}
+
+static __inline char *dec_put(soe_decimal_t *d, char *out, char sep)
+{
+	int n = d->cap - d->start;
+
+	memcpy(out, d->buf + d->start, n);
+	out[n] = sep;
+	return out + n + 1;
+}
+
+static void outbuf_primes(soe_writer_t *w, uint64_t *primes, uint64_t num)
+{
+	// encode the primes in range from the sorted list primes[0..num)
+	uint64_t i;
+
+	for (i = 0; i < num; i++)
+	{
+		uint64_t p = primes[i];
+
+		if ((p < w->lowlimit) || (p > w->highlimit))
+			continue;
+
+		// room for the longest entry of any format
+		if (w->len > SOE_OUTBUF_BYTES - 32)
+			outbuf_flush(w);
+
+		if ((w->count == 0) && (w->format != SOE_OUTPUT_TEXT))
+		{
+			outbuf_u64(w, p);
+		}
+		else
+		{
+			switch (w->format)
+			{
+			case SOE_OUTPUT_U64:
+				outbuf_u64(w, p);
+				break;
+			case SOE_OUTPUT_GAP32:
+				outbuf_u32(w, (uint32_t)(p - w->prev));
+				break;
+			case SOE_OUTPUT_VARINT:
+				outbuf_varint(w, (p - w->prev) / 2);
+				break;
+			default:
+				if (w->count == 0)
+					dec_set_u64(&w->dec, p);
+				else
+					dec_add(&w->dec, p - w->prev);
+				w->len = (char *)dec_put(&w->dec, (char *)w->buf + w->len, '\n') - 
+					(char *)w->buf;
+				break;
+			}
+		}
+
+		w->prev = p;
+		w->count++;
+	}
+
+	return;
+}
+
+typedef struct
+{
+	mpz_t *base;
+	uint64_t *values;
+	uint64_t num;
+	uint64_t minval;
+	uint64_t maxval;
+	char sep;
+	int width;
+	char *out;
+
+	uint64_t num_slices;
+	uint64_t next_slice;
+	uint64_t *slice_of_thread;
+	uint64_t *lens;
+	uint64_t *counts;
+} format_userdata_t;
+
+static void format_slice(format_userdata_t *udata, uint64_t slice)
+{
+	// format the values of one slice into its own stretch of out
+	uint64_t lo = slice * SOE_TEXT_SLICE;
+	uint64_t hi = MIN(lo + SOE_TEXT_SLICE, udata->num);
+	char *start = udata->out + lo * (udata->width + 1);
+	char *o = start;
+	char *tmp = NULL;
+	soe_decimal_t d;
+	uint64_t i, prev = 0, count = 0;
+	mpz_t t;
+
+	dec_init(&d, udata->width);
+	if (udata->base != NULL)
+	{
+		mpz_init(t);
+		tmp = (char *)xmalloc(udata->width + 2);
+	}
+
+	for (i = lo; i < hi; i++)
+	{
+		uint64_t v = udata->values[i];
+
+		if ((v < udata->minval) || (v > udata->maxval))
+			continue;
+
+		if ((count > 0) && (v >= prev))
+		{
+			dec_add(&d, v - prev);
+		}
+		else if (udata->base != NULL)
+		{
+			mpz_add_ui(t, *udata->base, v);
+			dec_set_mpz(&d, t, tmp);
+		}
+		else
+		{
+			dec_set_u64(&d, v);
+		}
+
+		o = dec_put(&d, o, udata->sep);
+		prev = v;
+		count++;
+	}
+
+	udata->lens[slice] = o - start;
+	udata->counts[slice] = count;
+
+	if (udata->base != NULL)
+	{
+		mpz_clear(t);
+		free(tmp);
+	}
+	free(d.buf);
+	return;
+}
+
+void format_dispatch(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	format_userdata_t *udata = (format_userdata_t *)tdata->user_data;
+
+	// if not done, dispatch another slice
+	if (udata->next_slice < udata->num_slices)
+	{
+		udata->slice_of_thread[tdata->tindex] = udata->next_slice;
+		tdata->work_fcn_id = 0;
+		udata->next_slice++;
+	}
+	else
+	{
+		tdata->work_fcn_id = tdata->num_work_fcn;
+	}
+
+	return;
+}
+
+void format_work_fcn(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	format_userdata_t *udata = (format_userdata_t *)tdata->user_data;
+
+	format_slice(udata, udata->slice_of_thread[tdata->tindex]);
+	return;
+}
+
+int format_decimal_width(mpz_t *base, uint64_t maxval)
+{
+	// the most digits format_decimal will write for one value
+	mpz_t t;
+	int width;
+
+	mpz_init(t);
+	if (base != NULL)
+		mpz_add_ui(t, *base, maxval);
+	else
+		mpz_set_ui(t, maxval);
+	width = (int)mpz_sizeinbase(t, 10);
+	mpz_clear(t);
+
+	return width;
+}
+
+uint64_t format_decimal(soe_staticdata_t *sdata, mpz_t *base, uint64_t *values,
+	uint64_t num, uint64_t minval, uint64_t maxval, char sep, char *out, size_t *len)
+{
+	// write base + values[i] in decimal to out, each followed by sep, for
+	// the values in [minval, maxval].  out needs room for num values of
+	// format_decimal_width(base, maxval) digits and a separator.  The 
+	// values should be increasing, or formatting falls back to a full 
+	// conversion at each value that isn't.  With sdata, slices are
+	// formatted by all of its threads.  Returns the number of values
+	// written, and their length in len.
+	format_userdata_t udata;
+	tpool_t *tpool_data;
+	int threads = (sdata == NULL) ? 1 : sdata->THREADS;
+	uint64_t s, pos = 0, count = 0;
+
+	udata.base = base;
+	udata.values = values;
+	udata.num = num;
+	udata.minval = minval;
+	udata.maxval = maxval;
+	udata.sep = sep;
+	udata.width = format_decimal_width(base, maxval);
+	udata.out = out;
+	udata.num_slices = (num + SOE_TEXT_SLICE - 1) / SOE_TEXT_SLICE;
+	udata.next_slice = 0;
+	udata.slice_of_thread = (uint64_t *)xmalloc(threads * sizeof(uint64_t));
+	udata.lens = (uint64_t *)xmalloc((udata.num_slices + 1) * sizeof(uint64_t));
+	udata.counts = (uint64_t *)xmalloc((udata.num_slices + 1) * sizeof(uint64_t));
+
+	if ((threads == 1) || (udata.num_slices == 1))
+	{
+		for (; udata.next_slice < udata.num_slices; udata.next_slice++)
+		{
+			format_slice(&udata, udata.next_slice);
+		}
+	}
+	else
+	{
+		tpool_data = tpool_setup(threads, NULL, NULL, NULL,
+			&format_dispatch, &udata);
+		tpool_add_work_fcn(tpool_data, &format_work_fcn);
+		tpool_go(tpool_data);
+		free(tpool_data);
+	}
+
+	// close up the gaps between slices
+	for (s = 0; s < udata.num_slices; s++)
+	{
+		char *src = out + s * SOE_TEXT_SLICE * (udata.width + 1);
+
+		if (src != out + pos)
+			memmove(out + pos, src, udata.lens[s]);
+		pos += udata.lens[s];
+		count += udata.counts[s];
+	}
+
+	free(udata.slice_of_thread);
+	free(udata.lens);
+	free(udata.counts);
+
+	*len = pos;
+	return count;
+}
+
+#if defined(WIN32) || defined(_WIN64)
+static DWORD WINAPI writer_thread_main(LPVOID thread_data)
+#else
+static void *writer_thread_main(void *thread_data)
+#endif
+{
+	soe_writer_t *w = (soe_writer_t *)thread_data;
+
+	writer_lock(w);
+	while (1)
+	{
+		soe_write_job_t job;
+
+		while ((w->next_job == w->num_jobs) && !w->done)
+			writer_wait(w);
+
+		if (w->next_job == w->num_jobs)
+			break;
+
+		job = w->jobs[w->next_job++];
+		writer_wake(w);
+		writer_unlock(w);
+
+		if (job.bytes != NULL)
+		{
+			outbuf_flush(w);
+			if (fwrite(job.bytes, 1, job.len, w->out) != job.len)
+				w->err = 1;
+			free(job.bytes);
+		}
+		else
+		{
+			outbuf_primes(w, job.primes, job.num);
+		}
+
+		writer_lock(w);
+	}
+	writer_unlock(w);
+
+	outbuf_flush(w);
+	return 0;
+}
+
+const char* soe_output_filename(int format)
+{
+	switch (format)
+	{
+	case SOE_OUTPUT_U64:
+		return "primes.u64";
+	case SOE_OUTPUT_GAP32:
+		return "primes.g32";
+	case SOE_OUTPUT_VARINT:
+		return "primes.var";
+	default:
+		return "primes.dat";
+	}
+}
+
+soe_writer_t *soe_writer_open(const char *filename, int format, 
+	uint64_t lowlimit, uint64_t highlimit)
+{
+	// start a writer thread on a list of primes in [lowlimit, highlimit]
+	// going to filename.  Returns NULL if the file can't be opened.
+	soe_writer_t *w;
+	FILE *out;
+
+	out = fopen(filename, (format == SOE_OUTPUT_TEXT) ? "w" : "wb");
+	if (out == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for writing\n", filename);
+		return NULL;
+	}
+
+	// the buffers are already large, don't copy them again
+	setvbuf(out, NULL, _IONBF, 0);
+
+	w = (soe_writer_t *)xcalloc(1, sizeof(soe_writer_t));
+	w->out = out;
+	w->buf = (uint8_t *)xmalloc(SOE_OUTBUF_BYTES);
+	dec_init(&w->dec, 20);
+	w->format = format;
+	w->lowlimit = lowlimit;
+	w->highlimit = highlimit;
+
+#if defined(WIN32) || defined(_WIN64)
+	InitializeCriticalSection(&w->lock);
+	InitializeConditionVariable(&w->cond);
+	w->thread_id = CreateThread(NULL, 0, writer_thread_main, w, 0, NULL);
+#else
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	pthread_create(&w->thread_id, NULL, writer_thread_main, w);
+#endif
+
+	return w;
+}
+
+void soe_writer_decimal(soe_writer_t *w, soe_staticdata_t *sdata, mpz_t *base,
+	uint64_t *values, uint64_t num, uint64_t minval, uint64_t maxval)
+{
+	// format the lines base + values[i] for values in [minval, maxval]
+	// here, with the threads of sdata, and queue them in batches.
+	int width = format_decimal_width(base, maxval);
+	soe_write_job_t job;
+	uint64_t i;
+
+	for (i = 0; i < num; i += SOE_TEXT_BATCH)
+	{
+		uint64_t n = MIN(SOE_TEXT_BATCH, num - i);
+		size_t len;
+
+		job.bytes = (uint8_t *)xmalloc(n * (width + 1));
+		w->formatted += format_decimal(sdata, base, values + i, n,
+			minval, maxval, '\n', (char *)job.bytes, &len);
+		job.len = len;
+		job.primes = NULL;
+		job.num = 0;
+		writer_push(w, &job);
+	}
+
+	return;
+}
+
+void soe_print_decimal(soe_staticdata_t *sdata, mpz_t *base, uint64_t *values, 
+	uint64_t num, uint64_t minval, uint64_t maxval, char sep)
+{
+	// as soe_writer_decimal, but to the screen with the given separator
+	int width = format_decimal_width(base, maxval);
+	char *buf = (char *)xmalloc(MIN(num, SOE_TEXT_BATCH) * (width + 1) + 1);
+	uint64_t i;
+
+	for (i = 0; i < num; i += SOE_TEXT_BATCH)
+	{
+		uint64_t n = MIN(SOE_TEXT_BATCH, num - i);
+		size_t len;
+
+		format_decimal(sdata, base, values + i, n, minval, maxval, sep, buf, &len);
+		fwrite(buf, 1, len, stdout);
+	}
+
+	free(buf);
+	return;
+}
+
+void soe_writer_primes(soe_writer_t *w, soe_staticdata_t *sdata, 
+	uint64_t *primes, uint64_t num)
+{
+	// queue the sorted list primes[0..num), which must stay valid until
+	// soe_writer_close.  Successive lists must continue in increasing order.
+	// Given sdata, text is formatted here by its threads instead.
+	soe_write_job_t job;
+
+	if ((sdata != NULL) && (w->format == SOE_OUTPUT_TEXT))
+	{
+		soe_writer_decimal(w, sdata, NULL, primes, num, w->lowlimit, w->highlimit);
+		return;
+	}
+
+	job.bytes = NULL;
+	job.len = 0;
+	job.primes = primes;
+	job.num = num;
+	writer_push(w, &job);
+	return;
+}
+
+uint64_t soe_writer_close(soe_writer_t *w, const char *filename)
+{
+	// wait for everything queued to be written, stop the writer thread
+	// and close the file.  Returns the number of primes written.
+	uint64_t count;
+
+	writer_lock(w);
+	w->done = 1;
+	writer_wake(w);
+	writer_unlock(w);
+
+#if defined(WIN32) || defined(_WIN64)
+	WaitForSingleObject(w->thread_id, INFINITE);
+	CloseHandle(w->thread_id);
+	DeleteCriticalSection(&w->lock);
+#else
+	pthread_join(w->thread_id, NULL);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+#endif
+
+	if (fclose(w->out) != 0)
+		w->err = 1;
+
+	if (w->err)
+	{
+		printf("error writing %s\n", filename);
+	}
+
+	count = w->count + w->formatted;
+	free(w->dec.buf);
+	free(w->buf);
+	free(w->jobs);
+	free(w);
+
+	return count;
+}
+
+uint64_t soe_write_primes(const char *filename, int format, uint64_t *primes,
+	uint64_t num, uint64_t lowlimit, uint64_t highlimit)
+{
+	// write the primes in [lowlimit, highlimit] from the sorted list
+	// primes[0..num) to filename.  Returns the number written.
+	soe_writer_t *w = soe_writer_open(filename, format, lowlimit, highlimit);
+
+	if (w == NULL)
+		return 0;
+
+	soe_writer_primes(w, NULL, primes, num);
+	return soe_writer_close(w, filename);
+}
+
+// Prime lists bigger than memory.  With sdata->map_path set, the list
+// soe_wrapper returns is written straight into a mapped file instead of
+// the heap, so the kernel can page it out to disk rather than the
+// allocation failing.  The file is sparse, so only what is filled takes
+// space, and it is deleted as soon as it is mapped (on Windows, when
+// the mapping is closed).  Such lists are released with soe_free_primes.
+
+// smaller lists stay on the heap
+#define SOE_MAP_MIN_BYTES (1ULL << 26)
+
+uint64_t *map_primes_alloc(soe_staticdata_t *sdata, uint64_t num)
+{
+	// room for num primes, in a mapped file if it's big enough to be
+	// worth it; falls back to the heap if the file can't be made.
+	uint64_t bytes = MAX(num, 1) * sizeof(uint64_t);
+	soe_mapped_t m;
+	char *name;
+
+	if ((sdata->map_path == NULL) || (bytes < SOE_MAP_MIN_BYTES))
+		return (uint64_t *)xmalloc(bytes);
+
+	name = (char *)xmalloc(strlen(sdata->map_path) + 32);
+	m.bytes = bytes;
+	m.primes = NULL;
+
+#if defined(WIN32) || defined(_WIN64)
+	{
+		DWORD ret;
+		int k;
+
+		// the first name not taken by another list
+		m.file = INVALID_HANDLE_VALUE;
+		for (k = 0; (k < 1000) && (m.file == INVALID_HANDLE_VALUE); k++)
+		{
+			sprintf(name, "%s.%lu.%d", sdata->map_path, 
+				(unsigned long)GetCurrentProcessId(), k);
+			m.file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+				FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		}
+
+		if (m.file != INVALID_HANDLE_VALUE)
+		{
+			DeviceIoControl(m.file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &ret, NULL);
+			m.mapping = CreateFileMapping(m.file, NULL, PAGE_READWRITE,
+				(DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+			if (m.mapping != NULL)
+				m.primes = (uint64_t *)MapViewOfFile(m.mapping, FILE_MAP_WRITE, 0, 0, 0);
+			if (m.primes == NULL)
+			{
+				if (m.mapping != NULL)
+					CloseHandle(m.mapping);
+				CloseHandle(m.file);
+			}
+		}
+	}
+#else
+	{
+		int fd;
+		void *p;
+
+		sprintf(name, "%s.XXXXXX", sdata->map_path);
+		fd = mkstemp(name);
+		if (fd >= 0)
+		{
+			if (ftruncate(fd, (off_t)bytes) == 0)
+			{
+#if defined(MAP_NORESERVE)
+				p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+#else
+				p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+				if (p != MAP_FAILED)
+				{
+					// filled front to back by the sieve
+					madvise(p, bytes, MADV_SEQUENTIAL);
+					m.primes = (uint64_t *)p;
+				}
+			}
+			close(fd);
+			unlink(name);
+		}
+	}
+#endif
+
+	if (m.primes == NULL)
+	{
+		printf("can't map %" PRIu64 " bytes at %s, using memory\n", bytes, name);
+		free(name);
+		return (uint64_t *)xmalloc(bytes);
+	}
+
+	if (sdata->VFLAG > 1)
+	{
+		printf("mapped %" PRIu64 " bytes for primes at %s\n", bytes, name);
+	}
+
+	sdata->mapped = (soe_mapped_t *)xrealloc(sdata->mapped,
+		(sdata->num_mapped + 1) * sizeof(soe_mapped_t));
+	sdata->mapped[sdata->num_mapped++] = m;
+	free(name);
+
+	return m.primes;
+}
+
+void soe_free_primes(soe_staticdata_t *sdata, uint64_t *primes)
+{
+	// release a list returned by soe_wrapper, mapped or not
+	int i;
+
+	for (i = 0; i < sdata->num_mapped; i++)
+	{
+		if (sdata->mapped[i].primes == primes)
+		{
+#if defined(WIN32) || defined(_WIN64)
+			UnmapViewOfFile(primes);
+			CloseHandle(sdata->mapped[i].mapping);
+			CloseHandle(sdata->mapped[i].file);
+#else
+			munmap(primes, sdata->mapped[i].bytes);
+#endif
+			sdata->mapped[i] = sdata->mapped[--sdata->num_mapped];
+			return;
+		}
+	}
+
+	free(primes);
+	return;
+}
+
+typedef struct
+{
+	FILE *in;
+	uint8_t *buf;
+	size_t len;
+	size_t pos;
+} soe_inbuf_t;
+
+static __inline int inbuf_byte(soe_inbuf_t *ib, uint8_t *b)
+{
+	if (ib->pos == ib->len)
+	{
+		ib->len = fread(ib->buf, 1, SOE_OUTBUF_BYTES, ib->in);
+		ib->pos = 0;
+		if (ib->len == 0)
+			return 0;
+	}
+	*b = ib->buf[ib->pos++];
+	return 1;
+}
+
+static __inline int inbuf_le(soe_inbuf_t *ib, int bytes, uint64_t *x)
+{
+	uint8_t b;
+	int i;
+
+	for (i = 0, *x = 0; i < bytes; i++)
+	{
+		if (!inbuf_byte(ib, &b))
+			return 0;
+		*x |= (uint64_t)b << (8 * i);
+	}
+	return 1;
+}
+
+uint64_t *soe_read_primes(const char *filename, int format, uint64_t *num)
+{
+	// load a prime list written by soe_write_primes in a binary format
+	soe_inbuf_t ib;
+	uint64_t *primes;
+	uint64_t alloc = 1024, n = 0, p, x;
+
+	*num = 0;
+	if ((format != SOE_OUTPUT_U64) && (format != SOE_OUTPUT_GAP32) &&
+		(format != SOE_OUTPUT_VARINT))
+	{
+		printf("soe_read_primes: unsupported format %d\n", format);
+		return NULL;
+	}
+
+	ib.in = fopen(filename, "rb");
+	if (ib.in == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for reading\n", filename);
+		return NULL;
+	}
+
+	ib.buf = (uint8_t *)xmalloc(SOE_OUTBUF_BYTES);
+	ib.len = ib.pos = 0;
+	primes = (uint64_t *)xmalloc(alloc * sizeof(uint64_t));
+
+	if (inbuf_le(&ib, 8, &p))
+	{
+		primes[n++] = p;
+
+		while (1)
+		{
+			if (format == SOE_OUTPUT_U64)
+			{
+				if (!inbuf_le(&ib, 8, &p))
+					break;
+			}
+			else if (format == SOE_OUTPUT_GAP32)
+			{
+				if (!inbuf_le(&ib, 4, &x))
+					break;
+				p += x;
+			}
+			else
+			{
+				uint8_t b;
+				int shift = 0;
+
+				x = 0;
+				do
+				{
+					if (!inbuf_byte(&ib, &b))
+						break;
+					x |= (uint64_t)(b & 127) << shift;
+					shift += 7;
+				} while (b & 128);
+
+				if ((shift == 0) || (b & 128))
+					break;
+				p = (p == 2) ? 3 : p + 2 * x;
+			}
+
+			if (n == alloc)
+			{
+				alloc *= 2;
+				primes = (uint64_t *)xrealloc(primes, alloc * sizeof(uint64_t));
+			}
+			primes[n++] = p;
+		}
+	}
+
+	fclose(ib.in);
+	free(ib.buf);
+	*num = n;
+	return primes;
+}
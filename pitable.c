@@ -0,0 +1,217 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+// A table of pi(k * step) checkpoints, k = 0, 1, ..., num - 1.  With a
+// table loaded, soe_wrapper answers a count over a range wider than
+// the step by sieving from each end to its nearest checkpoint, at most
+// step / 2 per end, and taking the difference of the table entries.
+//
+//   "YSPI", version            2 x 32 bits
+//   step, num                  2 x 64 bits
+//   pi(0), pi(step), ...       num x 64 bits
+//
+// All numbers are little endian.
+
+#define SOE_PI_TABLE_VERSION 1
+#define SOE_PI_TABLE_HEADER_BYTES 24
+
+int soe_pi_table_build(soe_staticdata_t *sdata, const char *filename, 
+	uint64_t limit, uint64_t step)
+{
+	// write pi(k * step) for k * step <= limit to filename, counting
+	// each step with the sieve.  A step of 0 means SOE_PI_TABLE_STEP.
+	// Returns 0 on success.
+	FILE *out;
+	uint8_t b[SOE_PI_TABLE_HEADER_BYTES];
+	uint64_t k, num, pi = 0;
+	int err = 0;
+
+	// timing
+	double t;
+	struct timeval tstart, tstop;
+
+	if (step == 0)
+		step = SOE_PI_TABLE_STEP;
+	num = limit / step + 1;
+
+	out = fopen(filename, "wb");
+	if (out == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for writing\n", filename);
+		return -1;
+	}
+
+	gettimeofday(&tstart, NULL);
+
+	memcpy(b, "YSPI", 4);
+	b[4] = SOE_PI_TABLE_VERSION;
+	b[5] = b[6] = b[7] = 0;
+	put_u64(b + 8, step);
+	put_u64(b + 16, num);
+	err |= (fwrite(b, 1, SOE_PI_TABLE_HEADER_BYTES, out) != SOE_PI_TABLE_HEADER_BYTES);
+
+	put_u64(b, 0);
+	err |= (fwrite(b, 1, 8, out) != 8);
+
+	for (k = 1; k < num; k++)
+	{
+		uint64_t n;
+
+		soe_wrapper(sdata, (k - 1) * step + 1, k * step, 1, &n, 0, 0);
+		pi += n;
+
+		put_u64(b, pi);
+		err |= (fwrite(b, 1, 8, out) != 8);
+
+		if (sdata->VFLAG > 0)
+		{
+			printf("pi(%" PRIu64 ") = %" PRIu64 "\r", k * step, pi);
+			fflush(stdout);
+		}
+	}
+
+	if (fclose(out) != 0)
+		err = 1;
+
+	if (err)
+	{
+		printf("error writing %s\n", filename);
+		return -1;
+	}
+
+	if (sdata->VFLAG > 0)
+	{
+		gettimeofday(&tstop, NULL);
+		t = ytools_difftime(&tstart, &tstop);
+		printf("\nwrote %" PRIu64 " checkpoints every %" PRIu64 " in %1.4f seconds\n",
+			num, step, t);
+	}
+
+	return 0;
+}
+
+int soe_pi_table_load(soe_staticdata_t *sdata, const char *filename)
+{
+	// read a table written by soe_pi_table_build and use it for counts
+	// from now on.  Returns 0 on success.
+	FILE *in;
+	uint8_t b[SOE_PI_TABLE_HEADER_BYTES];
+	uint8_t *buf;
+	uint64_t step, num, k;
+
+	in = fopen(filename, "rb");
+	if (in == NULL)
+	{
+		printf("fopen error: %s\n", strerror(errno));
+		printf("can't open %s for reading\n", filename);
+		return -1;
+	}
+
+	if ((fread(b, 1, SOE_PI_TABLE_HEADER_BYTES, in) != SOE_PI_TABLE_HEADER_BYTES) ||
+		(memcmp(b, "YSPI", 4) != 0) || (b[4] != SOE_PI_TABLE_VERSION))
+	{
+		printf("%s is not a pi table\n", filename);
+		fclose(in);
+		return -1;
+	}
+
+	step = get_u64(b + 8);
+	num = get_u64(b + 16);
+
+	buf = (uint8_t *)xmalloc(num * 8);
+	if ((step == 0) || (num == 0) || (fread(buf, 1, num * 8, in) != num * 8))
+	{
+		printf("%s is truncated\n", filename);
+		free(buf);
+		fclose(in);
+		return -1;
+	}
+	fclose(in);
+
+	free(sdata->pi_table);
+	sdata->pi_table = (uint64_t *)xmalloc(num * sizeof(uint64_t));
+	for (k = 0; k < num; k++)
+		sdata->pi_table[k] = get_u64(buf + 8 * k);
+	sdata->pi_table_step = step;
+	sdata->pi_table_num = num;
+
+	free(buf);
+
+	if (sdata->VFLAG > 1)
+	{
+		printf("loaded pi table with %" PRIu64 " checkpoints every %" PRIu64 "\n",
+			num, step);
+	}
+
+	return 0;
+}
+
+static uint64_t pi_table_pi(soe_staticdata_t *sdata, uint64_t x)
+{
+	// pi(x), from the nearest checkpoint and a sieve back to it.
+	// x must be below the last checkpoint.
+	uint64_t step = sdata->pi_table_step;
+	uint64_t k = x / step;
+	uint64_t r = x % step;
+	uint64_t n = 0;
+
+	if (r == 0)
+		return sdata->pi_table[k];
+
+	if ((r <= step / 2) || (k + 1 >= sdata->pi_table_num))
+	{
+		soe_wrapper(sdata, k * step + 1, x, 1, &n, 0, 0);
+		return sdata->pi_table[k] + n;
+	}
+
+	soe_wrapper(sdata, x + 1, (k + 1) * step, 1, &n, 0, 0);
+	return sdata->pi_table[k + 1] - n;
+}
+
+int pi_table_covers(soe_staticdata_t *sdata, uint64_t lowlimit, uint64_t highlimit)
+{
+	// the table pays off once the range is wider than a step, since
+	// then the two partial sieves are shorter than sieving it all.
+	return (sdata->pi_table != NULL) && (!sdata->do_reduce) &&
+		((highlimit - lowlimit) > sdata->pi_table_step) &&
+		(highlimit / sdata->pi_table_step < sdata->pi_table_num);
+}
+
+uint64_t pi_table_count(soe_staticdata_t *sdata, uint64_t lowlimit, uint64_t highlimit)
+{
+	// the number of primes in [lowlimit, highlimit], given pi_table_covers
+	uint64_t hi = pi_table_pi(sdata, highlimit);
+	uint64_t lo = (lowlimit > 0) ? pi_table_pi(sdata, lowlimit - 1) : 0;
+
+	return hi - lo;
+}
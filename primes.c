@@ -73,35 +73,43 @@ void compute_primes_work_fcn(void *vptr)
     soe_userdata_t *udata = (soe_userdata_t *)tdata->user_data;
     soe_staticdata_t *sdata = udata->sdata;
     thread_soedata_t *t = &udata->ddata[tdata->tindex];
-    int i;
+    uint32_t i, start, stop;
 
     if (sdata->THREADS > 1)
     {
         t->linecount = 0;
     }
 
-#if defined(USE_BMI2) || defined(USE_AVX512F)
-    if (sdata->has_bmi2)
+    // progress is counted once per 32k bytes
+    for (start = t->startid; start < t->stopid; start = stop)
     {
-        for (i = t->startid; i < t->stopid; i += 8)
+        stop = MIN(start + 32768, t->stopid);
+
+#if defined(USE_BMI2) || defined(USE_AVX512F)
+        if (sdata->has_bmi2)
         {
-            t->linecount = compute_8_bytes_bmi2(sdata, t->linecount, t->ddata.primes, i);
+            for (i = start; i < stop; i += 8)
+            {
+                t->linecount = compute_8_bytes_bmi2(sdata, t->linecount, t->ddata.primes, i);
+            }
         }
-    }
-    else
-    {
-        for (i = t->startid; i < t->stopid; i += 8)
+        else
         {
-            t->linecount = compute_8_bytes(sdata, t->linecount, t->ddata.primes, i);
+            for (i = start; i < stop; i += 8)
+            {
+                t->linecount = compute_8_bytes(sdata, t->linecount, t->ddata.primes, i);
+            }
         }
-    }
 #else
-    for (i = t->startid; i < t->stopid; i += 8)
-    {
-        t->linecount = compute_8_bytes(sdata, t->linecount, t->ddata.primes, i);
-    }
+        for (i = start; i < stop; i += 8)
+        {
+            t->linecount = compute_8_bytes(sdata, t->linecount, t->ddata.primes, i);
+        }
 #endif
 
+        soe_progress_add(sdata, SOE_PROGRESS_EXTRACT, stop - start);
+    }
+
     return;
 }
 
@@ -217,6 +225,7 @@ uint64_t primes_from_lineflags(soe_staticdata_t *sdata, thread_soedata_t *thread
     tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
         &compute_primes_dispatch, &udata);
 
+    soe_progress_begin(sdata, SOE_PROGRESS_EXTRACT, lastid);
     if (sdata->THREADS == 1)
     {
         thread_data->linecount = pcount;
@@ -228,6 +237,7 @@ uint64_t primes_from_lineflags(soe_staticdata_t *sdata, thread_soedata_t *thread
         tpool_add_work_fcn(tpool_data, &compute_primes_work_fcn);
         tpool_go(tpool_data);
     }
+    soe_progress_end(sdata, SOE_PROGRESS_EXTRACT);
     free(tpool_data);    
 
 	// now combine all of the temporary arrays, if necessary
@@ -307,16 +317,6 @@ uint32_t compute_8_bytes(soe_staticdata_t *sdata,
 	uint64_t ohigh = sdata->orig_hlimit;
     int GLOBAL_OFFSET = sdata->GLOBAL_OFFSET;
 		
-	if ((byte_offset & 32767) == 0)
-	{
-		if (sdata->VFLAG > 1)
-		{
-			printf("computing: %d%%\r",(int)
-				((double)byte_offset / (double)(sdata->numlinebytes) * 100.0));
-			fflush(stdout);
-		}
-	}
-
     // Compute the primes using ctz on the 64-bit words but push the results
     // into 64 different queues depending on the bit position.  Then
     // we pull from the queues in order while storing into the primes array.
@@ -400,16 +400,6 @@ uint32_t compute_8_bytes_bmi2(soe_staticdata_t *sdata,
     uint64_t ohigh = sdata->orig_hlimit;
     int GLOBAL_OFFSET = sdata->GLOBAL_OFFSET;
 
-    if ((byte_offset & 32767) == 0)
-    {
-        if (sdata->VFLAG > 1)
-        {
-            printf("computing: %d%%\r", (int)
-                ((double)byte_offset / (double)(sdata->numlinebytes) * 100.0));
-            fflush(stdout);
-        }
-    }
-
     // AVX2 version, new instructions help quite a bit:
     // use _pdep_u64 to align/interleave bits from multiple bytes, 
     // _blsr_u64 to clear the last set bit, and depending on the 
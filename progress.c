@@ -0,0 +1,288 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#if !defined(WIN32) && !defined(_WIN64)
+#include <time.h>
+#endif
+
+// Progress of the sieve, extraction and PRP phases.  Workers only bump
+// a counter (soe_progress_add); while a phase runs, a reporter thread
+// wakes every interval seconds and hands the counts to the user's
+// callback.  Without a callback it prints the old "sieving: N%" style
+// lines, at the verbosity that used to print them, so nothing on the
+// worker side ever touches stdout.
+
+#define SOE_PROGRESS_INTERVAL 1.0
+
+static void progress_lock(struct soe_progress *p)
+{
+#if defined(WIN32) || defined(_WIN64)
+    EnterCriticalSection(&p->lock);
+#else
+    pthread_mutex_lock(&p->lock);
+#endif
+}
+
+static void progress_unlock(struct soe_progress *p)
+{
+#if defined(WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&p->lock);
+#else
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+static void progress_wake(struct soe_progress *p)
+{
+#if defined(WIN32) || defined(_WIN64)
+    WakeAllConditionVariable(&p->cond);
+#else
+    pthread_cond_broadcast(&p->cond);
+#endif
+}
+
+// wait up to the report interval, or until woken by soe_progress_end
+static void progress_wait(struct soe_progress *p)
+{
+#if defined(WIN32) || defined(_WIN64)
+    SleepConditionVariableCS(&p->cond, &p->lock, (DWORD)(p->interval * 1000.0));
+#else
+    struct timespec ts;
+    double s;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    s = (double)ts.tv_nsec * 1e-9 + p->interval;
+    ts.tv_sec += (time_t)s;
+    ts.tv_nsec = (long)((s - (double)(time_t)s) * 1e9);
+    pthread_cond_timedwait(&p->cond, &p->lock, &ts);
+#endif
+}
+
+static void progress_report(struct soe_progress *p, int phase, uint64_t done, uint64_t total)
+{
+    if (p->fcn != NULL)
+    {
+        p->fcn(phase, done, total, p->user_data);
+        return;
+    }
+
+    if (phase == SOE_PROGRESS_PRP)
+    {
+        printf("PRP tested %" PRIu64 " of %" PRIu64 " candidates\r", done, total);
+    }
+    else
+    {
+        printf("%s: %d%%\r", (phase == SOE_PROGRESS_SIEVE) ? "sieving" :
+            (phase == SOE_PROGRESS_DEEP) ? "deep sieve" : "computing",
+            (total > 0) ? (int)(MIN(done, total) * 100 / total) : 0);
+    }
+    fflush(stdout);
+
+    return;
+}
+
+#if defined(WIN32) || defined(_WIN64)
+static DWORD WINAPI progress_thread_main(LPVOID thread_data)
+#else
+static void *progress_thread_main(void *thread_data)
+#endif
+{
+    struct soe_progress *p = (struct soe_progress *)thread_data;
+
+    progress_lock(p);
+    while (p->running)
+    {
+        int phase;
+        uint64_t done, total;
+
+        progress_wait(p);
+        if (!p->running)
+        {
+            break;
+        }
+
+        phase = p->phase;
+        done = p->done;
+        total = p->total;
+        progress_unlock(p);
+
+        progress_report(p, phase, done, total);
+
+        progress_lock(p);
+    }
+    progress_unlock(p);
+
+    return 0;
+}
+
+struct soe_progress *soe_progress_init(void)
+{
+    struct soe_progress *p;
+
+    p = (struct soe_progress *)xcalloc(1, sizeof(struct soe_progress));
+    p->phase = SOE_PROGRESS_NONE;
+    p->interval = SOE_PROGRESS_INTERVAL;
+#if defined(WIN32) || defined(_WIN64)
+    InitializeCriticalSection(&p->lock);
+    InitializeConditionVariable(&p->cond);
+#else
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+#endif
+
+    return p;
+}
+
+void soe_progress_free(struct soe_progress *p)
+{
+#if defined(WIN32) || defined(_WIN64)
+    DeleteCriticalSection(&p->lock);
+#else
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+#endif
+    free(p);
+
+    return;
+}
+
+// start counting a phase of total units.  If another phase is already
+// being counted this one is ignored, along with its counts and its end.
+void soe_progress_begin(soe_staticdata_t *sdata, int phase, uint64_t total)
+{
+    struct soe_progress *p = sdata->progress;
+
+    progress_lock(p);
+    if (p->phase != SOE_PROGRESS_NONE)
+    {
+        progress_unlock(p);
+        return;
+    }
+
+    p->done = 0;
+    p->total = total;
+    p->phase = phase;
+
+    // without a callback, print at the verbosity that used to print
+    if ((p->fcn != NULL) || (sdata->VFLAG > ((phase == SOE_PROGRESS_PRP) ? 0 : 1)))
+    {
+        p->running = 1;
+#if defined(WIN32) || defined(_WIN64)
+        p->thread_id = CreateThread(NULL, 0, progress_thread_main, p, 0, NULL);
+#else
+        pthread_create(&p->thread_id, NULL, progress_thread_main, p);
+#endif
+    }
+    progress_unlock(p);
+
+    return;
+}
+
+// for phases whose size grows as they go, like the PRP queue
+void soe_progress_total(soe_staticdata_t *sdata, int phase, uint64_t total)
+{
+    struct soe_progress *p = sdata->progress;
+
+    if (p->phase == phase)
+    {
+        p->total = total;
+    }
+
+    return;
+}
+
+void soe_progress_end(soe_staticdata_t *sdata, int phase)
+{
+    struct soe_progress *p = sdata->progress;
+    uint64_t done, total;
+    int running;
+
+    progress_lock(p);
+    if (p->phase != phase)
+    {
+        progress_unlock(p);
+        return;
+    }
+
+    running = p->running;
+    p->running = 0;
+    progress_wake(p);
+    progress_unlock(p);
+
+    if (running)
+    {
+#if defined(WIN32) || defined(_WIN64)
+        WaitForSingleObject(p->thread_id, INFINITE);
+        CloseHandle(p->thread_id);
+#else
+        pthread_join(p->thread_id, NULL);
+#endif
+    }
+
+    progress_lock(p);
+    done = p->done;
+    total = p->total;
+    p->phase = SOE_PROGRESS_NONE;
+    progress_unlock(p);
+
+    // a callback always hears about the end of a phase, however short
+    if (p->fcn != NULL)
+    {
+        p->fcn(phase, done, total, p->user_data);
+    }
+
+    return;
+}
+
+// report progress to fcn every interval seconds (0 for the default),
+// or stop reporting if fcn is NULL.  Must not be changed mid-call.
+void soe_set_progress(soe_staticdata_t *sdata, soe_progress_fcn_t fcn,
+    void *user_data, double interval)
+{
+    struct soe_progress *p = sdata->progress;
+
+    p->fcn = fcn;
+    p->user_data = user_data;
+    p->interval = (interval > 0) ? interval : SOE_PROGRESS_INTERVAL;
+
+    return;
+}
+
+// poll the current phase's counts; returns the phase, or
+// SOE_PROGRESS_NONE if nothing is running
+int soe_get_progress(soe_staticdata_t *sdata, uint64_t *done, uint64_t *total)
+{
+    struct soe_progress *p = sdata->progress;
+
+    *done = p->done;
+    *total = p->total;
+    return p->phase;
+}
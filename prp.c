@@ -0,0 +1,545 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+
+// Baillie-PSW probable prime tests for candidates that fit in one or
+// two 64-bit words: trial division by a few small primes, a strong
+// base-2 test, then a strong Lucas test with Selfridge's parameters
+// (the first D in 5, -7, 9, -11, ... with (D/n) = -1, P = 1 and
+// Q = (1 - D)/4).  All arithmetic is in Montgomery form.
+//
+// This matches mpz_probab_prime_p(n, 1) only from GMP 6.2 on, which
+// made BPSW its test.  Older GMPs, like the 6.1.2 of the WSL build,
+// run a Fermat test and one Miller-Rabin round with a random base
+// instead, so in rare cases a composite that passes one test and not
+// the other separates the native and gmp survivors.
+
+#if defined(HAVE_UINT128)
+
+static const uint32_t prp_small_primes[15] = {
+	3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+
+static int jacobi_u32(uint32_t a, uint32_t m)
+{
+	// jacobi symbol (a/m) for odd m
+	int j = 1;
+
+	a %= m;
+	while (a != 0)
+	{
+		while ((a & 1) == 0)
+		{
+			a >>= 1;
+			if (((m & 7) == 3) || ((m & 7) == 5))
+				j = -j;
+		}
+
+		{
+			uint32_t t = a;
+			a = m;
+			m = t;
+		}
+
+		if (((a & 3) == 3) && ((m & 3) == 3))
+			j = -j;
+		a %= m;
+	}
+
+	return (m == 1) ? j : 0;
+}
+
+static int jacobi_d(int d, uint32_t nmodd, uint32_t nmod4)
+{
+	// (d/n) for small odd d, given n mod |d| and n mod 4, by
+	// reciprocity
+	uint32_t a = (d < 0) ? -d : d;
+	int j = jacobi_u32(nmodd, a);
+
+	if (((a & 3) == 3) && (nmod4 == 3))
+		j = -j;
+	if ((d < 0) && (nmod4 == 3))
+		j = -j;
+
+	return j;
+}
+
+// ============================================================
+// one word
+// ============================================================
+
+static __inline uint64_t mulredc64(uint64_t a, uint64_t b, uint64_t n, uint64_t nhat)
+{
+	// a * b / 2^64 mod n.  The low words of a*b and m*n sum to 0 or
+	// 2^64, depending only on whether the low word of a*b is zero.
+	uint128_t t = (uint128_t)a * b;
+	uint64_t m = (uint64_t)t * nhat;
+	uint128_t r = (t >> 64) + (((uint128_t)m * n) >> 64) + ((uint64_t)t != 0);
+
+	if (r >= n)
+		r -= n;
+
+	return (uint64_t)r;
+}
+
+static __inline uint64_t addmod64(uint64_t a, uint64_t b, uint64_t n)
+{
+	uint64_t r = a + b;
+
+	if ((r < a) || (r >= n))
+		r -= n;
+
+	return r;
+}
+
+static __inline uint64_t submod64(uint64_t a, uint64_t b, uint64_t n)
+{
+	uint64_t r = a - b;
+
+	if (a < b)
+		r += n;
+
+	return r;
+}
+
+static __inline uint64_t halfmod64(uint64_t a, uint64_t n)
+{
+	// a / 2 mod n for odd n
+	if (a & 1)
+		return (a >> 1) + (n >> 1) + 1;
+
+	return a >> 1;
+}
+
+static int issquare_u64(uint64_t n)
+{
+	uint64_t r = (uint64_t)sqrt((double)n);
+
+	while ((r > 0) && ((r > 0xffffffffULL) || (r * r > n)))
+		r--;
+	while (((r + 1) <= 0xffffffffULL) && ((r + 1) * (r + 1) <= n))
+		r++;
+
+	return (r * r == n);
+}
+
+static int sprp2_u64(uint64_t n, uint64_t nhat, uint64_t one)
+{
+	uint64_t d = n - 1;
+	uint64_t mone = n - one;
+	uint64_t x = one;
+	int s = 0, bit, i;
+
+	while ((d & 1) == 0)
+	{
+		d >>= 1;
+		s++;
+	}
+
+	// left-to-right powering; multiplying by the base is a doubling
+	for (bit = 63 - (int)_lead_zcnt64(d); bit >= 0; bit--)
+	{
+		x = mulredc64(x, x, n, nhat);
+		if ((d >> bit) & 1)
+			x = addmod64(x, x, n);
+	}
+
+	if ((x == one) || (x == mone))
+		return 1;
+
+	for (i = 1; i < s; i++)
+	{
+		x = mulredc64(x, x, n, nhat);
+		if (x == mone)
+			return 1;
+		if (x == one)
+			return 0;
+	}
+
+	return 0;
+}
+
+static int lucas_u64(uint64_t n, uint64_t nhat, uint64_t one)
+{
+	// strong Lucas test, Selfridge's method A
+	uint64_t r2, dm, qm, u, v, qk, d;
+	int dd = 5, s = 0, bit, i, j;
+
+	for (i = 0; ; i++)
+	{
+		j = jacobi_d(dd, (uint32_t)(n % (uint64_t)((dd < 0) ? -dd : dd)),
+			(uint32_t)(n & 3));
+
+		if (j == -1)
+			break;
+
+		if ((j == 0) && ((uint64_t)((dd < 0) ? -dd : dd) != n))
+			return 0;
+
+		// no such D exists for squares
+		if ((i == 8) && issquare_u64(n))
+			return 0;
+
+		dd = (dd < 0) ? (-dd + 2) : (-dd - 2);
+	}
+
+	// montgomery forms of D and Q = (1 - D) / 4
+	r2 = (uint64_t)(((uint128_t)one << 64) % n);
+	dm = mulredc64((uint64_t)((dd < 0) ? -dd : dd), r2, n, nhat);
+	if (dd < 0)
+		dm = n - dm;
+	qm = mulredc64((uint64_t)(((dd < 0) ? (1 - dd) : (dd - 1)) / 4), r2, n, nhat);
+	if (dd > 0)
+		qm = (qm == 0) ? 0 : n - qm;
+
+	// n + 1 = d * 2^s; n < 2^64 - 1 here since 3 | 2^64 - 1
+	d = n + 1;
+	while ((d & 1) == 0)
+	{
+		d >>= 1;
+		s++;
+	}
+
+	// U_1 = 1, V_1 = P = 1, Q^1
+	u = one;
+	v = one;
+	qk = qm;
+	for (bit = 62 - (int)_lead_zcnt64(d); bit >= 0; bit--)
+	{
+		// double: U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k
+		u = mulredc64(u, v, n, nhat);
+		v = submod64(mulredc64(v, v, n, nhat), addmod64(qk, qk, n), n);
+		qk = mulredc64(qk, qk, n, nhat);
+
+		if ((d >> bit) & 1)
+		{
+			// increment: U_k+1 = (U_k + V_k) / 2, V_k+1 = (D U_k + V_k) / 2
+			uint64_t t = addmod64(u, v, n);
+			v = halfmod64(addmod64(mulredc64(dm, u, n, nhat), v, n), n);
+			u = halfmod64(t, n);
+			qk = mulredc64(qk, qm, n, nhat);
+		}
+	}
+
+	if ((u == 0) || (v == 0))
+		return 1;
+
+	for (i = 1; i < s; i++)
+	{
+		v = submod64(mulredc64(v, v, n, nhat), addmod64(qk, qk, n), n);
+		if (v == 0)
+			return 1;
+		qk = mulredc64(qk, qk, n, nhat);
+	}
+
+	return 0;
+}
+
+int bpsw_u64(uint64_t n)
+{
+	// 1 if n is a probable prime, else 0
+	uint64_t nhat, one;
+	int i;
+
+	if (n < 2)
+		return 0;
+	if ((n & 1) == 0)
+		return (n == 2);
+
+	for (i = 0; i < 15; i++)
+	{
+		if ((n % prp_small_primes[i]) == 0)
+			return (n == prp_small_primes[i]);
+	}
+
+	if (n < 59 * 59)
+		return 1;
+
+	// -1/n mod 2^64 by newton iteration; n*n = 1 mod 8 to start
+	nhat = n;
+	for (i = 0; i < 5; i++)
+		nhat *= 2 - n * nhat;
+	nhat = 0 - nhat;
+	one = (0 - n) % n;
+
+	if (!sprp2_u64(n, nhat, one))
+		return 0;
+
+	return lucas_u64(n, nhat, one);
+}
+
+// ============================================================
+// two words
+// ============================================================
+
+static __inline uint128_t mulredc128(uint128_t a, uint128_t b, uint128_t n, uint64_t nhat)
+{
+	// a * b / 2^128 mod n, a word of b at a time (CIOS).  a, b < n.
+	uint64_t a0 = (uint64_t)a, a1 = (uint64_t)(a >> 64);
+	uint64_t b0 = (uint64_t)b, b1 = (uint64_t)(b >> 64);
+	uint64_t n0 = (uint64_t)n, n1 = (uint64_t)(n >> 64);
+	uint64_t t0, t1, t2, t3, m;
+	uint128_t c, r;
+
+	c = (uint128_t)a0 * b0;
+	t0 = (uint64_t)c;
+	c = (uint128_t)a1 * b0 + (c >> 64);
+	t1 = (uint64_t)c;
+	t2 = (uint64_t)(c >> 64);
+
+	m = t0 * nhat;
+	c = (uint128_t)m * n0 + t0;
+	c = (uint128_t)m * n1 + t1 + (c >> 64);
+	t0 = (uint64_t)c;
+	c = (uint128_t)t2 + (c >> 64);
+	t1 = (uint64_t)c;
+	t2 = (uint64_t)(c >> 64);
+
+	c = (uint128_t)a0 * b1 + t0;
+	t0 = (uint64_t)c;
+	c = (uint128_t)a1 * b1 + t1 + (c >> 64);
+	t1 = (uint64_t)c;
+	c = (uint128_t)t2 + (c >> 64);
+	t2 = (uint64_t)c;
+	t3 = (uint64_t)(c >> 64);
+
+	m = t0 * nhat;
+	c = (uint128_t)m * n0 + t0;
+	c = (uint128_t)m * n1 + t1 + (c >> 64);
+	t0 = (uint64_t)c;
+	c = (uint128_t)t2 + (c >> 64);
+	t1 = (uint64_t)c;
+	t2 = t3 + (uint64_t)(c >> 64);
+
+	// the result is less than 2n
+	r = ((uint128_t)t1 << 64) | t0;
+	if (t2 || (r >= n))
+		r -= n;
+
+	return r;
+}
+
+static __inline uint128_t addmod128(uint128_t a, uint128_t b, uint128_t n)
+{
+	uint128_t r = a + b;
+
+	if ((r < a) || (r >= n))
+		r -= n;
+
+	return r;
+}
+
+static __inline uint128_t submod128(uint128_t a, uint128_t b, uint128_t n)
+{
+	uint128_t r = a - b;
+
+	if (a < b)
+		r += n;
+
+	return r;
+}
+
+static __inline uint128_t halfmod128(uint128_t a, uint128_t n)
+{
+	if (a & 1)
+		return (a >> 1) + (n >> 1) + 1;
+
+	return a >> 1;
+}
+
+static __inline int bits128(uint128_t x)
+{
+	if (x >> 64)
+		return 128 - (int)_lead_zcnt64((uint64_t)(x >> 64));
+
+	return 64 - (int)_lead_zcnt64((uint64_t)x);
+}
+
+static int issquare_u128(uint128_t n)
+{
+	// newton from above
+	uint128_t x = (uint128_t)sqrtl((long double)n), y;
+
+	x += (x >> 32) + 2;
+	if (x > 0xffffffffffffffffULL)
+		x = 0xffffffffffffffffULL;
+
+	while (1)
+	{
+		y = (x + n / x) >> 1;
+		if (y >= x)
+			break;
+		x = y;
+	}
+
+	return (x * x == n);
+}
+
+static int sprp2_u128(uint128_t n, uint64_t nhat, uint128_t one)
+{
+	uint128_t d = n - 1;
+	uint128_t mone = n - one;
+	uint128_t x = one;
+	int s = 0, bit, i;
+
+	while ((d & 1) == 0)
+	{
+		d >>= 1;
+		s++;
+	}
+
+	for (bit = bits128(d) - 1; bit >= 0; bit--)
+	{
+		x = mulredc128(x, x, n, nhat);
+		if ((d >> bit) & 1)
+			x = addmod128(x, x, n);
+	}
+
+	if ((x == one) || (x == mone))
+		return 1;
+
+	for (i = 1; i < s; i++)
+	{
+		x = mulredc128(x, x, n, nhat);
+		if (x == mone)
+			return 1;
+		if (x == one)
+			return 0;
+	}
+
+	return 0;
+}
+
+static int lucas_u128(uint128_t n, uint64_t nhat, uint128_t one)
+{
+	uint128_t r2, dm, qm, u, v, qk, d;
+	int dd = 5, s = 0, bit, i, j;
+
+	for (i = 0; ; i++)
+	{
+		uint32_t a = (uint32_t)((dd < 0) ? -dd : dd);
+
+		j = jacobi_d(dd, u128_mod_u32(n, a), (uint32_t)(n & 3));
+
+		if (j == -1)
+			break;
+
+		if ((j == 0) && ((uint128_t)a != n))
+			return 0;
+
+		if ((i == 8) && issquare_u128(n))
+			return 0;
+
+		dd = (dd < 0) ? (-dd + 2) : (-dd - 2);
+	}
+
+	// R^2 mod n by doubling R mod n another 128 times
+	r2 = one;
+	for (i = 0; i < 128; i++)
+		r2 = addmod128(r2, r2, n);
+
+	dm = mulredc128((uint128_t)((dd < 0) ? -dd : dd), r2, n, nhat);
+	if (dd < 0)
+		dm = n - dm;
+	qm = mulredc128((uint128_t)(((dd < 0) ? (1 - dd) : (dd - 1)) / 4), r2, n, nhat);
+	if (dd > 0)
+		qm = (qm == 0) ? 0 : n - qm;
+
+	// n < 2^128 - 1 here since 3 | 2^128 - 1
+	d = n + 1;
+	while ((d & 1) == 0)
+	{
+		d >>= 1;
+		s++;
+	}
+
+	u = one;
+	v = one;
+	qk = qm;
+	for (bit = bits128(d) - 2; bit >= 0; bit--)
+	{
+		u = mulredc128(u, v, n, nhat);
+		v = submod128(mulredc128(v, v, n, nhat), addmod128(qk, qk, n), n);
+		qk = mulredc128(qk, qk, n, nhat);
+
+		if ((d >> bit) & 1)
+		{
+			uint128_t t = addmod128(u, v, n);
+			v = halfmod128(addmod128(mulredc128(dm, u, n, nhat), v, n), n);
+			u = halfmod128(t, n);
+			qk = mulredc128(qk, qm, n, nhat);
+		}
+	}
+
+	if ((u == 0) || (v == 0))
+		return 1;
+
+	for (i = 1; i < s; i++)
+	{
+		v = submod128(mulredc128(v, v, n, nhat), addmod128(qk, qk, n), n);
+		if (v == 0)
+			return 1;
+		qk = mulredc128(qk, qk, n, nhat);
+	}
+
+	return 0;
+}
+
+int bpsw_u128(uint128_t n)
+{
+	// 1 if n is a probable prime, else 0
+	uint64_t n0 = (uint64_t)n;
+	uint64_t nhat;
+	uint128_t one;
+	int i;
+
+	if ((n >> 64) == 0)
+		return bpsw_u64(n0);
+
+	if ((n & 1) == 0)
+		return 0;
+
+	for (i = 0; i < 15; i++)
+	{
+		if (u128_mod_u32(n, prp_small_primes[i]) == 0)
+			return 0;
+	}
+
+	nhat = n0;
+	for (i = 0; i < 5; i++)
+		nhat *= 2 - n0 * nhat;
+	nhat = 0 - nhat;
+	one = (0 - n) % n;
+
+	if (!sprp2_u128(n, nhat, one))
+		return 0;
+
+	return lucas_u128(n, nhat, one);
+}
+
+#endif
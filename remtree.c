@@ -0,0 +1,341 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+#include "threadpool.h"
+
+// Reduce one large integer modulo many 32-bit primes.  Calling
+// mpz_tdiv_ui once per prime costs O(size of n) each time, which
+// dominates setup when n has thousands of digits and there are
+// millions of sieve primes.  Here the primes are taken in batches
+// whose product is about the size of n.  Each batch builds a product
+// tree over small groups of primes, reduces n modulo the root, and
+// pushes remainders down the tree so that every group only needs to
+// divide a remainder a few limbs long.  Batches are independent and
+// are handed to the thread pool dynamically.  The deep sieve uses the
+// same trees, one thread per tree, with 64-bit prime moduli.
+
+// primes multiplied together in each leaf of a tree
+#define REMTREE_LEAF_PRIMES 8
+
+typedef struct
+{
+	mpz_t *tree;				// product tree nodes, leaves first
+	uint32_t alloc;				// number of nodes initialized
+	mpz_t tmpz;					// workspace for 64-bit moduli
+	uint32_t batch;				// the batch currently assigned to this thread
+} remtree_threaddata_t;
+
+typedef struct
+{
+	mpz_ptr n;
+	const uint32_t *moduli;
+	uint32_t *residues;
+	const uint64_t *moduli64;	// used instead of moduli when not NULL
+	uint64_t *residues64;
+	uint32_t num;
+	uint32_t batch_size;		// primes per batch, a multiple of REMTREE_LEAF_PRIMES
+	uint32_t num_batches;
+	uint32_t next_batch;
+	remtree_threaddata_t *tdata;
+} remtree_userdata_t;
+
+static void remtree_batch(remtree_userdata_t *udata, remtree_threaddata_t *r)
+{
+	uint32_t start = r->batch * udata->batch_size;
+	uint32_t num = MIN(udata->batch_size, udata->num - start);
+	const uint32_t *p = (udata->moduli64 == NULL) ? udata->moduli + start : NULL;
+	uint32_t *res = (udata->moduli64 == NULL) ? udata->residues + start : NULL;
+	const uint64_t *q = (udata->moduli64 != NULL) ? udata->moduli64 + start : NULL;
+	uint64_t *res64 = (udata->moduli64 != NULL) ? udata->residues64 + start : NULL;
+	uint32_t level_start[32];
+	uint32_t level_size[32];
+	uint32_t nlevels, nodes, i, j, k;
+	mpz_t *tree;
+
+	// size the tree: one leaf per group of primes, then halve until
+	// a single root remains.
+	level_size[0] = (num + REMTREE_LEAF_PRIMES - 1) / REMTREE_LEAF_PRIMES;
+	level_start[0] = 0;
+	nodes = level_size[0];
+	nlevels = 1;
+	while (level_size[nlevels - 1] > 1)
+	{
+		level_start[nlevels] = nodes;
+		level_size[nlevels] = (level_size[nlevels - 1] + 1) / 2;
+		nodes += level_size[nlevels];
+		nlevels++;
+	}
+
+	if (nodes > r->alloc)
+	{
+		r->tree = (mpz_t *)xrealloc(r->tree, nodes * sizeof(mpz_t));
+		for (i = r->alloc; i < nodes; i++)
+			mpz_init(r->tree[i]);
+		r->alloc = nodes;
+	}
+	tree = r->tree;
+
+	// leaves
+	for (i = 0; i < level_size[0]; i++)
+	{
+		uint32_t lo = i * REMTREE_LEAF_PRIMES;
+		uint32_t hi = MIN(lo + REMTREE_LEAF_PRIMES, num);
+
+		if (q != NULL)
+		{
+			// an unsigned long may only be 32 bits
+			mpz_import(tree[i], 1, -1, sizeof(uint64_t), 0, 0, q + lo);
+			for (j = lo + 1; j < hi; j++)
+			{
+				mpz_import(r->tmpz, 1, -1, sizeof(uint64_t), 0, 0, q + j);
+				mpz_mul(tree[i], tree[i], r->tmpz);
+			}
+			continue;
+		}
+
+		mpz_set_ui(tree[i], p[lo]);
+		for (j = lo + 1; j < hi; j++)
+			mpz_mul_ui(tree[i], tree[i], p[j]);
+	}
+
+	// products up the tree
+	for (k = 1; k < nlevels; k++)
+	{
+		mpz_t *child = tree + level_start[k - 1];
+		mpz_t *node = tree + level_start[k];
+
+		for (i = 0; i < level_size[k]; i++)
+		{
+			if ((2 * i + 1) < level_size[k - 1])
+				mpz_mul(node[i], child[2 * i], child[2 * i + 1]);
+			else
+				mpz_set(node[i], child[2 * i]);
+		}
+	}
+
+	// remainders down the tree.  Each node is overwritten with n mod
+	// its product, which is all its children need.
+	mpz_tdiv_r(tree[nodes - 1], udata->n, tree[nodes - 1]);
+	for (k = nlevels - 1; k > 0; k--)
+	{
+		mpz_t *child = tree + level_start[k - 1];
+		mpz_t *node = tree + level_start[k];
+
+		for (i = 0; i < level_size[k - 1]; i++)
+		{
+			mpz_tdiv_r(child[i], node[i / 2], child[i]);
+		}
+	}
+
+	// and finally the primes in each leaf
+	for (i = 0; i < level_size[0]; i++)
+	{
+		uint32_t lo = i * REMTREE_LEAF_PRIMES;
+		uint32_t hi = MIN(lo + REMTREE_LEAF_PRIMES, num);
+
+		if (q != NULL)
+		{
+			for (j = lo; j < hi; j++)
+				res64[j] = mpz_mod_u64(tree[i], q[j], r->tmpz);
+			continue;
+		}
+
+		for (j = lo; j < hi; j++)
+			res[j] = (uint32_t)mpz_tdiv_ui(tree[i], p[j]);
+	}
+
+	return;
+}
+
+void remtree_dispatch(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	remtree_userdata_t *udata = (remtree_userdata_t *)tdata->user_data;
+
+	// if not done, dispatch another batch
+	if (udata->next_batch < udata->num_batches)
+	{
+		udata->tdata[tdata->tindex].batch = udata->next_batch;
+		tdata->work_fcn_id = 0;
+		udata->next_batch++;
+	}
+	else
+	{
+		tdata->work_fcn_id = tdata->num_work_fcn;
+	}
+
+	return;
+}
+
+void remtree_work_fcn(void *vptr)
+{
+	tpool_t *tdata = (tpool_t *)vptr;
+	remtree_userdata_t *udata = (remtree_userdata_t *)tdata->user_data;
+
+	remtree_batch(udata, &udata->tdata[tdata->tindex]);
+
+	return;
+}
+
+void remtree_mod_primes(soe_staticdata_t *sdata, mpz_t n,
+	const uint32_t *moduli, uint32_t num, uint32_t *residues)
+{
+	// residues[i] = n mod moduli[i] for 0 <= i < num.  n must be
+	// non-negative.  Small n is handled directly.
+	remtree_userdata_t udata;
+	tpool_t *tpool_data;
+	size_t nbits = mpz_sizeinbase(n, 2);
+	uint32_t i;
+	int j;
+
+	// timing
+	double t;
+	struct timeval tstart, tstop;
+
+	if (num == 0)
+		return;
+
+	if (nbits < REMTREE_MIN_BITS)
+	{
+		for (i = 0; i < num; i++)
+			residues[i] = (uint32_t)mpz_tdiv_ui(n, moduli[i]);
+		return;
+	}
+
+	if (sdata->VFLAG > 1)
+	{
+		gettimeofday(&tstart, NULL);
+	}
+
+	// batches whose product is about the size of n: reducing n modulo
+	// anything much larger is a copy, and anything much smaller wastes
+	// the reduction at the root.
+	udata.n = n;
+	udata.moduli = moduli;
+	udata.residues = residues;
+	udata.moduli64 = NULL;
+	udata.residues64 = NULL;
+	udata.num = num;
+	udata.batch_size = (uint32_t)(nbits / (64 - _lead_zcnt64(moduli[num - 1])));
+	udata.batch_size = MAX(udata.batch_size, 64 * REMTREE_LEAF_PRIMES);
+	udata.batch_size -= udata.batch_size % REMTREE_LEAF_PRIMES;
+	udata.num_batches = (num + udata.batch_size - 1) / udata.batch_size;
+	udata.next_batch = 0;
+
+	udata.tdata = (remtree_threaddata_t *)calloc(sdata->THREADS, sizeof(remtree_threaddata_t));
+	for (j = 0; j < sdata->THREADS; j++)
+		mpz_init(udata.tdata[j].tmpz);
+
+	tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
+		&remtree_dispatch, &udata);
+
+	if (sdata->THREADS == 1)
+	{
+		for (; udata.next_batch < udata.num_batches; udata.next_batch++)
+		{
+			udata.tdata[0].batch = udata.next_batch;
+			remtree_work_fcn(tpool_data);
+		}
+	}
+	else
+	{
+		tpool_add_work_fcn(tpool_data, &remtree_work_fcn);
+		tpool_go(tpool_data);
+	}
+
+	free(tpool_data);
+
+	for (j = 0; j < sdata->THREADS; j++)
+	{
+		remtree_threaddata_t *r = udata.tdata + j;
+
+		for (i = 0; i < r->alloc; i++)
+			mpz_clear(r->tree[i]);
+		free(r->tree);
+		mpz_clear(r->tmpz);
+	}
+	free(udata.tdata);
+
+	if (sdata->VFLAG > 1)
+	{
+		gettimeofday(&tstop, NULL);
+		t = ytools_difftime(&tstart, &tstop);
+		printf("remainder tree: %u primes in %u batches of %u took %1.6f seconds\n",
+			num, udata.num_batches, udata.batch_size, t);
+	}
+
+	return;
+}
+
+void remtree_mod_primes64(mpz_t n, const uint64_t *moduli, uint32_t num,
+	uint64_t *residues)
+{
+	// residues[i] = n mod moduli[i] for 0 <= i < num, on the calling
+	// thread.  n must be non-negative.  Small n is handled directly.
+	remtree_userdata_t udata;
+	remtree_threaddata_t r;
+	size_t nbits = mpz_sizeinbase(n, 2);
+	uint32_t i;
+
+	if (num == 0)
+		return;
+
+	memset(&r, 0, sizeof(remtree_threaddata_t));
+	mpz_init(r.tmpz);
+
+	if (nbits < REMTREE_MIN_BITS)
+	{
+		for (i = 0; i < num; i++)
+			residues[i] = mpz_mod_u64(n, moduli[i], r.tmpz);
+		mpz_clear(r.tmpz);
+		return;
+	}
+
+	udata.n = n;
+	udata.moduli = NULL;
+	udata.residues = NULL;
+	udata.moduli64 = moduli;
+	udata.residues64 = residues;
+	udata.num = num;
+	udata.batch_size = (uint32_t)(nbits / (64 - _lead_zcnt64(moduli[num - 1])));
+	udata.batch_size = MAX(udata.batch_size, 64 * REMTREE_LEAF_PRIMES);
+	udata.batch_size -= udata.batch_size % REMTREE_LEAF_PRIMES;
+	udata.num_batches = (num + udata.batch_size - 1) / udata.batch_size;
+
+	for (r.batch = 0; r.batch < udata.num_batches; r.batch++)
+		remtree_batch(&udata, &r);
+
+	for (i = 0; i < r.alloc; i++)
+		mpz_clear(r.tree[i]);
+	free(r.tree);
+	mpz_clear(r.tmpz);
+
+	return;
+}
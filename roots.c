@@ -457,21 +457,46 @@ void compute_roots_work_fcn(void *vptr)
     else
     {
         mpz_t tmpz;
+        int native = 0;
+#if defined(HAVE_UINT128)
+        uint128_t n128;
+#endif
         mpz_init(tmpz);
 
+        // with an offset the range also covers the line sieve primes,
+        // whose roots are already done: those only need the offset
+        // reduced, once, so that get_offsets can start every line
+        // without going back to the mpz offset.
         mpz_add_ui(tmpz, *t->sdata.offset, t->sdata.lowlimit + 1);
+#if defined(HAVE_UINT128)
+        native = mpz_get_u128(tmpz, &n128);
+#endif
         for (i = t->startid; i < t->stopid; i++)
         {
             uint32_t inv;
             uint32_t prime = t->sdata.sieve_p[i];
 
-            // slightly optimized modinv when prime >> prodN
-            inv = modinv3(t->sdata.prodN, prime);
-            t->sdata.root[i] = prime - inv;
+            if (i >= t->sdata.bucket_start_id)
+            {
+                // slightly optimized modinv when prime >> prodN
+                inv = modinv3(t->sdata.prodN, prime);
+                t->sdata.root[i] = prime - inv;
+            }
 
+            if (t->sdata.offset_mods_ready)
+                continue;
+
+#if defined(HAVE_UINT128)
+            if (native)
+            {
+                t->sdata.lower_mod_prime[i] = u128_mod_u32(n128, prime);
+                continue;
+            }
+#endif
             t->sdata.lower_mod_prime[i] =
                 mpz_tdiv_ui(tmpz, prime);
         }
+        mpz_clear(tmpz);
     }
 
     free(last_root);
@@ -550,11 +575,26 @@ void getRoots(soe_staticdata_t *sdata, thread_soedata_t *thread_data)
         gettimeofday(&tstart, NULL);
     }
 
-    range = (sdata->bitmap_start_id - sdata->bucket_start_id) / sdata->THREADS;
+    // when sieving above an offset, the threads also reduce the
+    // offset modulo each line sieve prime (see compute_roots_work_fcn).
+    lastid = (sdata->sieve_range) ? (uint32_t)startprime : sdata->bucket_start_id;
+    range = (sdata->bitmap_start_id - lastid) / sdata->THREADS;
     //range = (sdata->pboundi - sdata->bucket_start_id) / sdata->THREADS;
-    lastid = sdata->bucket_start_id;
 
-    if (range > 0)
+    if ((sdata->sieve_range) && (sdata->bitmap_start_id > lastid) &&
+        (mpz_sizeinbase(*sdata->offset, 2) >= REMTREE_MIN_BITS))
+    {
+        // very large offsets: reduce modulo all of the primes at once
+        mpz_t tmpz;
+        mpz_init(tmpz);
+        mpz_add_ui(tmpz, *sdata->offset, sdata->lowlimit + 1);
+        remtree_mod_primes(sdata, tmpz, sdata->sieve_p + lastid,
+            sdata->bitmap_start_id - lastid, sdata->lower_mod_prime + lastid);
+        mpz_clear(tmpz);
+        sdata->offset_mods_ready = 1;
+    }
+
+    if (sdata->bitmap_start_id > lastid)
     {
         // divvy up the primes left to compute
         for (j = 0; j < sdata->THREADS; j++)
@@ -599,6 +639,7 @@ void getRoots(soe_staticdata_t *sdata, thread_soedata_t *thread_data)
         }
         free(tpool_data);
     }
+    sdata->offset_mods_ready = 0;
 
     if (sdata->VFLAG > 1)
     {
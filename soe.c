@@ -57,18 +57,15 @@ void sieve_sync(void *vptr)
     soe_staticdata_t *sdata = udata->sdata;
     thread_soedata_t *t = &udata->ddata[tdata->tindex];
 
-    if (sdata->VFLAG > 1)
-    {
-        //don't print status if computing primes, because lots of routines within
-        //yafu do this and they don't want this side effect
-        printf("sieving: %d%%\r", 
-            (int)((double)sdata->sync_count / (double)(sdata->numclasses)* 100.0));
-        fflush(stdout);
-    }
+    soe_progress_add(sdata, SOE_PROGRESS_SIEVE, 1);
 
     if (sdata->only_count)
     {
         sdata->num_found += t->linecount;
+        if (sdata->do_reduce)
+        {
+            reduction_merge(&sdata->reduction, &t->reduction);
+        }
     }
 
     if (t->ddata.min_sieved_val < sdata->min_sieved_val)
@@ -76,6 +73,38 @@ void sieve_sync(void *vptr)
         sdata->min_sieved_val = t->ddata.min_sieved_val;
     }
 
+    soe_stats_merge(&sdata->stats, &t->ddata.stats);
+    memset(&t->ddata.stats, 0, sizeof(soe_stats_t));
+
+    if (sdata->trace_path != NULL)
+    {
+        soe_trace_add(sdata, t->spans, t->num_spans);
+    }
+
+    return;
+}
+
+// hardware counters follow the thread that opens them, so each sieve
+// thread opens its own when it starts
+void sieve_start(void *vptr)
+{
+    tpool_t *tdata = (tpool_t *)vptr;
+    soe_userdata_t *udata = (soe_userdata_t *)tdata->user_data;
+    thread_soedata_t *t = &udata->ddata[tdata->tindex];
+
+    soe_perf_open(udata->sdata, &t->ddata);
+
+    return;
+}
+
+void sieve_stop(void *vptr)
+{
+    tpool_t *tdata = (tpool_t *)vptr;
+    soe_userdata_t *udata = (soe_userdata_t *)tdata->user_data;
+    thread_soedata_t *t = &udata->ddata[tdata->tindex];
+
+    soe_perf_close(&t->ddata);
+
     return;
 }
 
@@ -107,6 +136,14 @@ void sieve_work_fcn(void *vptr)
     soe_userdata_t *udata = (soe_userdata_t *)tdata->user_data;
     soe_staticdata_t *sdata = udata->sdata;
     thread_soedata_t *t = &udata->ddata[tdata->tindex];
+    soe_phase_t mark, start;
+    soe_stats_t before;
+
+    if (sdata->trace_path != NULL)
+    {
+        soe_clock(&start, NULL);
+        before = t->ddata.stats;
+    }
 
     if ((sdata->only_count == 0) || (sdata->num_bitmap_primes > 0))
     {
@@ -115,17 +152,46 @@ void sieve_work_fcn(void *vptr)
         // in memory at once.
         sieve_line_ptr(t);
         if (sdata->only_count)
-            t->linecount = count_line(&t->sdata, t->current_line);
+        {
+            soe_clock(&mark, &t->ddata);
+            if (sdata->do_reduce)
+            {
+                memset(&t->reduction, 0, sizeof(soe_reduction_t));
+                t->linecount = reduce_line(&t->sdata, t->current_line, &t->reduction);
+            }
+            else
+            {
+                t->linecount = count_line(&t->sdata, t->current_line);
+            }
+            soe_phase_lap(&t->ddata.stats.count, &mark, &t->ddata);
+        }
     }   
     else
     {
         t->sdata.lines[t->current_line] =
             (uint8_t *)xmalloc_align(t->sdata.numlinebytes * sizeof(uint8_t));
         sieve_line_ptr(t);
-        t->linecount = count_line(&t->sdata, t->current_line);
+        soe_clock(&mark, &t->ddata);
+        if (sdata->do_reduce)
+        {
+            // reductions are folded in line by line just like the
+            // count, so memory use stays the same as counting.
+            memset(&t->reduction, 0, sizeof(soe_reduction_t));
+            t->linecount = reduce_line(&t->sdata, t->current_line, &t->reduction);
+        }
+        else
+        {
+            t->linecount = count_line(&t->sdata, t->current_line);
+        }
+        soe_phase_lap(&t->ddata.stats.count, &mark, &t->ddata);
         align_free(t->sdata.lines[t->current_line]);        
     }
 
+    if (sdata->trace_path != NULL)
+    {
+        soe_trace_line(sdata, t, tdata->tindex + 1, &before, start.wall);
+    }
+
     return;
 }
 
@@ -442,6 +508,8 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
     // timing
     double t;
     struct timeval tstart, tstop;
+    soe_phase_t mark, begin;
+    double t0;
 
 	// keep track of how much memory we've used
 	uint64_t allocated_bytes = 0;
@@ -457,6 +525,8 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
 	thread_soedata_t *thread_data;		//an array of thread data objects
 
 	//*********************** BEGIN ******************************//
+    soe_clock(&mark, NULL);
+    begin = mark;
     sdata->only_count = count;
 
     if (VFLAG > 1)
@@ -486,7 +556,11 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
 	thread_data = (thread_soedata_t *)malloc(THREADS * sizeof(thread_soedata_t));
 
 	// find all roots of prime with prodN.  These are used when finding offsets.
+    soe_phase_lap(&sdata->stats.setup, &mark, NULL);
+    t0 = mark.wall;
 	getRoots(sdata, thread_data);
+    soe_phase_lap(&sdata->stats.roots, &mark, NULL);
+    soe_trace_span(sdata, "roots", 0, -1, t0, mark.wall);
 
 	// init bucket sieving
 	set_bucket_depth(sdata);
@@ -589,6 +663,11 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
         }
     }
 
+    soe_phase_lap(&sdata->stats.setup, &mark, NULL);
+    soe_trace_span(sdata, "setup", 0, -1, begin.wall, mark.wall);
+    sdata->stats.allocated_bytes += allocated_bytes;
+    sdata->stats.max_allocated_bytes = MAX(sdata->stats.max_allocated_bytes, allocated_bytes);
+
     if (sdata->num_bitmap_primes > 0)
     {
         uint8_t *line = sdata->lines[0];
@@ -851,6 +930,10 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
                 printf("bitmap sieve took %1.6f seconds\n", t);
             }
         }
+
+        t0 = mark.wall;
+        soe_phase_lap(&sdata->stats.bitmap_sieve, &mark, NULL);
+        soe_trace_span(sdata, "bitmap sieve", 0, -1, t0, mark.wall);
     }
 
     //printf("commencing sieve from %lu - %lu (originally %lu - %lu)\n",
@@ -861,6 +944,10 @@ uint64_t spSOE(soe_staticdata_t *sdata, mpz_t *offset,
 
 	//finish up
 	finalize_sieve(sdata, thread_data, count, primes);
+    sdata->stats.num_sieves++;
+
+    soe_clock(&mark, NULL);
+    soe_trace_span(sdata, "spSOE", 0, -1, begin.wall, mark.wall);
 
 	return sdata->num_found;
 }
@@ -887,13 +974,15 @@ void do_soe_sieving(soe_staticdata_t *sdata, thread_soedata_t *thread_data, int
 
     udata.sdata = sdata;
     udata.ddata = thread_data;
-    tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, &sieve_sync,
+    tpool_data = tpool_setup(sdata->THREADS, &sieve_start, &sieve_stop, &sieve_sync,
         &sieve_dispatch, &udata);
 
+    soe_progress_begin(sdata, SOE_PROGRESS_SIEVE, sdata->numclasses);
     if (sdata->THREADS == 1)
     {
         thread_soedata_t *t = &thread_data[0];
         sdata->sync_count = 0;
+        sieve_start(tpool_data);
         for (i = 0; i < sdata->numclasses; i++)
         {
             t->current_line = i;
@@ -901,6 +990,7 @@ void do_soe_sieving(soe_staticdata_t *sdata, thread_soedata_t *thread_data, int
             sieve_sync(tpool_data);
             sdata->sync_count++;
         }
+        sieve_stop(tpool_data);
     }
     else
     {
@@ -908,6 +998,7 @@ void do_soe_sieving(soe_staticdata_t *sdata, thread_soedata_t *thread_data, int
         tpool_add_work_fcn(tpool_data, &sieve_work_fcn);
         tpool_go(tpool_data);
     }
+    soe_progress_end(sdata, SOE_PROGRESS_SIEVE);
 
 	if (sdata->VFLAG > 1)
 	{
@@ -931,6 +1022,8 @@ void finalize_sieve(soe_staticdata_t *sdata,
 	thread_soedata_t *thread_data, int count, uint64_t *primes)
 {
 	uint64_t i, j = 0, num_p = sdata->num_found;
+	soe_phase_t mark;
+	double t0;
 
 	if (count)
 	{
@@ -978,6 +1071,10 @@ void finalize_sieve(soe_staticdata_t *sdata,
             {
                 //printf("%u ", sdata->sieve_p[i]);
                 num_p++;
+                if (sdata->do_reduce)
+                {
+                    reduction_add_prime(&sdata->reduction, (uint64_t)sdata->sieve_p[i]);
+                }
             }
 			i++;
 		}
@@ -1015,18 +1112,27 @@ void finalize_sieve(soe_staticdata_t *sdata,
 			sdata->min_sieved_val += ui_offset;
 
 		// PRIMES is already sized appropriately by the wrapper
-		// load in the sieve primes that we need
+		// load in the sieve primes that we need.  a bitmap only
+		// has slots for the lines.
 		j = 0;
 		i = 0;
-		while (((uint64_t)sdata->sieve_p[i] < sdata->min_sieved_val) && (i < sdata->bucket_start_id))
+		while (((uint64_t)sdata->sieve_p[i] < sdata->min_sieved_val) && (i < sdata->bucket_start_id) &&
+			(sdata->bitmap == NULL))
 		{
 			if (sdata->sieve_p[i] >= (sdata->orig_llimit + ui_offset))					
 				primes[j++] = (uint64_t)sdata->sieve_p[i];
 			i++;
 		}
 
-		//and then the primes in the lines
-		num_p = primes_from_lineflags(sdata, thread_data, j, primes);
+		//and then the primes in the lines, or the lines themselves
+		soe_clock(&mark, NULL);
+		if (sdata->bitmap != NULL)
+			num_p = bitmap_from_lineflags(sdata, sdata->bitmap);
+		else
+			num_p = primes_from_lineflags(sdata, thread_data, j, primes);
+		t0 = mark.wall;
+		soe_phase_lap(&sdata->stats.extract, &mark, NULL);
+		soe_trace_span(sdata, "extract", 0, -1, t0, mark.wall);
 
 	}
 
@@ -1068,7 +1174,9 @@ void finalize_sieve(soe_staticdata_t *sdata,
         for (i = 0; i < sdata->numclasses; i++)
         {
             //sdata->lines[i] = sdata->lines[0] + i * numlinebytes;
-            align_free(sdata->lines[i]);
+            // lines handed over to a bitmap are NULL
+            if (sdata->lines[i] != NULL)
+                align_free(sdata->lines[i]);
         }
         align_free(sdata->lines);
 	}
@@ -64,6 +64,195 @@ typedef struct
 	uint8_t eacc;			// accumulated error
 } soe_bitmap_p;
 
+typedef struct
+{
+	uint64_t count;		// number of primes folded in
+	uint64_t sum_lo;	// sum of primes, as a 128-bit value (low word)
+	uint64_t sum_hi;	// sum of primes, as a 128-bit value (high word)
+	uint64_t sumsq;		// sum of the squares of primes, mod 2^64
+	uint64_t xorsum;	// xor of all primes
+} soe_reduction_t;
+
+// most distinct prime factors any 64-bit integer can have
+#define SOE_MAX_FACTORS 15
+
+// default spacing of pi(x) checkpoints written by soe_pi_table_build
+#define SOE_PI_TABLE_STEP 1000000000ULL
+
+enum soe_factor_mode {
+    SOE_FACTOR_SPF,         // record the smallest prime factor only
+    SOE_FACTOR_FULL,        // record complete factorizations
+    SOE_FACTOR_MULT,        // compute multiplicative functions
+    SOE_FACTOR_LOGP         // accumulate prime logs for smoothness detection
+};
+
+typedef struct
+{
+	uint64_t lowlimit;		// first integer in the block
+	uint32_t num;			// number of integers in the block
+	int tindex;				// thread that sieved the block
+	uint32_t *spf;			// smallest prime factor <= sqrt(highlimit), or 0 if none
+	uint8_t *nfactors;		// SOE_FACTOR_FULL: number of distinct prime factors
+	uint64_t *factors;		// SOE_FACTOR_FULL: SOE_MAX_FACTORS primes per integer
+	uint8_t *exponents;		// SOE_FACTOR_FULL: SOE_MAX_FACTORS exponents per integer
+	int8_t *mu;				// SOE_FACTOR_MULT: mobius function; squarefree iff nonzero
+	uint64_t *phi;			// SOE_FACTOR_MULT: euler totient
+	uint32_t *sigma0;		// SOE_FACTOR_MULT: number of divisors
+	uint8_t *logp;			// SOE_FACTOR_LOGP: sum of floor(log2 p) over p and p^2 dividing
+} soe_factor_block_t;
+
+// called once per sieved block, from the thread that sieved it.
+// blocks are not delivered in order.
+typedef void (*soe_factor_fcn_t)(soe_factor_block_t* block, void* user_data);
+
+// progress of a long running phase, see soe_set_progress.  Called from a
+// reporter thread at a fixed interval, never from the sieve threads.
+enum soe_progress_phase {
+    SOE_PROGRESS_NONE,
+    SOE_PROGRESS_SIEVE,     // residue class lines sieved
+    SOE_PROGRESS_EXTRACT,   // line bytes turned into primes
+    SOE_PROGRESS_PRP,       // candidates PRP tested
+    SOE_PROGRESS_DEEP       // deep primes (past the sieve primes) covered
+};
+typedef void (*soe_progress_fcn_t)(int phase, uint64_t done, uint64_t total, void* user_data);
+struct soe_progress;
+
+// survivors of a sieve, packed one bit per wheel slot.  Bit b of line c
+// is the value base + b * prodN + rclass[c].  Only values in
+// [base + lo, base + hi] are ever set.
+typedef struct
+{
+	uint32_t prodN;
+	uint32_t numclasses;
+	uint32_t *rclass;
+	uint64_t numlinebytes;
+	uint8_t **lines;
+	mpz_t base;
+	uint64_t lo;
+	uint64_t hi;
+	uint64_t num;			// number of set bits
+} soe_bitmap_t;
+
+// formats for PRIMES_TO_FILE; 0 and 1 keep their old meanings
+enum soe_output_format {
+    SOE_OUTPUT_NONE,        // no file
+    SOE_OUTPUT_TEXT,        // primes.dat: decimal, one per line
+    SOE_OUTPUT_U64,         // primes.u64: raw 64-bit values
+    SOE_OUTPUT_GAP32,       // primes.g32: first prime, then 32-bit gaps
+    SOE_OUTPUT_VARINT       // primes.var: first prime, then varint gaps / 2
+};
+
+// how the avx2 32k line sieve clears flags, see soe_staticdata_t.bit_update.
+// the best one depends on the compiler and the cpu.
+enum soe_bit_update {
+    SOE_BITS_AUTO,          // the default for this compiler
+    SOE_BITMASKS8,          // and bytes with a mask table
+    SOE_BITMASKS32,         // and 32-bit words with a mask table
+    SOE_BITLOGIC8,          // and bytes with a computed mask
+    SOE_BITLOGIC32,         // and 32-bit words with a computed mask
+    SOE_NUM_BIT_UPDATES
+};
+
+// a prime list in a mapped file, see soe_staticdata_t.map_path
+typedef struct
+{
+	uint64_t *primes;
+	uint64_t bytes;
+#if defined(WIN32) || defined(_WIN64)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} soe_mapped_t;
+
+// a mapped prime archive written by soe_archive_build: every prime up to
+// limit, in gap-coded blocks with an index of each block's first prime
+// and the count of primes before it.
+typedef struct
+{
+	uint64_t limit;
+	uint64_t num_primes;
+	uint64_t num_blocks;
+	const uint8_t *map;
+	uint64_t size;
+	const uint8_t *index;
+#if defined(WIN32) || defined(_WIN64)
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+} soe_archive_t;
+
+// hardware events counted in the threaded phases when
+// soe_staticdata_t.perf_events is set (linux perf_event_open only)
+enum soe_perf_event {
+    SOE_PERF_CYCLES,
+    SOE_PERF_INSTRUCTIONS,
+    SOE_PERF_L1D_MISSES,        // L1 data cache read misses
+    SOE_PERF_LLC_REFERENCES,    // last level cache references: mostly L2 misses
+    SOE_PERF_LLC_MISSES,
+    SOE_PERF_BRANCH_MISSES,
+    SOE_PERF_NUM_EVENTS
+};
+
+// wall and cpu seconds spent in one phase of the sieve.  phases that run
+// inside the sieve threads add up the time of every thread.
+typedef struct
+{
+	double wall;
+	double cpu;
+	uint64_t events[SOE_PERF_NUM_EVENTS];
+} soe_phase_t;
+
+// running totals over every sieve done with one soe_staticdata_t,
+// see soe_get_stats and soe_reset_stats.
+typedef struct
+{
+	uint64_t num_sieves;
+	soe_phase_t setup;			// sizing and allocating the sieve
+	soe_phase_t roots;			// inverses of the sieve primes mod prodN
+	soe_phase_t offsets;		// first hit of each small/medium prime in a line
+	soe_phase_t presieve;		// block init and the smallest primes
+	soe_phase_t medium_sieve;	// primes sieved directly in each block
+	soe_phase_t bucket_fill;	// sorting large prime hits into buckets
+	soe_phase_t bucket_unload;	// applying the bucketed hits to each block
+	soe_phase_t bitmap_sieve;	// the largest primes, across all lines at once
+	soe_phase_t count;			// counting or reducing the sieved lines
+	soe_phase_t extract;		// turning the sieved lines into primes
+	uint64_t bucket_hits;		// hits stored in buckets...
+	uint64_t bucket_slots;		// ...and the space allocated for them
+	double bucket_max_fill;		// fullest bucket seen, as a fraction of its space
+	uint64_t allocated_bytes;	// sieve storage, summed over sieves
+	uint64_t max_allocated_bytes;	// most storage used by a single sieve
+	uint32_t perf_mask;			// bit (1 << soe_perf_event) set for events counted
+} soe_stats_t;
+
+// one span of the chrome trace kept when soe_staticdata_t.trace_path is set
+typedef struct
+{
+	const char *name;
+	int tid;					// 0 for the calling thread, sieve threads from 1
+	int line;					// residue class line, or -1
+	uint32_t blocks;			// blocks of the line covered, if a line span
+	double start;				// seconds since soe_init
+	double stop;
+	double split[3];			// presieve, medium sieve and bucket unload seconds
+} soe_span_t;
+
+// sieve parameters found by soe_autotune, or read from a profile.
+// zeros keep the built-in choices.  unroll and bucket_start only
+// apply at the block size they were tuned for.
+typedef struct
+{
+	uint32_t blocksize;			// SOEBLOCKSIZE
+	uint64_t wheel_bounds[3];	// range sizes above which 8, 48 and 480 residue classes are used
+	uint64_t wheel_max_low;		// 480 residue classes only below this lower limit
+	uint32_t unroll[3];			// where the 16x, 8x and 4x unrolled line sieve loops stop
+	uint32_t bucket_start;		// BUCKETSTARTI
+	int bit_update;				// enum soe_bit_update
+	uint32_t cpu;				// cpu features the profile was measured with
+} soe_tune_t;
+
 typedef struct
 {
     int VFLAG;
@@ -110,8 +299,29 @@ typedef struct
 	int **bitmap_ptrs;
 #endif
 	int only_count;
+	int do_reduce;
+	soe_reduction_t reduction;
 	mpz_t *offset;
 	int sieve_range;
+	int offset_mods_ready;		// lower_mod_prime already holds the offset residues
+	soe_bitmap_t *bitmap;		// if set, the sieved lines are handed over here
+	uint64_t *pi_table;			// pi(k * pi_table_step), see soe_pi_table_load
+	uint64_t pi_table_step;
+	uint64_t pi_table_num;
+	const char *map_path;		// if set, big prime lists are kept in files named after this
+	int map_output;				// set while soe_wrapper finds the list it returns
+	soe_mapped_t *mapped;		// lists living in mapped files, see soe_free_primes
+	int num_mapped;
+	soe_stats_t stats;			// see soe_get_stats
+	int perf_events;			// count hardware events into stats
+	int bit_update;				// enum soe_bit_update, used by get_numclasses
+	soe_tune_t tune;			// see soe_autotune
+	const char *trace_path;		// if set, soe_finalize writes a chrome trace here
+	soe_span_t *trace;
+	uint64_t trace_num;
+	uint64_t trace_alloc;
+	double trace_t0;
+	struct soe_progress *progress;	// shared by the thread copies of this struct
 	uint64_t min_sieved_val;
 
     // presieving stuff
@@ -137,6 +347,7 @@ typedef struct
     uint32_t FLAGSIZEm1;
     uint32_t FLAGBITS;
     uint32_t BUCKETSTARTI;
+    uint32_t unroll_stop[3];	// sieve prime indices ending the unrolled line sieve loops
 	int has_avx2;
 	int has_bmi2;
 	int has_bmi1;
@@ -173,14 +384,24 @@ typedef struct
     // presieving stuff
     uint32_t *presieve_scratch;
 
+    // this thread's share of the phase timings, merged by sieve_sync
+    soe_stats_t stats;
+    int perf_fd[SOE_PERF_NUM_EVENTS];   // -1 if not counting the event
+    int perf_leader;                    // group fd read for all events
+
 } soe_dynamicdata_t;
 
 typedef struct {
 	soe_dynamicdata_t ddata;
 	soe_staticdata_t sdata;
 	uint64_t linecount;
+	soe_reduction_t reduction;
 	uint32_t current_line;
 
+	// trace spans of the last line sieved, handed over by sieve_sync
+	soe_span_t spans[5];
+	int num_spans;
+
     int tindex;
     int tstartup;
 
@@ -243,10 +464,58 @@ extern soe_staticdata_t* soe_init(int vflag, int threads, int blocksize);
 extern void soe_finalize(soe_staticdata_t* sdata);
 extern uint64_t* soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
     int count, uint64_t* num_p, int PRIMES_TO_FILE, int PRIMES_TO_SCREEN);
+extern uint64_t soe_reduce(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+    soe_reduction_t* reduction);
 extern uint64_t* sieve_to_depth(soe_staticdata_t* sdata,
     mpz_t lowlimit, mpz_t highlimit, int count, int num_witnesses, 
     uint64_t sieve_limit, uint64_t* num_p,
     int PRIMES_TO_FILE, int PRIMES_TO_SCREEN);
+extern uint64_t* sieve_to_depth_smooth(soe_staticdata_t* sdata,
+    mpz_t lowlimit, mpz_t highlimit, uint64_t sieve_limit,
+    uint32_t threshold, uint64_t* num_found);
+extern uint64_t** sieve_to_depth_batch(soe_staticdata_t* sdata,
+    mpz_t* bases, uint64_t* widths, int num_windows, int num_witnesses,
+    uint64_t sieve_limit, uint64_t* num_p);
+extern soe_bitmap_t* sieve_to_depth_bitmap(soe_staticdata_t* sdata,
+    mpz_t lowlimit, mpz_t highlimit, uint64_t* num_p);
+extern uint64_t soe_bitmap_values(soe_bitmap_t* bm, uint64_t start, uint64_t stop,
+    uint64_t* values);
+extern int soe_bitmap_write(soe_bitmap_t* bm, const char* filename);
+extern soe_bitmap_t* soe_bitmap_read(const char* filename);
+extern void soe_bitmap_free(soe_bitmap_t* bm);
+extern void soe_free_primes(soe_staticdata_t* sdata, uint64_t* primes);
+extern void soe_get_stats(soe_staticdata_t* sdata, soe_stats_t* stats);
+extern void soe_reset_stats(soe_staticdata_t* sdata);
+extern void soe_print_stats(soe_staticdata_t* sdata);
+extern int soe_trace_write(soe_staticdata_t* sdata, const char* filename);
+extern void soe_set_progress(soe_staticdata_t* sdata, soe_progress_fcn_t fcn,
+    void* user_data, double interval);
+extern int soe_get_progress(soe_staticdata_t* sdata, uint64_t* done, uint64_t* total);
+extern int soe_autotune(soe_staticdata_t* sdata, const char* profile);
+extern int soe_tune_read(soe_tune_t* tune, const char* filename);
+extern int soe_tune_write(soe_tune_t* tune, const char* filename);
+extern const char* soe_output_filename(int format);
+extern uint64_t soe_write_primes(const char* filename, int format, uint64_t* primes,
+    uint64_t num, uint64_t lowlimit, uint64_t highlimit);
+extern uint64_t* soe_read_primes(const char* filename, int format, uint64_t* num);
+extern int soe_archive_build(soe_staticdata_t* sdata, const char* filename, uint64_t limit);
+extern soe_archive_t* soe_archive_open(const char* filename);
+extern void soe_archive_close(soe_archive_t* a);
+extern uint64_t soe_archive_count(soe_archive_t* a, soe_staticdata_t* sdata,
+    uint64_t lowlimit, uint64_t highlimit);
+extern uint64_t soe_archive_nth_prime(soe_archive_t* a, soe_staticdata_t* sdata, uint64_t n);
+extern uint64_t* soe_archive_primes(soe_archive_t* a, soe_staticdata_t* sdata,
+    uint64_t lowlimit, uint64_t highlimit, uint64_t* num_p);
+extern int soe_pi_table_build(soe_staticdata_t* sdata, const char* filename,
+    uint64_t limit, uint64_t step);
+extern int soe_pi_table_load(soe_staticdata_t* sdata, const char* filename);
+extern void soe_factor_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+    int mode, soe_factor_fcn_t fcn, void* user_data);
+extern uint32_t* soe_spf_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit);
+extern void soe_mult_range(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+    soe_factor_fcn_t fcn, void* user_data);
+extern int64_t soe_mertens(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit);
+extern uint64_t soe_squarefree_count(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit);
 
 
 #endif // #ifndef SOE_H
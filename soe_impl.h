@@ -52,6 +52,7 @@ extern "C" {
 #define _lead_zcnt64 __lzcnt64
 #define _trail_zcnt _tzcnt_u32
 #define _trail_zcnt64 _tzcnt_u64
+#define _popcount64 _mm_popcnt_u64
 #else
 #define _reset_lsb(x) ((x) &= ((x) - 1))
 #define _reset_lsb64(x) ((x) &= ((x) - 1))
@@ -87,12 +88,14 @@ __inline uint64_t _lead_zcnt64(uint64_t x)
 #define _lead_zcnt64 __builtin_clzll
 #define _trail_zcnt __builtin_ctzl
 #define _trail_zcnt64 __builtin_ctzll
+#define _popcount64 __builtin_popcountll
 #else
 #define _reset_lsb(x) ((x) &= ((x) - 1))
 #define _reset_lsb64(x) ((x) &= ((x) - 1))
 #define _lead_zcnt64 __builtin_clzll
 #define _trail_zcnt __builtin_ctzl
 #define _trail_zcnt64 __builtin_ctzll
+#define _popcount64 __builtin_popcountll
 
 #endif
 #elif defined(_MSC_VER)
@@ -132,6 +135,9 @@ __inline uint64_t _lead_zcnt64(uint64_t x)
 }
 #define _reset_lsb(x) ((x) &= ((x) - 1))
 #define _reset_lsb64(x) ((x) &= ((x) - 1))
+#ifdef USE_BMI2
+#define _popcount64 __popcnt64
+#endif
 //#endif
 
 #else
@@ -207,6 +213,80 @@ __inline uint64_t _trail_zcnt64(uint64_t x)
 
 #endif
 
+#ifndef _popcount64
+// no popcnt instruction is assumed here
+static __inline uint64_t _popcount64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+#endif
+
+// native 128-bit integers, where the compiler has them.  Offsets and
+// candidates below 2^128 use these instead of gmp on the hot paths.
+#if defined(__SIZEOF_INT128__) && !defined(NO_UINT128)
+#define HAVE_UINT128
+typedef unsigned __int128 uint128_t;
+
+static __inline int mpz_get_u128(mpz_t z, uint128_t *x)
+{
+    // returns 0 (and leaves x alone) if z is negative or too big
+    uint64_t w[2] = { 0, 0 };
+
+    if ((mpz_sgn(z) < 0) || (mpz_sizeinbase(z, 2) > 128))
+        return 0;
+
+    mpz_export(w, NULL, -1, sizeof(uint64_t), 0, 0, z);
+    *x = ((uint128_t)w[1] << 64) | w[0];
+    return 1;
+}
+
+static __inline uint32_t u128_mod_u32(uint128_t n, uint32_t p)
+{
+    // three 64-bit by 32-bit reductions; each partial remainder is
+    // less than p and so fits with the next 32 bits of n.
+    uint64_t r = (uint64_t)(n >> 64) % p;
+    r = ((r << 32) | ((uint64_t)(n >> 32) & 0xffffffff)) % p;
+    r = ((r << 32) | ((uint64_t)n & 0xffffffff)) % p;
+    return (uint32_t)r;
+}
+
+// BPSW probable prime tests, prp.c
+int bpsw_u64(uint64_t n);
+int bpsw_u128(uint128_t n);
+#endif
+
+// little endian fields of the binary file formats (output.c,
+// archive.c, pitable.c), whatever the byte order of the machine
+static __inline uint32_t get_u32(const uint8_t *b)
+{
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) |
+        ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static __inline uint64_t get_u64(const uint8_t *b)
+{
+    return (uint64_t)get_u32(b) | ((uint64_t)get_u32(b + 4) << 32);
+}
+
+static __inline void put_u32(uint8_t *b, uint32_t x)
+{
+    b[0] = (uint8_t)x;
+    b[1] = (uint8_t)(x >> 8);
+    b[2] = (uint8_t)(x >> 16);
+    b[3] = (uint8_t)(x >> 24);
+    return;
+}
+
+static __inline void put_u64(uint8_t *b, uint64_t x)
+{
+    put_u32(b, (uint32_t)x);
+    put_u32(b + 4, (uint32_t)(x >> 32));
+    return;
+}
+
 #ifdef USE_AVX2
 
 #ifdef USE_AVX512F
@@ -227,7 +307,10 @@ extern ALIGNED_MEM uint32_t presieve_p1[32];
 
 // thread ready sieving functions
 void sieve_line(thread_soedata_t* thread_data);
-void sieve_line_avx2_32k(thread_soedata_t* thread_data);
+void sieve_line_avx2_32k_bitmasks8(thread_soedata_t* thread_data);
+void sieve_line_avx2_32k_bitmasks32(thread_soedata_t* thread_data);
+void sieve_line_avx2_32k_bitlogic8(thread_soedata_t* thread_data);
+void sieve_line_avx2_32k_bitlogic32(thread_soedata_t* thread_data);
 void sieve_line_avx2_64k(thread_soedata_t* thread_data);
 void sieve_line_avx2_128k(thread_soedata_t* thread_data);
 void sieve_line_avx2_256k(thread_soedata_t* thread_data);
@@ -241,10 +324,72 @@ void sieve_line_avx512_512k(thread_soedata_t* thread_data);
 
 uint64_t count_line(soe_staticdata_t* sdata, uint32_t current_line);
 void count_line_special(thread_soedata_t* thread_data);
+uint64_t reduce_line(soe_staticdata_t* sdata, uint32_t current_line, soe_reduction_t* r);
+void reduction_add_prime(soe_reduction_t* r, uint64_t prime);
+void reduction_merge(soe_reduction_t* dest, soe_reduction_t* src);
 uint32_t compute_32_bytes(soe_staticdata_t* sdata,
     uint32_t pcount, uint64_t* primes, uint64_t byte_offset);
 uint64_t primes_from_lineflags(soe_staticdata_t* sdata, thread_soedata_t* thread_data,
     uint32_t start_count, uint64_t* primes);
+uint64_t bitmap_from_lineflags(soe_staticdata_t* sdata, soe_bitmap_t* bm);
+void bitmap_clip(soe_bitmap_t* bm, uint64_t lo, uint64_t hi);
+uint64_t* map_primes_alloc(soe_staticdata_t* sdata, uint64_t num);
+typedef struct soe_writer soe_writer_t;
+
+// phase progress, counted by the workers and reported by its own thread
+// (progress.c).  Counts for a phase other than the one being reported
+// are dropped, which keeps the sieving done inside a PRP run out of it.
+struct soe_progress
+{
+    volatile int phase;
+    volatile uint64_t done;
+    volatile uint64_t total;
+    soe_progress_fcn_t fcn;
+    void* user_data;
+    double interval;
+    int running;
+#if defined(WIN32) || defined(_WIN64)
+    HANDLE thread_id;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_t thread_id;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+static __inline void soe_progress_add(soe_staticdata_t* sdata, int phase, uint64_t n)
+{
+    struct soe_progress* p = sdata->progress;
+
+    if (p->phase == phase)
+    {
+#if defined(_MSC_VER)
+        InterlockedExchangeAdd64((volatile LONG64*)&p->done, (LONG64)n);
+#else
+        __atomic_fetch_add(&p->done, n, __ATOMIC_RELAXED);
+#endif
+    }
+}
+
+struct soe_progress* soe_progress_init(void);
+void soe_progress_free(struct soe_progress* p);
+void soe_progress_begin(soe_staticdata_t* sdata, int phase, uint64_t total);
+void soe_progress_total(soe_staticdata_t* sdata, int phase, uint64_t total);
+void soe_progress_end(soe_staticdata_t* sdata, int phase);
+soe_writer_t* soe_writer_open(const char* filename, int format, uint64_t lowlimit, uint64_t highlimit);
+void soe_writer_primes(soe_writer_t* w, soe_staticdata_t* sdata, uint64_t* primes, uint64_t num);
+void soe_writer_decimal(soe_writer_t* w, soe_staticdata_t* sdata, mpz_t* base,
+    uint64_t* values, uint64_t num, uint64_t minval, uint64_t maxval);
+void soe_print_decimal(soe_staticdata_t* sdata, mpz_t* base, uint64_t* values,
+    uint64_t num, uint64_t minval, uint64_t maxval, char sep);
+uint64_t soe_writer_close(soe_writer_t* w, const char* filename);
+int format_decimal_width(mpz_t* base, uint64_t maxval);
+uint64_t format_decimal(soe_staticdata_t* sdata, mpz_t* base, uint64_t* values,
+    uint64_t num, uint64_t minval, uint64_t maxval, char sep, char* out, size_t* len);
+int pi_table_covers(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit);
+uint64_t pi_table_count(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit);
 void get_offsets(thread_soedata_t* thread_data);
 void getRoots(soe_staticdata_t* sdata, thread_soedata_t* thread_data);
 void stop_soe_worker_thread(thread_soedata_t* t);
@@ -263,6 +408,19 @@ uint64_t* GetPRIMESRange(soe_staticdata_t* sdata,
     mpz_t* offset, uint64_t lowlimit, uint64_t highlimit, uint64_t* num_p);
 uint64_t spSOE(soe_staticdata_t* sdata, mpz_t* offset,
     uint64_t lowlimit, uint64_t* highlimit, int count, uint64_t* primes);
+void extend_sieve_primes(soe_staticdata_t* sdata, uint64_t highlimit);
+void factor_range(soe_staticdata_t* sdata, mpz_t* offset, uint64_t lowlimit, uint64_t highlimit,
+	uint64_t pbound, int mode, soe_factor_fcn_t fcn, void* user_data);
+
+// offsets at least this many bits are reduced modulo the sieve
+// primes with a remainder tree rather than one division per prime.
+#define REMTREE_MIN_BITS 10000
+void remtree_mod_primes(soe_staticdata_t* sdata, mpz_t n,
+	const uint32_t* moduli, uint32_t num, uint32_t* residues);
+void remtree_mod_primes64(mpz_t n, const uint64_t* moduli, uint32_t num,
+	uint64_t* residues);
+uint64_t deep_sieve_values(soe_staticdata_t* sdata, mpz_t* offset,
+	uint64_t* values, uint64_t num, uint64_t plo, uint64_t phi);
 
 // misc and helper functions
 uint64_t estimate_primes_in_range(uint64_t lowlimit, uint64_t highlimit);
@@ -273,6 +431,21 @@ uint64_t init_sieve(soe_staticdata_t* sdata);
 void set_bucket_depth(soe_staticdata_t* sdata);
 uint64_t alloc_threaddata(soe_staticdata_t* sdata, thread_soedata_t* thread_data);
 void do_soe_sieving(soe_staticdata_t* sdata, thread_soedata_t* thread_data, int count);
+uint64_t mpz_mod_u64(mpz_t n, uint64_t m, mpz_t tmpz);
+
+// phase timing for soe_stats_t.  Given a thread's ddata, the cpu time
+// and hardware events are those of the calling thread; with NULL the cpu
+// time is the whole process's and no events are read.
+void soe_clock(soe_phase_t* now, soe_dynamicdata_t* ddata);
+void soe_phase_lap(soe_phase_t* phase, soe_phase_t* mark, soe_dynamicdata_t* ddata);
+void soe_perf_open(soe_staticdata_t* sdata, soe_dynamicdata_t* ddata);
+void soe_perf_close(soe_dynamicdata_t* ddata);
+void soe_trace_span(soe_staticdata_t* sdata, const char* name, int tid, int line,
+    double start, double stop);
+void soe_trace_line(soe_staticdata_t* sdata, thread_soedata_t* t, int tid,
+    soe_stats_t* before, double start);
+void soe_trace_add(soe_staticdata_t* sdata, soe_span_t* spans, int num);
+void soe_stats_merge(soe_stats_t* dst, soe_stats_t* src);
 void finalize_sieve(soe_staticdata_t* sdata,
     thread_soedata_t* thread_data, int count, uint64_t* primes);
 
@@ -295,6 +468,7 @@ uint32_t compute_8_bytes_bmi2(soe_staticdata_t* sdata,
 extern uint32_t(*compute_8_bytes_ptr)(soe_staticdata_t*, uint32_t, uint64_t*, uint64_t);
 extern void (*pre_sieve_ptr)(soe_dynamicdata_t*, soe_staticdata_t*, uint8_t*);
 extern void(*sieve_line_ptr)(thread_soedata_t*);
+extern void(*sieve_line_avx2_32k_ptrs[SOE_NUM_BIT_UPDATES])(thread_soedata_t*);
 
 
 
@@ -27,6 +27,7 @@ SOFTWARE.
 #include <immintrin.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <math.h>
 #include "soe_impl.h"
@@ -300,15 +301,39 @@ uint64_t gcd_1(uint64_t x, uint64_t y)
     return a;
 }
 
+static uint32_t sieve_p_index(soe_staticdata_t *sdata, uint64_t bound)
+{
+    // the number of sieve primes no larger than bound
+    uint32_t lo = 0, hi = sdata->num_sp;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (sdata->sieve_p[mid] <= bound)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sdata)
 {
 	uint64_t numclasses, prodN, startprime;
+    uint64_t bound8 = 100000000ULL;
+    uint64_t bound48 = 4000000000ULL;
+    uint64_t bound480 = 40000000000ULL;
+    uint64_t maxlow480 = 100000000000000ULL;
+    int i;
 
     sdata->use_monty = 0;
 
 	sieve_line_ptr = &sieve_line;
     sdata->FLAGBITS = 18;
     sdata->BUCKETSTARTI = 33336;
+    sdata->unroll_stop[0] = 1901;
+    sdata->unroll_stop[1] = 3513;
+    sdata->unroll_stop[2] = 6543;
 
     sdata->FLAGSIZE = 8 * sdata->SOEBLOCKSIZE;
     sdata->FLAGSIZEm1 = sdata->FLAGSIZE - 1;
@@ -326,7 +351,11 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
 
         if (sdata->has_avx2)
         {
-            sieve_line_ptr = &sieve_line_avx2_32k;
+            if ((sdata->bit_update < 0) || (sdata->bit_update >= SOE_NUM_BIT_UPDATES))
+            {
+                sdata->bit_update = SOE_BITS_AUTO;
+            }
+            sieve_line_ptr = sieve_line_avx2_32k_ptrs[sdata->bit_update];
         }
 #endif
         break;
@@ -342,6 +371,9 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         if (sdata->has_avx512f)
         {
             sieve_line_ptr = &sieve_line_avx512_128k;
+            sdata->unroll_stop[0] = 6540;
+            sdata->unroll_stop[1] = 12249;
+            sdata->unroll_stop[2] = 22998;
         }
 #elif defined(USE_AVX2)
         if (sdata->has_avx2)
@@ -356,6 +388,9 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         if (sdata->has_avx512f)
         {
             sieve_line_ptr = &sieve_line_avx512_256k;
+            sdata->unroll_stop[0] = 12249;
+            sdata->unroll_stop[1] = 22998;
+            sdata->unroll_stop[2] = 43388;
         }
 
 #elif defined(USE_AVX2)
@@ -370,6 +405,9 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         if (sdata->has_avx512f)
         {
             sieve_line_ptr = &sieve_line_avx512_512k;
+            sdata->unroll_stop[0] = 22998;
+            sdata->unroll_stop[1] = 43388;
+            sdata->unroll_stop[2] = 82023;
         }
 
 #elif defined(USE_AVX2)
@@ -389,13 +427,54 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         exit(1);
     }
 
+	// tuned values, see soe_autotune.  keep them to what the line sieves
+	// can handle: the unrolled loops need primes hitting a block at least
+	// 16, 8 or 4 times, and bucket sieved primes must hit it at most once.
+	// buckets also start on a multiple of 8 for the vectorized offsets.
+	if (sdata->tune.blocksize == sdata->SOEBLOCKSIZE)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			if (sdata->tune.unroll[i] > 0)
+			{
+				sdata->unroll_stop[i] = MIN(sdata->tune.unroll[i],
+					sieve_p_index(sdata, sdata->FLAGSIZE / ((16 >> i) - 1)));
+			}
+		}
+
+		if (sdata->tune.bucket_start > 0)
+		{
+			sdata->BUCKETSTARTI = MAX(sdata->tune.bucket_start,
+				sieve_p_index(sdata, sdata->FLAGSIZE) + 7) & (uint32_t)(~7);
+		}
+	}
+
+	if (sdata->tune.wheel_bounds[0] > 0)
+	{
+		bound8 = sdata->tune.wheel_bounds[0];
+	}
+	if (sdata->tune.wheel_bounds[1] > 0)
+	{
+		bound48 = sdata->tune.wheel_bounds[1];
+	}
+	if (sdata->tune.wheel_bounds[2] > 0)
+	{
+		bound480 = sdata->tune.wheel_bounds[2];
+	}
+	if (sdata->tune.wheel_max_low > 0)
+	{
+		maxlow480 = sdata->tune.wheel_max_low;
+	}
+
 	//printf("Sieve Parameters:\nBLOCKSIZE = %u\nFLAGSIZE = %u\nFLAGBITS = %u\nBUCKETSTARTI = %u\n",
 	//	SOEBLOCKSIZE, FLAGSIZE, FLAGBITS, BUCKETSTARTI);
 
 	//more efficient to sieve using mod210 when the range is big
-	if ((highlimit - lowlimit) > 40000000000ULL)
+	if ((highlimit - lowlimit) > bound480)
 	{
-        if (lowlimit < 100000000000000ULL)
+        // primes are pulled out of the lines with queues for at most 48
+        // residue classes, so the biggest wheel is only for counting.
+        if ((lowlimit < maxlow480) && sdata->only_count)
         {
             numclasses = 480;
             prodN = 2310;
@@ -415,7 +494,7 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         }
 #endif
 	}	
-	else if ((highlimit - lowlimit) > 4000000000ULL)
+	else if ((highlimit - lowlimit) > bound48)
 	{
         numclasses = 48;
         prodN = 210;
@@ -428,7 +507,7 @@ void get_numclasses(uint64_t highlimit, uint64_t lowlimit, soe_staticdata_t *sda
         }
 #endif
 	}
-	else if ((highlimit - lowlimit) > 100000000)
+	else if ((highlimit - lowlimit) > bound8)
 	{
 		numclasses=8;
 		prodN=30;
@@ -533,6 +612,7 @@ int check_input(uint64_t highlimit, uint64_t lowlimit, uint32_t num_sp, uint32_t
 		
 		sdata->offset = NULL;
 		sdata->sieve_range = 0;
+		sdata->offset_mods_ready = 0;
 	}
 	else
 	{
@@ -565,6 +645,7 @@ int check_input(uint64_t highlimit, uint64_t lowlimit, uint32_t num_sp, uint32_t
 		sdata->offset = offset;
 		mpz_clear(tmpz);
 		sdata->sieve_range = 1;
+		sdata->offset_mods_ready = 0;
 	}
 
 	return 0;
@@ -1025,6 +1106,9 @@ uint64_t alloc_threaddata(soe_staticdata_t *sdata, thread_soedata_t *thread_data
 	{
 		thread_soedata_t *thread = thread_data + i;
 
+        memset(&thread->ddata.stats, 0, sizeof(soe_stats_t));
+        thread->ddata.perf_leader = -1;
+
         // presieving scratch space
         thread->ddata.presieve_scratch = (uint32_t *)xmalloc_align(16 * sizeof(uint32_t));
 
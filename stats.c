@@ -0,0 +1,362 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+#if defined(WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#define SOE_HAVE_PERF
+#endif
+
+// Phase timings and bucket usage, gathered on every call to spSOE.
+// Serial phases are timed by the calling thread against the process cpu
+// clock.  Phases inside sieve_line and count_line are timed per thread
+// into thread_soedata_t.ddata.stats and folded into sdata->stats by
+// sieve_sync, so their wall times are thread-seconds.  With
+// sdata->perf_events set those phases also count hardware events, using
+// a perf_event_open group per sieve thread.
+
+static const char *perf_names[SOE_PERF_NUM_EVENTS] = {
+    "cycles", "instr", "L1D miss", "LLC ref", "LLC miss", "br miss" };
+
+#if defined(WIN32) || defined(_WIN64)
+static double filetime_seconds(FILETIME *ft)
+{
+    ULARGE_INTEGER t;
+
+    t.LowPart = ft->dwLowDateTime;
+    t.HighPart = ft->dwHighDateTime;
+    return (double)t.QuadPart * 1e-7;
+}
+#endif
+
+#ifdef SOE_HAVE_PERF
+static int perf_open_event(int e, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (e)
+    {
+    case SOE_PERF_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case SOE_PERF_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case SOE_PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case SOE_PERF_LLC_REFERENCES:
+        attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+        break;
+    case SOE_PERF_LLC_MISSES:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    default:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    attr.read_format = PERF_FORMAT_GROUP;
+    // user space only, which is all an unprivileged process may count
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // pid 0, cpu -1: the calling thread on whatever cpu it runs
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+// start counting events for the calling thread.  Called by each sieve
+// thread before it takes any work, since counters follow the thread
+// that opened them.  Events the cpu or kernel won't count are left out.
+void soe_perf_open(soe_staticdata_t *sdata, soe_dynamicdata_t *ddata)
+{
+    int i;
+
+    ddata->perf_leader = -1;
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        ddata->perf_fd[i] = -1;
+    }
+
+    if (sdata->perf_events == 0)
+    {
+        return;
+    }
+
+#ifdef SOE_HAVE_PERF
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        ddata->perf_fd[i] = perf_open_event(i, ddata->perf_leader);
+        if (ddata->perf_fd[i] < 0)
+        {
+            if (sdata->VFLAG > 1)
+            {
+                printf("can't count %s: %s\n", perf_names[i], strerror(errno));
+            }
+            continue;
+        }
+
+        if (ddata->perf_leader < 0)
+        {
+            ddata->perf_leader = ddata->perf_fd[i];
+        }
+        ddata->stats.perf_mask |= (1 << i);
+    }
+#else
+    if (sdata->VFLAG > 1)
+    {
+        printf("hardware event counters are not supported on this platform\n");
+    }
+#endif
+
+    return;
+}
+
+void soe_perf_close(soe_dynamicdata_t *ddata)
+{
+    int i;
+
+    for (i = SOE_PERF_NUM_EVENTS - 1; i >= 0; i--)
+    {
+#ifdef SOE_HAVE_PERF
+        if (ddata->perf_fd[i] >= 0)
+        {
+            close(ddata->perf_fd[i]);
+        }
+#endif
+        ddata->perf_fd[i] = -1;
+    }
+    ddata->perf_leader = -1;
+
+    return;
+}
+
+static void perf_read(soe_dynamicdata_t *ddata, uint64_t *events)
+{
+    memset(events, 0, SOE_PERF_NUM_EVENTS * sizeof(uint64_t));
+
+#ifdef SOE_HAVE_PERF
+    if ((ddata != NULL) && (ddata->perf_leader >= 0))
+    {
+        // the group reads as a count followed by one value per member,
+        // in the order they were opened
+        uint64_t buf[1 + SOE_PERF_NUM_EVENTS];
+        int i, j;
+
+        if (read(ddata->perf_leader, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t))
+        {
+            return;
+        }
+
+        for (i = 0, j = 1; (i < SOE_PERF_NUM_EVENTS) && (j <= buf[0]); i++)
+        {
+            if (ddata->perf_fd[i] >= 0)
+            {
+                events[i] = buf[j++];
+            }
+        }
+    }
+#endif
+
+    return;
+}
+
+void soe_clock(soe_phase_t *now, soe_dynamicdata_t *ddata)
+{
+#if defined(WIN32) || defined(_WIN64)
+    LARGE_INTEGER count, freq;
+    FILETIME create, exit, kernel, user;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    now->wall = (double)count.QuadPart / (double)freq.QuadPart;
+
+    if (ddata != NULL)
+        GetThreadTimes(GetCurrentThread(), &create, &exit, &kernel, &user);
+    else
+        GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user);
+    now->cpu = filetime_seconds(&kernel) + filetime_seconds(&user);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now->wall = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+    clock_gettime((ddata != NULL) ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &ts);
+    now->cpu = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+
+    perf_read(ddata, now->events);
+
+    return;
+}
+
+// add the time and events since mark to phase, and move mark up to now
+void soe_phase_lap(soe_phase_t *phase, soe_phase_t *mark, soe_dynamicdata_t *ddata)
+{
+    soe_phase_t now;
+    int i;
+
+    soe_clock(&now, ddata);
+    phase->wall += now.wall - mark->wall;
+    phase->cpu += now.cpu - mark->cpu;
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        phase->events[i] += now.events[i] - mark->events[i];
+    }
+    *mark = now;
+
+    return;
+}
+
+static void phase_merge(soe_phase_t *dst, soe_phase_t *src)
+{
+    int i;
+
+    dst->wall += src->wall;
+    dst->cpu += src->cpu;
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        dst->events[i] += src->events[i];
+    }
+    return;
+}
+
+void soe_stats_merge(soe_stats_t *dst, soe_stats_t *src)
+{
+    dst->num_sieves += src->num_sieves;
+    phase_merge(&dst->setup, &src->setup);
+    phase_merge(&dst->roots, &src->roots);
+    phase_merge(&dst->offsets, &src->offsets);
+    phase_merge(&dst->presieve, &src->presieve);
+    phase_merge(&dst->medium_sieve, &src->medium_sieve);
+    phase_merge(&dst->bucket_fill, &src->bucket_fill);
+    phase_merge(&dst->bucket_unload, &src->bucket_unload);
+    phase_merge(&dst->bitmap_sieve, &src->bitmap_sieve);
+    phase_merge(&dst->count, &src->count);
+    phase_merge(&dst->extract, &src->extract);
+    dst->bucket_hits += src->bucket_hits;
+    dst->bucket_slots += src->bucket_slots;
+    dst->bucket_max_fill = MAX(dst->bucket_max_fill, src->bucket_max_fill);
+    dst->allocated_bytes += src->allocated_bytes;
+    dst->max_allocated_bytes = MAX(dst->max_allocated_bytes, src->max_allocated_bytes);
+    dst->perf_mask |= src->perf_mask;
+    return;
+}
+
+// copy out the totals since soe_init or the last soe_reset_stats.  A
+// caller wanting the cost of one call resets first, or takes the
+// difference of two snapshots.
+void soe_get_stats(soe_staticdata_t *sdata, soe_stats_t *stats)
+{
+    memcpy(stats, &sdata->stats, sizeof(soe_stats_t));
+    return;
+}
+
+void soe_reset_stats(soe_staticdata_t *sdata)
+{
+    memset(&sdata->stats, 0, sizeof(soe_stats_t));
+    return;
+}
+
+static void print_phase(const char *name, soe_phase_t *p, uint32_t mask)
+{
+    int i;
+
+    printf("%-14s %10.4f %10.4f", name, p->wall, p->cpu);
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        if (mask & (1 << i))
+        {
+            printf(" %14" PRIu64 "", p->events[i]);
+        }
+    }
+    printf("\n");
+    return;
+}
+
+void soe_print_stats(soe_staticdata_t *sdata)
+{
+    soe_stats_t *s = &sdata->stats;
+    int i;
+
+    printf("%-14s %10s %10s", "phase", "wall (s)", "cpu (s)");
+    for (i = 0; i < SOE_PERF_NUM_EVENTS; i++)
+    {
+        if (s->perf_mask & (1 << i))
+        {
+            printf(" %14s", perf_names[i]);
+        }
+    }
+    printf("\n");
+
+    print_phase("setup", &s->setup, s->perf_mask);
+    print_phase("roots", &s->roots, s->perf_mask);
+    print_phase("offsets", &s->offsets, s->perf_mask);
+    print_phase("presieve", &s->presieve, s->perf_mask);
+    print_phase("medium sieve", &s->medium_sieve, s->perf_mask);
+    print_phase("bucket fill", &s->bucket_fill, s->perf_mask);
+    print_phase("bucket unload", &s->bucket_unload, s->perf_mask);
+    print_phase("bitmap sieve", &s->bitmap_sieve, s->perf_mask);
+    print_phase("count", &s->count, s->perf_mask);
+    print_phase("extract", &s->extract, s->perf_mask);
+
+    printf("sieves: %" PRIu64 ", storage: %" PRIu64 " bytes total, %" PRIu64 " max\n",
+        s->num_sieves, s->allocated_bytes, s->max_allocated_bytes);
+    if (s->bucket_slots > 0)
+    {
+        printf("buckets: %" PRIu64 " hits in %" PRIu64 " slots (%1.2f%%), fullest %1.2f%%\n",
+            s->bucket_hits, s->bucket_slots,
+            100.0 * (double)s->bucket_hits / (double)s->bucket_slots,
+            100.0 * s->bucket_max_fill);
+    }
+    if (sdata->perf_events && (s->perf_mask == 0))
+    {
+        printf("no hardware events could be counted\n");
+    }
+
+    return;
+}
@@ -0,0 +1,210 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+// A timeline of what each thread was doing, written as a Chrome trace
+// (chrome://tracing, ui.perfetto.dev).  Spans are kept in memory while
+// sdata->trace_path is set: the serial parts of spSOE on thread 0 and,
+// for each residue class line, the line and its offsets, bucket fill,
+// block sieve and count phases on the sieve thread that did it.  The
+// line phases are laid out from the soe_stats_t laps the thread already
+// takes, so tracing adds just one clock read and a copy per line.
+
+void soe_trace_add(soe_staticdata_t *sdata, soe_span_t *spans, int num)
+{
+    if (sdata->trace_num + num > sdata->trace_alloc)
+    {
+        sdata->trace_alloc = MAX(2 * sdata->trace_alloc, 4096);
+        sdata->trace = (soe_span_t *)xrealloc(sdata->trace,
+            sdata->trace_alloc * sizeof(soe_span_t));
+    }
+
+    memcpy(sdata->trace + sdata->trace_num, spans, num * sizeof(soe_span_t));
+    sdata->trace_num += num;
+
+    return;
+}
+
+// record a span of the calling thread; start and stop are soe_clock
+// wall times
+void soe_trace_span(soe_staticdata_t *sdata, const char *name, int tid, int line,
+    double start, double stop)
+{
+    soe_span_t s;
+
+    if (sdata->trace_path == NULL)
+    {
+        return;
+    }
+
+    memset(&s, 0, sizeof(soe_span_t));
+    s.name = name;
+    s.tid = tid;
+    s.line = line;
+    s.start = start - sdata->trace_t0;
+    s.stop = stop - sdata->trace_t0;
+    soe_trace_add(sdata, &s, 1);
+
+    return;
+}
+
+static soe_span_t *line_span(thread_soedata_t *t, const char *name, int tid,
+    double start, double stop)
+{
+    soe_span_t *s = &t->spans[t->num_spans++];
+
+    memset(s, 0, sizeof(soe_span_t));
+    s->name = name;
+    s->tid = tid;
+    s->line = t->current_line;
+    s->start = start;
+    s->stop = stop;
+
+    return s;
+}
+
+// spans for the line t just finished, given its phase totals and
+// wall clock from before it started.  They wait in t->spans until
+// sieve_sync hands them over with soe_trace_add.
+void soe_trace_line(soe_staticdata_t *sdata, thread_soedata_t *t, int tid,
+    soe_stats_t *before, double start)
+{
+    soe_stats_t *after = &t->ddata.stats;
+    soe_phase_t now;
+    soe_span_t *s;
+    double t0, t1;
+    double count = after->count.wall - before->count.wall;
+
+    soe_clock(&now, NULL);
+    start -= sdata->trace_t0;
+    now.wall -= sdata->trace_t0;
+
+    t->num_spans = 0;
+    s = line_span(t, "line", tid, start, now.wall);
+    s->blocks = (uint32_t)sdata->blocks;
+
+    t0 = start;
+    t1 = t0 + after->offsets.wall - before->offsets.wall;
+    line_span(t, "offsets", tid, t0, t1);
+
+    t0 = t1;
+    t1 = t0 + after->bucket_fill.wall - before->bucket_fill.wall;
+    if (t1 > t0)
+    {
+        line_span(t, "bucket fill", tid, t0, t1);
+    }
+
+    s = line_span(t, "sieve", tid, t1, now.wall - count);
+    s->blocks = (uint32_t)sdata->blocks;
+    s->split[0] = after->presieve.wall - before->presieve.wall;
+    s->split[1] = after->medium_sieve.wall - before->medium_sieve.wall;
+    s->split[2] = after->bucket_unload.wall - before->bucket_unload.wall;
+
+    if (count > 0)
+    {
+        line_span(t, "count", tid, now.wall - count, now.wall);
+    }
+
+    return;
+}
+
+// write the spans gathered so far in the Chrome trace event format.
+// returns 0 on success.
+int soe_trace_write(soe_staticdata_t *sdata, const char *filename)
+{
+    FILE *fid;
+    uint64_t i;
+    int tid, max_tid = 0;
+
+    fid = fopen(filename, "w");
+    if (fid == NULL)
+    {
+        printf("could not open %s for writing\n", filename);
+        return 1;
+    }
+
+    for (i = 0; i < sdata->trace_num; i++)
+    {
+        max_tid = MAX(max_tid, sdata->trace[i].tid);
+    }
+
+    fprintf(fid, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fid, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+        "\"args\":{\"name\":\"ysieve\"}}");
+    for (tid = 0; tid <= max_tid; tid++)
+    {
+        if (tid == 0)
+        {
+            fprintf(fid, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                "\"args\":{\"name\":\"main\"}}");
+        }
+        else
+        {
+            fprintf(fid, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"sieve %d\"}}", tid, tid - 1);
+        }
+    }
+
+    // timestamps and durations are in microseconds
+    for (i = 0; i < sdata->trace_num; i++)
+    {
+        soe_span_t *s = &sdata->trace[i];
+
+        fprintf(fid, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f", s->name, s->tid,
+            s->start * 1e6, (s->stop - s->start) * 1e6);
+
+        if (s->line >= 0)
+        {
+            fprintf(fid, ",\"args\":{\"line\":%d", s->line);
+            if (s->blocks > 0)
+            {
+                fprintf(fid, ",\"blocks\":\"0-%u\"", s->blocks - 1);
+            }
+            if (strcmp(s->name, "sieve") == 0)
+            {
+                fprintf(fid, ",\"presieve_us\":%.3f,\"medium_sieve_us\":%.3f,"
+                    "\"bucket_unload_us\":%.3f",
+                    s->split[0] * 1e6, s->split[1] * 1e6, s->split[2] * 1e6);
+            }
+            fprintf(fid, "}");
+        }
+        fprintf(fid, "}");
+    }
+    fprintf(fid, "\n]}\n");
+
+    if (fclose(fid) != 0)
+    {
+        printf("error writing %s\n", filename);
+        return 1;
+    }
+
+    return 0;
+}
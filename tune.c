@@ -0,0 +1,406 @@
+/*
+MIT License
+
+Copyright (c) 2021 Ben Buhrow
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include "soe.h"
+#include "soe_impl.h"
+#include "ytools.h"
+
+// Measures the sieve parameters that are otherwise fixed in the code:
+// the block size, the avx2 bit update method, the line sieve unroll
+// cutoffs, the first bucket sieved prime and the range sizes where
+// get_numclasses moves to bigger wheels.  Everything is timed by counting
+// primes above TUNE_LOW, where bucket sieving is in use, one parameter at
+// a time in that order.  The results go into sdata->tune, where soe_init's
+// block size and get_numclasses pick them up, and optionally into a
+// profile file so that each machine only has to measure once:
+//
+//   # comment
+//   cpu 7
+//   blocksize 32768
+//   wheel_bounds 100000000 4000000000 40000000000
+//   ...
+//
+// A profile measured on a cpu with different features is measured again.
+
+#define TUNE_LOW 1000000000000ULL
+
+static const uint32_t tune_blocksizes[] = { 32768, 65536, 131072, 262144, 524288 };
+
+static uint32_t tune_cpu(void)
+{
+    info_t info;
+
+    ytools_get_computer_info(&info, 0);
+    return (info.AVX2 ? 1 : 0) | (info.AVX512F ? 2 : 0) | (info.BMI2 ? 4 : 0);
+}
+
+static double tune_time(soe_staticdata_t* sdata, uint64_t range, int reps)
+{
+    // best time to count the primes in TUNE_LOW + [0, range], scaled to
+    // the range asked for since the sieve rounds up to whole lines.
+    soe_phase_t start, stop;
+    double t, best = 0;
+    uint64_t num;
+    int i;
+
+    for (i = 0; i < reps; i++)
+    {
+        soe_clock(&start, NULL);
+        soe_wrapper(sdata, TUNE_LOW, TUNE_LOW + range, 1, &num, 0, 0);
+        soe_clock(&stop, NULL);
+
+        t = (stop.wall - start.wall) * (double)range /
+            (double)(sdata->highlimit - sdata->lowlimit);
+        if ((i == 0) || (t < best))
+            best = t;
+    }
+
+    return best;
+}
+
+static void tune_wheel(soe_staticdata_t* sdata, int w)
+{
+    // force the wheel with 2, 8, 48 or 480 residue classes (w = 0..3)
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        sdata->tune.wheel_bounds[i] = (i < w) ? 1 : UINT64_MAX;
+    }
+    sdata->tune.wheel_max_low = UINT64_MAX;
+    return;
+}
+
+static uint64_t tune_wheel_bound(soe_staticdata_t* sdata, int w, uint64_t bound, int reps,
+    int vflag)
+{
+    // find the range size where wheel w + 1 starts beating wheel w.
+    // time both at two sizes below the built-in bound and intersect
+    // straight lines through the timings.
+    uint64_t r[2];
+    double t[2][2], slope[2], icept[2], x;
+    int j, k;
+
+    r[0] = bound / 32;
+    r[1] = bound / 8;
+    for (k = 0; k < 2; k++)
+    {
+        tune_wheel(sdata, w + k);
+        t[k][0] = tune_time(sdata, r[0], reps);
+        t[k][1] = tune_time(sdata, r[1], reps);
+        slope[k] = (t[k][1] - t[k][0]) / (double)(r[1] - r[0]);
+        icept[k] = t[k][0] - slope[k] * (double)r[0];
+
+        if (vflag > 1)
+        {
+            printf("autotune: %u classes, %" PRIu64 ": %1.4f, %" PRIu64 ": %1.4f seconds\n",
+                sdata->numclasses, r[0], t[k][0], r[1], t[k][1]);
+        }
+    }
+
+    // keep the built-in bound if the wheels are within the noise
+    for (j = 0; j < 2; j++)
+    {
+        if (fabs(t[1][j] - t[0][j]) > 0.02 * t[0][j])
+            break;
+    }
+    if (j == 2)
+        return bound;
+
+    // don't trust the lines too far from where they were measured
+    if (slope[0] <= slope[1])
+        return bound * 16;
+
+    x = (icept[1] - icept[0]) / (slope[0] - slope[1]);
+    if (x < (double)(bound / 16))
+        return bound / 16;
+    if (x > (double)bound * 16.0)
+        return bound * 16;
+    return (uint64_t)x;
+}
+
+static void tune_measure(soe_staticdata_t* sdata, soe_tune_t* tune)
+{
+    soe_staticdata_t* s = soe_init(0, sdata->THREADS, 32);
+    double t, best = 0;
+    uint32_t base, c;
+    int i, j;
+
+    // the scratch sieve needs primes up to sqrt of the biggest range timed
+    extend_sieve_primes(s, TUNE_LOW + 5000000000ULL);
+
+    // block size, on a range of 8 classes
+    for (i = 0; i < sizeof(tune_blocksizes) / sizeof(uint32_t); i++)
+    {
+        s->SOEBLOCKSIZE = tune_blocksizes[i];
+        t = tune_time(s, 1000000000ULL, 2);
+
+        if (sdata->VFLAG > 1)
+        {
+            printf("autotune: blocksize %u: %1.4f seconds\n", tune_blocksizes[i], t);
+        }
+        if ((i == 0) || (t < best))
+        {
+            best = t;
+            tune->blocksize = tune_blocksizes[i];
+        }
+    }
+    s->SOEBLOCKSIZE = tune->blocksize;
+    s->tune.blocksize = tune->blocksize;
+
+    // bit updates, for the only line sieve that has a choice of them
+    tune->bit_update = SOE_BITS_AUTO;
+#ifdef USE_AVX2
+    if ((tune->blocksize == 32768) && (tune_cpu() & 1))
+    {
+        for (i = SOE_BITMASKS8; i < SOE_NUM_BIT_UPDATES; i++)
+        {
+            s->bit_update = i;
+            t = tune_time(s, 200000000ULL, 2);
+
+            if (sdata->VFLAG > 1)
+            {
+                printf("autotune: bit update %d: %1.4f seconds\n", i, t);
+            }
+            if ((i == SOE_BITMASKS8) || (t < best))
+            {
+                best = t;
+                tune->bit_update = i;
+            }
+        }
+        s->bit_update = tune->bit_update;
+    }
+#endif
+
+    // unroll cutoffs, one at a time from the defaults for this block
+    // size, then the first bucket sieved prime if buckets get used.
+    tune_time(s, 200000000ULL, 1);
+    for (i = 0; i < 3; i++)
+    {
+        static const int scale[5] = { 2, 3, 4, 6, 8 };  // quarters
+
+        base = s->unroll_stop[i];
+        for (j = 0; j < 5; j++)
+        {
+            c = base * scale[j] / 4;
+            s->tune.unroll[i] = c;
+            t = tune_time(s, 200000000ULL, 2);
+
+            if (sdata->VFLAG > 1)
+            {
+                printf("autotune: unroll %d stop %u: %1.4f seconds\n", i, s->unroll_stop[i], t);
+            }
+            if ((j == 0) || (t < best))
+            {
+                best = t;
+                tune->unroll[i] = c;
+            }
+        }
+        s->tune.unroll[i] = tune->unroll[i];
+    }
+
+    tune_time(s, 200000000ULL, 1);
+    base = s->BUCKETSTARTI;
+    if (base < s->pboundi)
+    {
+        static const int scale[4] = { 3, 4, 6, 8 };     // quarters
+
+        for (j = 0; j < 4; j++)
+        {
+            c = base * scale[j] / 4;
+            s->tune.bucket_start = c;
+            t = tune_time(s, 200000000ULL, 2);
+
+            if (sdata->VFLAG > 1)
+            {
+                printf("autotune: bucket start %u: %1.4f seconds\n", s->BUCKETSTARTI, t);
+            }
+            if ((j == 0) || (t < best))
+            {
+                best = t;
+                tune->bucket_start = c;
+            }
+        }
+        s->tune.bucket_start = tune->bucket_start;
+    }
+
+    // wheel changeovers.  480 classes stay limited to lower limits
+    // below the built-in bound, which isn't measured.
+    tune->wheel_bounds[0] = tune_wheel_bound(s, 0, 100000000ULL, 2, sdata->VFLAG);
+    tune->wheel_bounds[1] = tune_wheel_bound(s, 1, 4000000000ULL, 2, sdata->VFLAG);
+    tune->wheel_bounds[2] = tune_wheel_bound(s, 2, 40000000000ULL, 1, sdata->VFLAG);
+    tune->wheel_bounds[1] = MAX(tune->wheel_bounds[1], tune->wheel_bounds[0]);
+    tune->wheel_bounds[2] = MAX(tune->wheel_bounds[2], tune->wheel_bounds[1]);
+    tune->wheel_max_low = 0;
+
+    soe_finalize(s);
+    return;
+}
+
+int soe_tune_write(soe_tune_t* tune, const char* filename)
+{
+    FILE* out;
+
+    out = fopen(filename, "w");
+    if (out == NULL)
+    {
+        printf("fopen error: %s\n", strerror(errno));
+        printf("can't open %s for writing\n", filename);
+        return -1;
+    }
+
+    fprintf(out, "# ysieve tuning profile, see soe_autotune\n");
+    fprintf(out, "cpu %u\n", tune->cpu);
+    fprintf(out, "blocksize %u\n", tune->blocksize);
+    fprintf(out, "wheel_bounds %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+        tune->wheel_bounds[0], tune->wheel_bounds[1], tune->wheel_bounds[2]);
+    fprintf(out, "wheel_max_low %" PRIu64 "\n", tune->wheel_max_low);
+    fprintf(out, "unroll %u %u %u\n", tune->unroll[0], tune->unroll[1], tune->unroll[2]);
+    fprintf(out, "bucket_start %u\n", tune->bucket_start);
+    fprintf(out, "bit_update %d\n", tune->bit_update);
+    fclose(out);
+
+    return 0;
+}
+
+int soe_tune_read(soe_tune_t* tune, const char* filename)
+{
+    // a missing file is not an error, it just hasn't been measured yet
+    FILE* in;
+    char line[256], key[64];
+    int n, bad = 0;
+
+    in = fopen(filename, "r");
+    if (in == NULL)
+        return -1;
+
+    memset(tune, 0, sizeof(soe_tune_t));
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        if ((line[0] == '#') || (sscanf(line, "%63s", key) != 1))
+            continue;
+
+        if (strcmp(key, "cpu") == 0)
+            n = sscanf(line, "%*s %u", &tune->cpu) - 1;
+        else if (strcmp(key, "blocksize") == 0)
+            n = sscanf(line, "%*s %u", &tune->blocksize) - 1;
+        else if (strcmp(key, "wheel_bounds") == 0)
+            n = sscanf(line, "%*s %" SCNu64 " %" SCNu64 " %" SCNu64, &tune->wheel_bounds[0],
+                &tune->wheel_bounds[1], &tune->wheel_bounds[2]) - 3;
+        else if (strcmp(key, "wheel_max_low") == 0)
+            n = sscanf(line, "%*s %" SCNu64, &tune->wheel_max_low) - 1;
+        else if (strcmp(key, "unroll") == 0)
+            n = sscanf(line, "%*s %u %u %u", &tune->unroll[0],
+                &tune->unroll[1], &tune->unroll[2]) - 3;
+        else if (strcmp(key, "bucket_start") == 0)
+            n = sscanf(line, "%*s %u", &tune->bucket_start) - 1;
+        else if (strcmp(key, "bit_update") == 0)
+            n = sscanf(line, "%*s %d", &tune->bit_update) - 1;
+        else
+            n = -1;
+
+        if (n != 0)
+        {
+            printf("bad line in tuning profile %s: %s", filename, line);
+            bad = 1;
+        }
+    }
+    fclose(in);
+
+    // only block sizes get_numclasses knows about
+    if ((tune->blocksize != 0) && ((tune->blocksize & (tune->blocksize - 1)) ||
+        (tune->blocksize < 32768) || (tune->blocksize > 1048576)))
+    {
+        printf("bad blocksize %u in tuning profile %s\n", tune->blocksize, filename);
+        bad = 1;
+    }
+
+    if ((tune->bit_update < 0) || (tune->bit_update >= SOE_NUM_BIT_UPDATES))
+    {
+        printf("bad bit_update %d in tuning profile %s\n", tune->bit_update, filename);
+        bad = 1;
+    }
+
+    if (bad)
+    {
+        memset(tune, 0, sizeof(soe_tune_t));
+        return -1;
+    }
+
+    return 0;
+}
+
+int soe_autotune(soe_staticdata_t* sdata, const char* profile)
+{
+    // use the profile if there is one for this cpu, otherwise measure
+    // (and save the profile, if named).  returns 1 if measured.
+    soe_tune_t tune;
+    uint32_t cpu = tune_cpu();
+    int measured = 0;
+
+    if ((profile == NULL) || (soe_tune_read(&tune, profile) != 0) || (tune.cpu != cpu))
+    {
+        if (sdata->VFLAG > 0)
+        {
+            printf("autotune: measuring sieve parameters\n");
+        }
+
+        memset(&tune, 0, sizeof(soe_tune_t));
+        tune_measure(sdata, &tune);
+        tune.cpu = cpu;
+        measured = 1;
+
+        if (profile != NULL)
+        {
+            soe_tune_write(&tune, profile);
+        }
+    }
+    else if (sdata->VFLAG > 0)
+    {
+        printf("autotune: using profile %s\n", profile);
+    }
+
+    sdata->tune = tune;
+    if (tune.blocksize > 0)
+    {
+        sdata->SOEBLOCKSIZE = tune.blocksize;
+    }
+    sdata->bit_update = tune.bit_update;
+
+    if (sdata->VFLAG > 0)
+    {
+        printf("autotune: blocksize %u, wheel bounds %" PRIu64 " %" PRIu64 " %" PRIu64
+            ", unroll %u %u %u, bucket start %u, bit update %d\n",
+            tune.blocksize, tune.wheel_bounds[0], tune.wheel_bounds[1], tune.wheel_bounds[2],
+            tune.unroll[0], tune.unroll[1], tune.unroll[2], tune.bucket_start, tune.bit_update);
+    }
+
+    return measured;
+}
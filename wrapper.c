@@ -34,16 +34,188 @@ SOFTWARE.
 #include <math.h>
 #include "threadpool.h"
 
+// primes going to a file are found this many integers at a time, so
+// that one piece is written while the next is sieved.
+#define SOE_FILE_PIECE 1000000000ULL
+
+// survivors are handed to the PRP threads in chunks of PRP_CHUNK,
+// taken from segments of the interval that are sieved while the
+// survivors of earlier segments are being tested.
+#define PRP_CHUNK 1024
+#define PRP_MAX_SEGMENTS 8
+#define PRP_MIN_SEGMENT (1ULL << 22)
+
+typedef struct
+{
+    uint64_t *v;            // survivors, relative to the interval start
+    uint32_t num;           // number of survivors in the chunk
+    uint32_t kept;          // number of them that are PRP
+} prp_chunk_t;
+
+typedef struct
+{
+    soe_staticdata_t *sdata;
+    thread_soedata_t *ddata;
+    mpz_t *offset;
+    uint64_t range;
+    uint64_t sieve_limit;
+    int deep;
+
+    // thread 0 sieves the interval in num_segs pieces of seglen
+    uint64_t seglen;
+    int num_segs;
+    uint64_t **segs;
+    uint64_t num_sieved;
+    uint64_t num_tested;
+
+    // work queue: appended to by the sieve, consumed by all threads
+    prp_chunk_t *chunks;
+    uint32_t num_chunks;
+    uint32_t alloc_chunks;
+    uint32_t next_chunk;
+    int sieving;
+    int sync_count;
+
+#if defined(WIN32) || defined(_WIN64)
+    CRITICAL_SECTION queue_lock;
+    CONDITION_VARIABLE queue_cond;
+#else
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;
+#endif
+} prp_userdata_t;
+
+static __inline void prp_queue_lock(prp_userdata_t *udata)
+{
+#if defined(WIN32) || defined(_WIN64)
+    EnterCriticalSection(&udata->queue_lock);
+#else
+    pthread_mutex_lock(&udata->queue_lock);
+#endif
+}
+
+static __inline void prp_queue_unlock(prp_userdata_t *udata)
+{
+#if defined(WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&udata->queue_lock);
+#else
+    pthread_mutex_unlock(&udata->queue_lock);
+#endif
+}
+
+static __inline void prp_queue_wait(prp_userdata_t *udata)
+{
+#if defined(WIN32) || defined(_WIN64)
+    SleepConditionVariableCS(&udata->queue_cond, &udata->queue_lock, INFINITE);
+#else
+    pthread_cond_wait(&udata->queue_cond, &udata->queue_lock);
+#endif
+}
+
+static __inline void prp_queue_wake(prp_userdata_t *udata)
+{
+#if defined(WIN32) || defined(_WIN64)
+    WakeAllConditionVariable(&udata->queue_cond);
+#else
+    pthread_cond_broadcast(&udata->queue_cond);
+#endif
+}
+
+static void prp_sieve_segments(prp_userdata_t *udata)
+{
+    // sieve the interval a segment at a time and queue the survivors
+    // of each segment as soon as it is done.
+    soe_staticdata_t *sdata = udata->sdata;
+    mpz_t segoff, tmpz;
+    int s;
+
+    mpz_init(segoff);
+    mpz_init(tmpz);
+
+    for (s = 0; s < udata->num_segs; s++)
+    {
+        uint64_t lo = (uint64_t)s * udata->seglen;
+        uint64_t hi = (s == (udata->num_segs - 1)) ? udata->range : lo + udata->seglen - 1;
+        uint64_t *v, num, d, i, j;
+
+        // the sieve needs a range of at least 1e6, and may lower
+        // segoff to suit the wheel.  values outside of [lo, hi] 
+        // belong to other segments, or to no one.
+        mpz_add_ui(segoff, *udata->offset, lo);
+        v = GetPRIMESRange(sdata, &segoff, 0, MAX(hi - lo, 1000000), &num);
+
+        mpz_add_ui(tmpz, *udata->offset, lo);
+        mpz_sub(tmpz, tmpz, segoff);
+        d = mpz_get_ui(tmpz);
+
+        for (i = j = 0; i < num; i++)
+        {
+            if ((v[i] >= d) && ((v[i] - d) <= (hi - lo)))
+            {
+                v[j++] = v[i] - d + lo;
+            }
+        }
+        num = j;
+
+        if (udata->deep)
+        {
+            num = deep_sieve_values(sdata, udata->offset, v, num,
+                sdata->sieve_p[sdata->num_sp - 1], udata->sieve_limit);
+        }
+
+        v = (uint64_t *)xrealloc(v, MAX(num, 1) * sizeof(uint64_t));
+        udata->segs[s] = v;
+
+        prp_queue_lock(udata);
+        for (i = 0; i < num; i += PRP_CHUNK)
+        {
+            prp_chunk_t *c;
+
+            if (udata->num_chunks == udata->alloc_chunks)
+            {
+                udata->alloc_chunks *= 2;
+                udata->chunks = (prp_chunk_t *)xrealloc(udata->chunks,
+                    udata->alloc_chunks * sizeof(prp_chunk_t));
+            }
+
+            c = &udata->chunks[udata->num_chunks++];
+            c->v = v + i;
+            c->num = (uint32_t)MIN(PRP_CHUNK, num - i);
+            c->kept = 0;
+        }
+        udata->num_sieved += num;
+        soe_progress_total(sdata, SOE_PROGRESS_PRP, udata->num_sieved);
+        prp_queue_wake(udata);
+        prp_queue_unlock(udata);
+
+        if (sdata->VFLAG > 1)
+        {
+            printf("segment %d of %d: queued %" PRIu64 " candidates for PRP tests\n",
+                s + 1, udata->num_segs, num);
+        }
+    }
+
+    prp_queue_lock(udata);
+    udata->sieving = 0;
+    prp_queue_wake(udata);
+    prp_queue_unlock(udata);
+
+    mpz_clear(segoff);
+    mpz_clear(tmpz);
+    return;
+}
+
 void compute_prps_dispatch(void *vptr)
 {
     tpool_t *tdata = (tpool_t *)vptr;
-    soe_userdata_t *t = (soe_userdata_t *)tdata->user_data;
-    soe_staticdata_t *sdata = t->sdata;
+    prp_userdata_t *udata = (prp_userdata_t *)tdata->user_data;
 
-    if (sdata->sync_count < sdata->THREADS)
+    // every thread runs the work function once; the work itself is
+    // balanced through the chunk queue.
+    if (udata->sync_count < udata->sdata->THREADS)
     {
         tdata->work_fcn_id = 0;
-        sdata->sync_count++;
+        udata->sync_count++;
     }
     else
     {
@@ -56,30 +228,80 @@ void compute_prps_dispatch(void *vptr)
 void compute_prps_work_fcn(void *vptr)
 {
     tpool_t *tdata = (tpool_t *)vptr;
-    soe_userdata_t *udata = (soe_userdata_t *)tdata->user_data;
+    prp_userdata_t *udata = (prp_userdata_t *)tdata->user_data;
     soe_staticdata_t *sdata = udata->sdata;
     thread_soedata_t *t = &udata->ddata[tdata->tindex];
-    int i;
-    
-    t->linecount = 0;
-    for (i = t->startid; i < t->stopid; i++)
+    uint32_t i;
+#if defined(HAVE_UINT128)
+    uint128_t off128, lo128, hi128;
+
+    // below 2^127 the bounds checks and the BPSW test are native
+    // and gmp isn't needed at all.
+    int native = (mpz_sizeinbase(t->highlimit, 2) <= 127) &&
+        mpz_get_u128(t->offset, &off128) &&
+        mpz_get_u128(t->lowlimit, &lo128) &&
+        mpz_get_u128(t->highlimit, &hi128);
+#endif
+
+    // thread 0 produces the work before joining in on it
+    if (tdata->tindex == 0)
+    {
+        prp_sieve_segments(udata);
+    }
+
+    while (1)
     {
-        if (((i & 127) == 0) && (sdata->VFLAG > 0))
+        prp_chunk_t c;
+        uint32_t id;
+
+        prp_queue_lock(udata);
+        while ((udata->next_chunk == udata->num_chunks) && udata->sieving)
         {
-            printf("thread %d progress: %d%%\r", tdata->tindex, 
-                (int)((double)(i - t->startid) / (double)(t->stopid - t->startid) * 100.0));
-            fflush(stdout);
+            prp_queue_wait(udata);
         }
 
-        mpz_add_ui(t->tmpz, t->offset, t->ddata.primes[i - t->startid]);
-        if ((mpz_cmp(t->tmpz, t->lowlimit) >= 0) && (mpz_cmp(t->highlimit, t->tmpz) >= 0))
+        if (udata->next_chunk == udata->num_chunks)
         {
-            //if (mpz_extrastrongbpsw_prp(t->tmpz))
-            if (mpz_probab_prime_p(t->tmpz, 1))
+            prp_queue_unlock(udata);
+            break;
+        }
+
+        id = udata->next_chunk++;
+        c = udata->chunks[id];
+        prp_queue_unlock(udata);
+
+        c.kept = 0;
+        for (i = 0; i < c.num; i++)
+        {
+#if defined(HAVE_UINT128)
+            if (native)
             {
-                t->ddata.primes[t->linecount++] = t->ddata.primes[i - t->startid];
+                uint128_t n = off128 + c.v[i];
+
+                if ((n >= lo128) && (n <= hi128) && bpsw_u128(n))
+                {
+                    c.v[c.kept++] = c.v[i];
+                }
+                continue;
+            }
+#endif
+
+            mpz_add_ui(t->tmpz, t->offset, c.v[i]);
+            if ((mpz_cmp(t->tmpz, t->lowlimit) >= 0) && (mpz_cmp(t->highlimit, t->tmpz) >= 0))
+            {
+                //if (mpz_extrastrongbpsw_prp(t->tmpz))
+                if (mpz_probab_prime_p(t->tmpz, 1))
+                {
+                    c.v[c.kept++] = c.v[i];
+                }
             }
         }
+
+        prp_queue_lock(udata);
+        udata->chunks[id].kept = c.kept;
+        udata->num_tested += c.num;
+        prp_queue_unlock(udata);
+        soe_progress_add(sdata, SOE_PROGRESS_PRP, c.num);
     }
 
     return;
@@ -88,6 +310,7 @@ void compute_prps_work_fcn(void *vptr)
 soe_staticdata_t* soe_init(int vflag, int threads, int blocksize)
 {
     soe_staticdata_t* sdata;
+    soe_phase_t now;
 
     sdata = (soe_staticdata_t*)malloc(sizeof(soe_staticdata_t));
 
@@ -97,6 +320,27 @@ soe_staticdata_t* soe_init(int vflag, int threads, int blocksize)
 
     sdata->VFLAG = vflag;
     sdata->THREADS = threads;
+    sdata->do_reduce = 0;
+    memset(&sdata->reduction, 0, sizeof(soe_reduction_t));
+    sdata->bitmap = NULL;
+    sdata->pi_table = NULL;
+    sdata->pi_table_step = 0;
+    sdata->pi_table_num = 0;
+    sdata->map_path = NULL;
+    sdata->map_output = 0;
+    memset(&sdata->stats, 0, sizeof(soe_stats_t));
+    sdata->perf_events = 0;
+    sdata->bit_update = SOE_BITS_AUTO;
+    memset(&sdata->tune, 0, sizeof(soe_tune_t));
+    sdata->trace_path = NULL;
+    sdata->trace = NULL;
+    sdata->trace_num = 0;
+    sdata->trace_alloc = 0;
+    soe_clock(&now, NULL);
+    sdata->trace_t0 = now.wall;
+    sdata->progress = soe_progress_init();
+    sdata->mapped = NULL;
+    sdata->num_mapped = 0;
     if (blocksize > 1024)
         sdata->SOEBLOCKSIZE = blocksize;
     else
@@ -107,6 +351,18 @@ soe_staticdata_t* soe_init(int vflag, int threads, int blocksize)
 void soe_finalize(soe_staticdata_t* sdata)
 {
     free(sdata->sieve_p);
+    free(sdata->pi_table);
+    while (sdata->num_mapped > 0)
+    {
+        soe_free_primes(sdata, sdata->mapped[0].primes);
+    }
+    free(sdata->mapped);
+    if ((sdata->trace_path != NULL) && (sdata->trace_num > 0))
+    {
+        soe_trace_write(sdata, sdata->trace_path);
+    }
+    free(sdata->trace);
+    soe_progress_free(sdata->progress);
 	free(sdata);
     return;
 }
@@ -149,7 +405,10 @@ uint64_t *GetPRIMESRange(soe_staticdata_t* sdata,
 			lo_est = 0;
 
 		i = (uint64_t)((double)(hi_est - lo_est) * 1.25);
-		primes = (uint64_t *)xrealloc(primes, (size_t) (i * sizeof(uint64_t)));
+		if (sdata->map_output)
+			primes = map_primes_alloc(sdata, i);
+		else
+			primes = (uint64_t *)xrealloc(primes, (size_t) (i * sizeof(uint64_t)));
 	}
 
 	//check for really big ranges ('big' is different here than when we are counting
@@ -166,16 +425,18 @@ uint64_t *GetPRIMESRange(soe_staticdata_t* sdata,
         // maxrange - 1, so that we don't count the upper
         // limit twice (again on the next iteration's lower bound).
 		tmph = lowlimit + maxrange - 1;
+		// each range goes at primes + tmpcount rather than at a
+		// GLOBAL_OFFSET, which threads would apply to their own
+		// temporary lists.
 		for (j = 0; j < num_ranges; j++)
 		{
-			tmpcount += spSOE(sdata, offset, tmpl, &tmph, 0, primes);
+			tmpcount += spSOE(sdata, offset, tmpl, &tmph, 0, primes + tmpcount);
 			tmpl += maxrange;
 			tmph = tmpl + maxrange - 1;
-            sdata->GLOBAL_OFFSET = tmpcount;
 		}
 				
 		tmph = tmpl + remainder;
-		tmpcount += spSOE(sdata, offset, tmpl, &tmph, 0, primes);
+		tmpcount += spSOE(sdata, offset, tmpl, &tmph, 0, primes + tmpcount);
 		*num_p = tmpcount;
 	}
 	else
@@ -193,38 +454,39 @@ uint64_t *GetPRIMESRange(soe_staticdata_t* sdata,
 	return primes;
 }
 
-uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit, 
-    int count, uint64_t* num_p, int PRIMES_TO_FILE, int PRIMES_TO_SCREEN)
+void extend_sieve_primes(soe_staticdata_t* sdata, uint64_t highlimit)
 {
-	//public interface to the sieve.  
-	uint64_t retval, tmpl, tmph, i;
-	uint32_t max_p;	
-	
-	uint64_t *primes = NULL;
-
-    sdata->only_count = count;
-
-    if (highlimit < lowlimit)
-    {
-        printf("error: lowlimit must be less than highlimit\n");
-        *num_p = 0;
-        return primes;
-    }
-
-	if (highlimit > (sdata->sieve_p[sdata->num_sp-1] * sdata->sieve_p[sdata->num_sp-1]))
+	// make sure we have all of the sieving primes needed to
+	// handle inputs up to highlimit.  highlimit may be anything up to
+	// 2^64, but the sieving primes are 32 bit, so they stop at the
+	// largest prime below 2^32.
+	uint64_t retval, i;
+	uint64_t max_p, sqrt_hi;
+	uint64_t *primes;
+
+	// integer square root: the double sqrt can round up past the true
+	// root, and (r + 1)^2 overflows once r reaches 2^32.
+	sqrt_hi = (uint64_t)sqrt((double)highlimit);
+	while ((sqrt_hi > 0xffffffffULL) || (sqrt_hi * sqrt_hi > highlimit))
+		sqrt_hi--;
+	while ((sqrt_hi < 0xffffffffULL) && ((sqrt_hi + 1) * (sqrt_hi + 1) <= highlimit))
+		sqrt_hi++;
+	sqrt_hi = MIN(sqrt_hi, 4294967291ULL);
+
+	if (sqrt_hi > sdata->sieve_p[sdata->num_sp-1])
 	{
 		//then we need to generate more sieving primes
-		uint32_t range_est;
+		uint64_t range_est;
 
 		//allocate array based on conservative estimate of the number of 
 		//primes in the interval	
-		max_p = (uint32_t)sqrt((int64_t)(highlimit)) + 65536;
-		range_est = (uint32_t)estimate_primes_in_range(0, (uint64_t)max_p);
+		max_p = MIN(sqrt_hi + 65536, 0xffffffffULL);
+		range_est = estimate_primes_in_range(0, max_p);
 
         if (sdata->VFLAG > 1)
         {
-            printf("generating more sieving primes in range 0 : %u \n", max_p);
-            printf("allocating %u bytes \n", range_est);
+            printf("generating more sieving primes in range 0 : %" PRIu64 " \n", max_p);
+            printf("allocating %" PRIu64 " bytes \n", range_est * sizeof(uint32_t));
         }
 
         sdata->sieve_p = (uint32_t *)xrealloc(sdata->sieve_p, 
@@ -246,13 +508,124 @@ uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highl
 
         sdata->num_sp = (uint32_t)retval;
 		free(primes);
-		primes = NULL;
 	}
 
+	return;
+}
+
+static uint64_t *get_primes_to_file(soe_staticdata_t* sdata, uint64_t lowlimit,
+	uint64_t highlimit, int format, uint64_t *num_p)
+{
+	// as GetPRIMESRange, but sieving a piece at a time and queueing each
+	// piece for the writer thread as soon as it is found, so that the
+	// file is written while the next piece is sieved.
+	const char *filename = soe_output_filename(format);
+	uint64_t num_pieces = (highlimit - lowlimit) / SOE_FILE_PIECE;
+	uint64_t hi_est, lo_est, k, alloc, count = 0;
+	uint64_t *primes;
+	uint64_t **retired = NULL;
+	int num_retired = 0;
+	soe_writer_t *w;
+	int i;
+
+	hi_est = (uint64_t)(highlimit/log((double)highlimit));
+	if (lowlimit > 1)
+		lo_est = (uint64_t)(lowlimit/log((double)lowlimit));
+	else
+		lo_est = 0;
+
+	alloc = (uint64_t)((double)(hi_est - lo_est) * 1.25);
+	if (sdata->map_output)
+		primes = map_primes_alloc(sdata, alloc);
+	else
+		primes = (uint64_t *)xmalloc((size_t)(alloc * sizeof(uint64_t)));
+
+	w = soe_writer_open(filename, format, lowlimit, highlimit);
+
+	for (k = 0; k < num_pieces; k++)
+	{
+		uint64_t lo = lowlimit + k * SOE_FILE_PIECE;
+		uint64_t hi = (k == (num_pieces - 1)) ? highlimit : lo + SOE_FILE_PIECE - 1;
+		uint64_t need = count + estimate_primes_in_range(lo, hi);
+		uint64_t n;
+
+		// the writer may still hold pointers into the list, so a list
+		// that is too small is copied to a bigger one, and the old one
+		// is kept until the writer is done.
+		if (need > alloc)
+		{
+			uint64_t *bigger;
+
+			alloc = MAX(need, alloc + alloc / 4);
+			if (sdata->map_output)
+				bigger = map_primes_alloc(sdata, alloc);
+			else
+				bigger = (uint64_t *)xmalloc((size_t)(alloc * sizeof(uint64_t)));
+			memcpy(bigger, primes, count * sizeof(uint64_t));
+
+			retired = (uint64_t **)xrealloc(retired, (num_retired + 1) * sizeof(uint64_t *));
+			retired[num_retired++] = primes;
+			primes = bigger;
+		}
+
+		// with more than one thread, primes found by each thread are
+		// gathered at GLOBAL_OFFSET in that thread's own temporary list,
+		// so pieces are placed by pointer instead.
+		sdata->GLOBAL_OFFSET = 0;
+		n = spSOE(sdata, NULL, lo, &hi, 0, primes + count);
+
+		if ((count + n) > alloc)
+		{
+			printf("error: %" PRIu64 " primes overflowed a list of %" PRIu64 "\n",
+				count + n, alloc);
+			exit(1);
+		}
+
+		if (w != NULL)
+			soe_writer_primes(w, sdata, primes + count, n);
+		count += n;
+	}
+
+	if (w != NULL)
+		soe_writer_close(w, filename);
+
+	for (i = 0; i < num_retired; i++)
+		soe_free_primes(sdata, retired[i]);
+	free(retired);
+
+	*num_p = count;
+	return primes;
+}
+
+uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit, 
+    int count, uint64_t* num_p, int PRIMES_TO_FILE, int PRIMES_TO_SCREEN)
+{
+	//public interface to the sieve.  
+	uint64_t retval, tmpl, tmph, i;
+	int written = 0;
+	
+	uint64_t *primes = NULL;
+
+    sdata->only_count = count;
+
+    if (highlimit < lowlimit)
+    {
+        printf("error: lowlimit must be less than highlimit\n");
+        *num_p = 0;
+        return primes;
+    }
+
+	extend_sieve_primes(sdata, highlimit);
+
 	if (count)
 	{
+		//with a pi table loaded, wide ranges only need their ends sieved
+		if (pi_table_covers(sdata, lowlimit, highlimit))
+		{
+			*num_p = pi_table_count(sdata, lowlimit, highlimit);
+		}
 		//this needs to be a range of at least 1e6
-		if ((highlimit - lowlimit) < 1000000)
+		else if ((highlimit - lowlimit) < 1000000)
 		{
 			//go and get a new range.
 			tmpl = lowlimit;
@@ -269,6 +642,10 @@ uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highl
                 if ((primes[i] >= lowlimit) && (primes[i] <= highlimit))
                 {
                     (*num_p)++;
+                    if (sdata->do_reduce)
+                    {
+                        reduction_add_prime(&sdata->reduction, primes[i]);
+                    }
                 }
 			}
 			free(primes);
@@ -351,48 +728,42 @@ uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highl
 			}
 
 		}
+		else if (PRIMES_TO_FILE && ((highlimit - lowlimit) >= 2 * SOE_FILE_PIECE))
+		{
+			//big enough to write the file while the rest is sieved
+			sdata->map_output = (sdata->map_path != NULL);
+			primes = get_primes_to_file(sdata, lowlimit, highlimit, PRIMES_TO_FILE, num_p);
+			sdata->map_output = 0;
+			written = 1;
+		}
 		else
 		{
 			//we don't need to mess with the requested range,
 			//so GetPRIMESRange will return the requested range directly
 			//and the count will be in NUM_P
+			sdata->map_output = (sdata->map_path != NULL);
 			primes = GetPRIMESRange(sdata, NULL, lowlimit, highlimit, num_p);
+			sdata->map_output = 0;
 		}
 
 		// now dump the requested range of primes to a file, or the
 		// screen, both, or neither, depending on the state of a couple
 		// global configuration variables
-		if (PRIMES_TO_FILE)
+		if (PRIMES_TO_FILE && !written)
 		{
-			FILE *out;
-			out = fopen("primes.dat","w");
-			if (out == NULL)
-			{
-				printf("fopen error: %s\n", strerror(errno));
-				printf("can't open primes.dat for writing\n");
-			}
-			else
+			const char *filename = soe_output_filename(PRIMES_TO_FILE);
+			soe_writer_t *w = soe_writer_open(filename, PRIMES_TO_FILE, lowlimit, highlimit);
+
+			if (w != NULL)
 			{
-				for (i = 0; i < *num_p; i++)
-				{
-                    if ((primes[i] >= lowlimit) && (primes[i] <= highlimit))
-                    {
-                        fprintf(out, "%" PRIu64 "\n", primes[i]);
-                    }
-				}
-				fclose(out);
+				soe_writer_primes(w, sdata, primes, *num_p);
+				soe_writer_close(w, filename);
 			}
 		}
 
 		if (PRIMES_TO_SCREEN)
 		{
-			for (i = 0; i < *num_p; i++)
-			{
-                if ((primes[i] >= lowlimit) && (primes[i] <= highlimit))
-                {
-                    printf("%" PRIu64 " ", primes[i]);
-                }
-			}
+			soe_print_decimal(sdata, NULL, primes, *num_p, lowlimit, highlimit, ' ');
 			printf("\n");
 		}			
 	}
@@ -400,6 +771,26 @@ uint64_t *soe_wrapper(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highl
 	return primes;
 }
 
+uint64_t soe_reduce(soe_staticdata_t* sdata, uint64_t lowlimit, uint64_t highlimit,
+    soe_reduction_t* reduction)
+{
+    // public interface to compute reductions (count, sum, sum of 
+    // squares and xor) over the primes in a range.  This runs the 
+    // count path of the sieve, folding primes into the accumulators
+    // as each line is finished, so no primes are ever stored.
+    uint64_t num_p;
+
+    sdata->do_reduce = 1;
+    memset(&sdata->reduction, 0, sizeof(soe_reduction_t));
+
+    soe_wrapper(sdata, lowlimit, highlimit, 1, &num_p, 0, 0);
+
+    *reduction = sdata->reduction;
+    sdata->do_reduce = 0;
+
+    return num_p;
+}
+
 uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 	mpz_t lowlimit, mpz_t highlimit, int count, int num_witnesses, 
     uint64_t sieve_limit, uint64_t *num_p,
@@ -414,6 +805,7 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 	uint64_t *values = NULL;
 	mpz_t tmpz;
 	mpz_t *offset;
+	int deep;
 
 	if (mpz_cmp(highlimit, lowlimit) <= 0)
 	{
@@ -429,7 +821,12 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 	mpz_sub(tmpz, highlimit, lowlimit);
 	range = mpz_get_ui(tmpz);
 
-	if (count)
+	// primes beyond the ones we have are applied to the survivors
+	// afterwards, which means we need the survivors even if only
+	// counting.
+	deep = (sieve_limit > sdata->sieve_p[sdata->num_sp - 1]);
+
+	if (count && !deep)
 	{
 		//this needs to be a range of at least 1e6
 		if (range < 1000000)
@@ -502,85 +899,60 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 	}
 	else
 	{
-		// this needs to be a range of at least 1e6
-		if (range < 1000000)
-		{
-			//there is slack built into the sieve limit, so go ahead and increase
-			//the size of the interval to make it at least 1e6.
-			tmpl = 0;
-			tmph = tmpl + 1000000;
-
-			// since this is a small range, we need to 
-			// find a bigger range and count them.
-			values = GetPRIMESRange(sdata, offset, tmpl, tmph, &retval);
-			*num_p = 0;
-			for (i = 0; i < retval; i++)
-			{
-				mpz_add_ui(tmpz, *offset, values[i]);
-                if ((mpz_cmp(tmpz, lowlimit) >= 0) && (mpz_cmp(highlimit, tmpz) >= 0))
-                {
-                    (*num_p)++;
-                }
-			}
-		}
-		else
-		{
-			//we don't need to mess with the requested range,
-			//so GetPRIMESRange will return the requested range directly
-			//and the count will be in NUM_P
-			values = GetPRIMESRange(sdata, offset, 0, range, num_p);
-		}
-
 		if (num_witnesses > 0)
 		{
-			thread_soedata_t *thread_data;		//an array of thread data objects
-			uint32_t lastid;
+			// sieve and PRP test together: thread 0 sieves the interval
+			// in segments and queues the survivors in chunks, which all
+			// threads (thread 0 too, once the sieve is done) test as they 
+			// become available.
+			prp_userdata_t udata;
+			tpool_t *tpool_data;
+			uint32_t c;
 			int j;
 
-            // threading structures
-            tpool_t *tpool_data;
-            soe_userdata_t udata;
-
-			//allocate thread data structure
-			thread_data = (thread_soedata_t *)malloc(sdata->THREADS * sizeof(thread_soedata_t));
-			
-			// conduct PRP tests on all surviving values
-            if (sdata->VFLAG > 0)
-            {
-                printf("starting PRP tests with %d witnesses on "
-                    "%" PRIu64 " surviving candidates using %d threads\n",
-                    num_witnesses, *num_p, sdata->THREADS);
-            }
-
-			range = *num_p / sdata->THREADS;
-			lastid = 0;
-
-			// divvy up the range
-			for (j = 0; j < sdata->THREADS; j++)
+			udata.sdata = sdata;
+			udata.offset = offset;
+			udata.range = range;
+			udata.sieve_limit = sieve_limit;
+			udata.deep = deep;
+
+			// each segment pays for its own roots, so segments are kept
+			// large compared to the number of sieve primes.  the deep sieve
+			// and huge offsets are expensive per segment, so they only
+			// get one, as does a single thread, which has nothing to 
+			// overlap with.
+			udata.num_segs = 1;
+			if ((sdata->THREADS > 1) && !deep && 
+				(mpz_sizeinbase(lowlimit, 2) < REMTREE_MIN_BITS))
 			{
-				thread_soedata_t *t = thread_data + j;
-				
-				t->startid = lastid;
-				t->stopid = t->startid + range;
-				lastid = t->stopid;
+				uint64_t minseg = MAX(PRP_MIN_SEGMENT, 64 * (uint64_t)sdata->num_sp);
 
-                if (sdata->VFLAG > 2)
-                {
-                    printf("thread %d computing PRPs from %u to %u\n",
-                        (int)j, t->startid, t->stopid);
-                }
+				udata.num_segs = (int)MIN(PRP_MAX_SEGMENTS, range / minseg);
+				udata.num_segs = MAX(udata.num_segs, 1);
 			}
-
-			// the last one gets any leftover
-            if (thread_data[sdata->THREADS - 1].stopid != (uint32_t)*num_p)
-            {
-                thread_data[sdata->THREADS - 1].stopid = (uint32_t)*num_p;
-            }
-
-			// allocate space for stuff in the threads
+			udata.seglen = range / udata.num_segs;
+			udata.segs = (uint64_t **)xcalloc(udata.num_segs, sizeof(uint64_t *));
+			udata.num_sieved = 0;
+			udata.num_tested = 0;
+
+			udata.alloc_chunks = 1024;
+			udata.chunks = (prp_chunk_t *)xmalloc(udata.alloc_chunks * sizeof(prp_chunk_t));
+			udata.num_chunks = 0;
+			udata.next_chunk = 0;
+			udata.sieving = 1;
+			udata.sync_count = 0;
+#if defined(WIN32) || defined(_WIN64)
+			InitializeCriticalSection(&udata.queue_lock);
+			InitializeConditionVariable(&udata.queue_cond);
+#else
+			pthread_mutex_init(&udata.queue_lock, NULL);
+			pthread_cond_init(&udata.queue_cond, NULL);
+#endif
+
+			udata.ddata = (thread_soedata_t *)malloc(sdata->THREADS * sizeof(thread_soedata_t));
 			for (j = 0; j < sdata->THREADS; j++)
 			{
-				thread_soedata_t *t = thread_data + j;
+				thread_soedata_t *t = udata.ddata + j;
 
 				mpz_init(t->tmpz);
 				mpz_init(t->offset);
@@ -589,55 +961,108 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 				mpz_set(t->offset, *offset);
 				mpz_set(t->lowlimit, lowlimit);
 				mpz_set(t->highlimit, highlimit);
-				t->current_line = (uint64_t)num_witnesses;
-
-				t->ddata.primes = (uint64_t *)malloc((t->stopid - t->startid) * sizeof(uint64_t));
-                for (i = t->startid; i < t->stopid; i++)
-                {
-                    t->ddata.primes[i - t->startid] = values[i];
-                }
 			}
 
-			// now run with the threads.  don't really need the 
-            // threadpool since we are statically dividing up the range
-            // to test, but it is easy so we use it.
-            udata.sdata = &thread_data->sdata;
-            udata.ddata = thread_data;
+            if (sdata->VFLAG > 0)
+            {
+                printf("sieving and PRP testing with %d witnesses "
+                    "in %d segments using %d threads\n",
+                    num_witnesses, udata.num_segs, sdata->THREADS);
+            }
+
             tpool_data = tpool_setup(sdata->THREADS, NULL, NULL, NULL,
                 &compute_prps_dispatch, &udata);
 
-            thread_data->sdata.sync_count = 0;
-            tpool_add_work_fcn(tpool_data, &compute_prps_work_fcn);
-            tpool_go(tpool_data);
+            soe_progress_begin(sdata, SOE_PROGRESS_PRP, 0);
+            if (sdata->THREADS == 1)
+            {
+                compute_prps_work_fcn(tpool_data);
+            }
+            else
+            {
+                tpool_add_work_fcn(tpool_data, &compute_prps_work_fcn);
+                tpool_go(tpool_data);
+            }
+            soe_progress_end(sdata, SOE_PROGRESS_PRP);
 
             free(tpool_data);
 
-			// combine results and free stuff
+			// chunks were queued in order, so the PRPs are too
+			values = (uint64_t *)xmalloc(MAX(udata.num_sieved, 1) * sizeof(uint64_t));
 			retval = 0;
-            for (i = 0; i < sdata->THREADS; i++)
-            {
-                thread_soedata_t* t = thread_data + i;
+			for (c = 0; c < udata.num_chunks; c++)
+			{
+				memcpy(values + retval, udata.chunks[c].v, 
+					udata.chunks[c].kept * sizeof(uint64_t));
+				retval += udata.chunks[c].kept;
+			}
+			*num_p = retval;
 
-                for (j = 0; j < t->linecount; j++)
-                {
-                    values[retval++] = t->ddata.primes[j];
-                }
+			for (j = 0; j < udata.num_segs; j++)
+			{
+				free(udata.segs[j]);
+			}
+			free(udata.segs);
+			free(udata.chunks);
 
-                free(t->ddata.primes);
-                mpz_clear(t->tmpz);
-                mpz_clear(t->offset);
-                mpz_clear(t->lowlimit);
-                mpz_clear(t->highlimit);
-            }
+			for (j = 0; j < sdata->THREADS; j++)
+			{
+				thread_soedata_t *t = udata.ddata + j;
 
-			free(thread_data);
+				mpz_clear(t->tmpz);
+				mpz_clear(t->offset);
+				mpz_clear(t->lowlimit);
+				mpz_clear(t->highlimit);
+			}
+			free(udata.ddata);
+
+#if defined(WIN32) || defined(_WIN64)
+			DeleteCriticalSection(&udata.queue_lock);
+#else
+			pthread_mutex_destroy(&udata.queue_lock);
+			pthread_cond_destroy(&udata.queue_cond);
+#endif
 
-			*num_p = retval;
             if (sdata->VFLAG > 0)
             {
-                printf("found %" PRIu64 " PRPs\n", *num_p);
+                printf("\nfound %" PRIu64 " PRPs in %" PRIu64 " candidates\n", 
+					*num_p, udata.num_sieved);
             }
-			
+		}
+		// this needs to be a range of at least 1e6
+		else if (range < 1000000)
+		{
+			//there is slack built into the sieve limit, so go ahead and increase
+			//the size of the interval to make it at least 1e6.
+			tmpl = 0;
+			tmph = tmpl + 1000000;
+
+			// since this is a small range, we need to 
+			// find a bigger range and keep the ones inside the
+			// original range.
+			values = GetPRIMESRange(sdata, offset, tmpl, tmph, &retval);
+			*num_p = 0;
+			for (i = 0; i < retval; i++)
+			{
+				mpz_add_ui(tmpz, *offset, values[i]);
+                if ((mpz_cmp(tmpz, lowlimit) >= 0) && (mpz_cmp(highlimit, tmpz) >= 0))
+                {
+                    values[(*num_p)++] = values[i];
+                }
+			}
+		}
+		else
+		{
+			//we don't need to mess with the requested range,
+			//so GetPRIMESRange will return the requested range directly
+			//and the count will be in NUM_P
+			values = GetPRIMESRange(sdata, offset, 0, range, num_p);
+		}
+
+		if (deep && (num_witnesses == 0))
+		{
+			*num_p = deep_sieve_values(sdata, offset, values, *num_p,
+				sdata->sieve_p[sdata->num_sp - 1], sieve_limit);
 		}
 
 		if (mpz_cmp(*offset, lowlimit) != 0)
@@ -657,49 +1082,31 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 		// now dump the requested range of primes to a file, or the
 		// screen, both, or neither, depending on the state of a couple
 		// global configuration variables
+		mpz_set(tmpz, lowlimit);
 		if (PRIMES_TO_FILE)
 		{
-			FILE *out;
-			if (num_witnesses > 0)
-				out = fopen("prp_values.dat", "w");
-			else
-				out = fopen("sieved_values.dat","w");
+			const char *filename = (num_witnesses > 0) ? 
+				"prp_values.dat" : "sieved_values.dat";
+			soe_writer_t *out = soe_writer_open(filename, SOE_OUTPUT_TEXT, 0, 0);
 
-			if (out == NULL)
-			{
-				printf("fopen error: %s\n", strerror(errno));
-				printf("can't open file for writing\n");
-			}
-			else
+			if (out != NULL)
 			{
-				for (i = 0; i < *num_p; i++)
-				{
-					//mpz_add_ui(tmpz, *offset, values[i]);
-					mpz_add_ui(tmpz, lowlimit, values[i]);
-                    if ((mpz_cmp(tmpz, lowlimit) >= 0) && (mpz_cmp(highlimit, tmpz) >= 0))
-                    {
-                        char* buf = mpz_get_str(NULL, 10, tmpz);
-                        fprintf(out, "%s\n", buf);
-                        free(buf);
-                    }
-				}
-				fclose(out);
+				soe_writer_decimal(out, sdata, &tmpz, values, *num_p, 0, range);
+				soe_writer_close(out, filename);
 			}
 		}
 
 		if (PRIMES_TO_SCREEN)
 		{
-			for (i = 0; i < *num_p; i++)
-			{
-				//mpz_add_ui(tmpz, *offset, values[i]);
-				mpz_add_ui(tmpz, lowlimit, values[i]);
-                if ((mpz_cmp(tmpz, lowlimit) >= 0) && (mpz_cmp(highlimit, tmpz) >= 0))
-                {
-                    gmp_printf("%Zd\n", tmpz);
-                }
-			}
+			soe_print_decimal(sdata, &tmpz, values, *num_p, 0, range, '\n');
 			printf("\n");
 		}			
+
+		if (count)
+		{
+			free(values);
+			values = NULL;
+		}
 	}
 
 	mpz_clear(tmpz);
@@ -709,4 +1116,191 @@ uint64_t *sieve_to_depth(soe_staticdata_t* sdata,
 	return values;
 }
 
+soe_bitmap_t *sieve_to_depth_bitmap(soe_staticdata_t* sdata,
+	mpz_t lowlimit, mpz_t highlimit, uint64_t *num_p)
+{
+	// sieve [lowlimit, highlimit] like sieve_to_depth, but return the 
+	// survivors as the sieved lines themselves, one bit per wheel slot,
+	// instead of a list of offsets.  soe_bitmap_values expands them to
+	// offsets from lowlimit.  Sieve primes inside the range are not
+	// flagged.
+	soe_bitmap_t *bm;
+	uint64_t range, tmph;
+	mpz_t tmpz;
+	mpz_t *offset;
+
+	if (mpz_cmp(highlimit, lowlimit) <= 0)
+	{
+		printf("error: lowlimit must be less than highlimit\n");
+		*num_p = 0;
+		return NULL;
+	}	
+
+	offset = (mpz_t *)malloc(sizeof(mpz_t));
+	mpz_init(tmpz);
+	mpz_init(*offset);
+	mpz_set(*offset, lowlimit);
+	mpz_sub(tmpz, highlimit, lowlimit);
+	range = mpz_get_ui(tmpz);
+
+	// the sieve needs a range of at least 1e6; the bitmap
+	// is clipped to the requested range afterwards.
+	tmph = MAX(range, 1000000);
+
+	bm = (soe_bitmap_t *)xcalloc(1, sizeof(soe_bitmap_t));
+	sdata->bitmap = bm;
+	spSOE(sdata, offset, 0, &tmph, 0, NULL);
+	sdata->bitmap = NULL;
+
+	// sieving may have lowered the offset to suit the wheel
+	mpz_sub(tmpz, lowlimit, *offset);
+	bitmap_clip(bm, mpz_get_ui(tmpz), mpz_get_ui(tmpz) + range);
+	*num_p = bm->num;
+
+	if (sdata->VFLAG > 0)
+	{
+		printf("%" PRIu64 " survivors in %" PRIu64 " bytes of bitmap\n",
+			bm->num, bm->numlinebytes * bm->numclasses);
+	}
+
+	mpz_clear(tmpz);
+	mpz_clear(*offset);
+	free(offset);
+
+	return bm;
+}
+
+typedef struct
+{
+	uint32_t threshold;
+	uint64_t **values;		// per-thread candidate lists
+	uint64_t *num;
+	uint64_t *alloc;
+} smooth_userdata_t;
+
+static void smooth_block_fcn(soe_factor_block_t *b, void *vptr)
+{
+	smooth_userdata_t *u = (smooth_userdata_t *)vptr;
+	int tid = b->tindex;
+	uint32_t i;
+
+	for (i = 0; i < b->num; i++)
+	{
+		if (b->logp[i] >= u->threshold)
+		{
+			if (u->num[tid] == u->alloc[tid])
+			{
+				u->alloc[tid] *= 2;
+				u->values[tid] = (uint64_t *)xrealloc(u->values[tid],
+					u->alloc[tid] * sizeof(uint64_t));
+			}
+			u->values[tid][u->num[tid]++] = b->lowlimit + i;
+		}
+	}
+
+	return;
+}
+
+static int cmp_uint64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+uint64_t *sieve_to_depth_smooth(soe_staticdata_t* sdata,
+	mpz_t lowlimit, mpz_t highlimit, uint64_t sieve_limit,
+	uint32_t threshold, uint64_t *num_found)
+{
+	// public interface to a smoothness sieve over a range of integers.
+	// Each integer accumulates floor(log2 p) for every prime p <= sieve_limit
+	// that divides it (and once more if p^2 divides it).  The offsets from
+	// lowlimit of the integers reaching threshold bits are returned in
+	// ascending order.  Unlike sieve_to_depth, which sieves the residue
+	// classes coprime to a small primorial, every integer in the range
+	// is visited here, since those are exactly the ones with small factors.
+	smooth_userdata_t u;
+	uint64_t *values;
+	uint64_t range, i;
+	mpz_t tmpz;
+	int j;
+
+	*num_found = 0;
+
+	if (mpz_cmp(highlimit, lowlimit) <= 0)
+	{
+		printf("error: lowlimit must be less than highlimit\n");
+		return NULL;
+	}
+
+	if ((threshold == 0) || (threshold > 255))
+	{
+		printf("error: smoothness threshold must be between 1 and 255 bits\n");
+		return NULL;
+	}
+
+	if ((sieve_limit < 2) || (sieve_limit > 0xffffffffULL))
+	{
+		printf("error: sieve limit must be between 2 and 2^32\n");
+		return NULL;
+	}
+
+	mpz_init(tmpz);
+	mpz_sub(tmpz, highlimit, lowlimit);
+	if (mpz_sizeinbase(tmpz, 2) > 40)
+	{
+		printf("range too big\n");
+		mpz_clear(tmpz);
+		return NULL;
+	}
+	range = mpz_get_ui(tmpz);
+	mpz_set(tmpz, lowlimit);
+
+	u.threshold = threshold;
+	u.values = (uint64_t **)malloc(sdata->THREADS * sizeof(uint64_t *));
+	u.num = (uint64_t *)calloc(sdata->THREADS, sizeof(uint64_t));
+	u.alloc = (uint64_t *)malloc(sdata->THREADS * sizeof(uint64_t));
+	for (j = 0; j < sdata->THREADS; j++)
+	{
+		u.alloc[j] = 1024;
+		u.values[j] = (uint64_t *)xmalloc(u.alloc[j] * sizeof(uint64_t));
+	}
+
+	if (sdata->VFLAG > 0)
+	{
+		gmp_printf("smoothness sieve on %Zd : %Zd with primes up to %" PRIu64
+			", threshold %u bits\n", lowlimit, highlimit, sieve_limit, threshold);
+	}
+
+	factor_range(sdata, &tmpz, 0, range, sieve_limit, SOE_FACTOR_LOGP,
+		&smooth_block_fcn, &u);
+	mpz_clear(tmpz);
+
+	// gather the per-thread lists.  blocks finish in no particular order.
+	for (j = 0; j < sdata->THREADS; j++)
+		*num_found += u.num[j];
+
+	values = (uint64_t *)xmalloc((*num_found + 1) * sizeof(uint64_t));
+	i = 0;
+	for (j = 0; j < sdata->THREADS; j++)
+	{
+		memcpy(values + i, u.values[j], u.num[j] * sizeof(uint64_t));
+		i += u.num[j];
+		free(u.values[j]);
+	}
+	qsort(values, *num_found, sizeof(uint64_t), &cmp_uint64);
+
+	free(u.values);
+	free(u.num);
+	free(u.alloc);
+
+	if (sdata->VFLAG > 0)
+	{
+		printf("found %" PRIu64 " smooth candidates\n", *num_found);
+	}
+
+	return values;
+}
+
 